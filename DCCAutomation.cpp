@@ -0,0 +1,173 @@
+#include "DCCAutomation.h"
+
+DCCAutomation::DCCAutomation(DCCPacketScheduler &new_scheduler, DCC_sensor_source_t new_sensors) : steps_run(0), retries(0), bad_steps(0),
+    scheduler(new_scheduler), sensors(new_sensors), cursor(0)
+{
+  for(uint8_t i = 0; i < DCC_AUTOMATION_SLOTS; ++i)
+    slots[i].flags = 0;
+  for(uint8_t i = 0; i < DCC_AUTOMATION_LOCKS; ++i)
+    lock_owner[i] = DCC_AUTOMATION_NONE;
+}
+
+uint8_t DCCAutomation::start(const DCCAutomationStep *program, uint16_t loco, uint8_t loco_kind)
+{
+  uint8_t length = 0;
+  while((program[length].op & DCC_AUTO_OP_MASK) != DCC_AUTO_OP_END)
+  {
+    if(++length == DCC_AUTOMATION_MAX_STEPS)
+      return DCC_AUTOMATION_NONE;
+  }
+  for(uint8_t i = 0; i < DCC_AUTOMATION_SLOTS; ++i)
+  {
+    if(slots[i].flags & DCC_AUTO_RUNNING)
+      continue;
+    slots[i].program = program;
+    slots[i].loco = loco;
+    slots[i].loco_kind = loco_kind;
+    slots[i].pc = 0;
+    slots[i].length = length;
+    slots[i].flags = DCC_AUTO_RUNNING;
+    return i;
+  }
+  return DCC_AUTOMATION_NONE;
+}
+
+void DCCAutomation::stop(uint8_t slot)
+{
+  slots[slot].flags = 0;
+  for(uint8_t i = 0; i < DCC_AUTOMATION_LOCKS; ++i)
+  {
+    if(lock_owner[i] == slot)
+      lock_owner[i] = DCC_AUTOMATION_NONE;
+  }
+}
+
+void DCCAutomation::stopAll(void)
+{
+  for(uint8_t i = 0; i < DCC_AUTOMATION_SLOTS; ++i)
+    stop(i);
+}
+
+uint8_t DCCAutomation::getRunning(void)
+{
+  uint8_t running = 0;
+  for(uint8_t i = 0; i < DCC_AUTOMATION_SLOTS; ++i)
+  {
+    if(slots[i].flags & DCC_AUTO_RUNNING)
+      ++running;
+  }
+  return running;
+}
+
+void DCCAutomation::update(uint8_t budget)
+{
+  if(budget > DCC_AUTOMATION_SLOTS)
+    budget = DCC_AUTOMATION_SLOTS; //one round is enough
+  while(budget--)
+  {
+    uint8_t slot = cursor;
+    cursor = (cursor + 1 < DCC_AUTOMATION_SLOTS) ? cursor + 1 : 0;
+    if(slots[slot].flags & DCC_AUTO_RUNNING)
+      step(slot);
+  }
+}
+
+void DCCAutomation::step(uint8_t slot)
+{
+  DCCAutomationSlot *s = &slots[slot];
+  const DCCAutomationStep *current = &s->program[s->pc];
+  uint8_t op = current->op & DCC_AUTO_OP_MASK;
+  if(op > DCC_AUTO_OP_JUMP || (op == DCC_AUTO_OP_JUMP && current->value > s->length)
+      || ((op == DCC_AUTO_OP_LOCK || op == DCC_AUTO_OP_UNLOCK) && current->arg >= DCC_AUTOMATION_LOCKS))
+  {
+    ++bad_steps;
+    stop(slot);
+    return;
+  }
+  switch(op)
+  {
+    case DCC_AUTO_OP_END:
+      stop(slot);
+      return;
+    case DCC_AUTO_OP_WAIT:
+      if(!(s->flags & DCC_AUTO_WAITING))
+      {
+        s->wake = millis() + current->value;
+        s->flags |= DCC_AUTO_WAITING;
+        return;
+      }
+      if((long)(millis() - s->wake) < 0)
+        return;
+      s->flags &= ~DCC_AUTO_WAITING;
+      break;
+    case DCC_AUTO_OP_WAIT_SENSOR:
+      if(!sensors || (!sensors(current->address) != !current->arg))
+        return;
+      break;
+    case DCC_AUTO_OP_LOCK:
+      if(lock_owner[current->arg] != DCC_AUTOMATION_NONE && lock_owner[current->arg] != slot)
+        return;
+      lock_owner[current->arg] = slot;
+      break;
+    case DCC_AUTO_OP_UNLOCK:
+      if(lock_owner[current->arg] == slot)
+        lock_owner[current->arg] = DCC_AUTOMATION_NONE;
+      break;
+    case DCC_AUTO_OP_JUMP:
+      s->pc = current->value;
+      ++steps_run;
+      return;
+    default:
+      if(!command(s, current))
+      {
+        ++retries; //the queues are full; try again next visit
+        return;
+      }
+  }
+  ++s->pc;
+  ++steps_run;
+}
+
+bool DCCAutomation::command(DCCAutomationSlot *slot, const DCCAutomationStep *s)
+{
+  uint16_t address = s->address;
+  uint8_t address_kind = (s->op & DCC_AUTO_LONG) ? DCC_LONG_ADDRESS : DCC_SHORT_ADDRESS;
+  if(!address)
+  {
+    address = slot->loco;
+    address_kind = slot->loco_kind;
+  }
+  switch(s->op & DCC_AUTO_OP_MASK)
+  {
+    case DCC_AUTO_OP_SPEED:
+      return scheduler.setSpeed(address, address_kind, (int8_t)s->value, s->arg);
+    case DCC_AUTO_OP_FUNCTIONS:
+      if(!(slot->flags & DCC_AUTO_F0_SENT))
+      {
+        if(!scheduler.setFunctions0to4(address, address_kind, s->value & 0x1F))
+          return false;
+        slot->flags |= DCC_AUTO_F0_SENT;
+      }
+      if(!(slot->flags & DCC_AUTO_F5_SENT))
+      {
+        if(!scheduler.setFunctions5to8(address, address_kind, (s->value >> 5) & 0x0F))
+          return false;
+        slot->flags |= DCC_AUTO_F5_SENT;
+      }
+      if(!scheduler.setFunctions9to12(address, address_kind, (s->value >> 9) & 0x0F))
+        return false;
+      slot->flags &= ~(DCC_AUTO_F0_SENT | DCC_AUTO_F5_SENT);
+      return true;
+    case DCC_AUTO_OP_E_STOP:
+      return scheduler.eStop(address, address_kind);
+#if DCC_ACCESSORIES
+    case DCC_AUTO_OP_ACCESSORY:
+      return s->value ? scheduler.setBasicAccessory(s->address, s->arg) : scheduler.unsetBasicAccessory(s->address, s->arg);
+#endif
+#if DCC_PULSE_TIMERS
+    case DCC_AUTO_OP_PULSE:
+      return scheduler.pulseAccessory(s->address, s->arg, s->value);
+#endif
+  }
+  return true; //not built in this profile, or unknown: skipped
+}
@@ -0,0 +1,143 @@
+#ifndef __DCCAUTOMATION_H__
+#define __DCCAUTOMATION_H__
+
+#include "Arduino.h"
+#include "DCCPacketScheduler.h"
+
+/**
+ * Table-driven automation: shuttles, block-occupancy triggers and interlocking, without delay().
+ * A program is a const array of DCCAutomationStep, written with the DCC_AUTO_* macros below:
+ *
+ *   const DCCAutomationStep shuttle[] = {
+ *     DCC_AUTO_LOCK(0),                  //take block 0, waiting for any other sequence to release it
+ *     DCC_AUTO_SPEED(0, 40, 0),          //this sequence's loco, speed 40 forward, default steps
+ *     DCC_AUTO_WAIT_SENSOR(3, 1),        //until sensor 3 reports occupied
+ *     DCC_AUTO_SPEED(0, 1, 0),           //stop
+ *     DCC_AUTO_UNLOCK(0),
+ *     DCC_AUTO_WAIT_MS(5000),
+ *     DCC_AUTO_ACCESSORY(12, 1, 1),      //throw turnout 12
+ *     DCC_AUTO_JUMP(0),
+ *     DCC_AUTO_END()
+ *   };
+ *
+ * Every program ends at its first DCC_AUTO_END(), even one that loops forever and never reaches it: start()
+ * measures the program by it, and refuses one with no END in its first 255 steps. A step that could only run
+ * outside the program or the lock table (a JUMP beyond the END, a LOCK or UNLOCK of a lock beyond
+ * DCC_AUTOMATION_LOCKS, an unknown opcode) stops its sequence there instead, as stop() would, and is counted.
+ *
+ * start() runs a program in one of DCC_AUTOMATION_SLOTS slots; any number of slots may run the same
+ * program, each for its own loco (address 0 in a step means the slot's loco). Every slot is a resumable
+ * state machine: a program counter, a wake-up time and nothing else, so no sequence ever blocks another.
+ *
+ * update() costs at most budget units, one per slot visited: slots are visited round-robin from where the
+ * last call stopped, and each visit runs at most one step. A step that is waiting, or a command the scheduler
+ * refuses because its queues are full, is tried again on the slot's next visit (so one it can never accept,
+ * such as 14 steps in a build without them, holds its sequence there). A FUNCTIONS step takes three packets and
+ * resumes from the first one refused, so it gets through even a queue with fewer than three slots free. Automation therefore never takes more
+ * than its share of loop(), and never outruns the queues; call it alongside the scheduler:
+ *
+ *   void loop() { automation.update(); dps.update(); }
+ *
+ * Sensors are read through a DCC_sensor_source_t, the sketch's own (debounced) view of its detectors.
+ * Locks are DCC_AUTOMATION_LOCKS named mutexes, one per block or route; a sequence stopped by stop()
+ * gives up the locks it held.
+**/
+
+#ifndef DCC_AUTOMATION_SLOTS
+#define DCC_AUTOMATION_SLOTS    8 //sequences running at once; 12 bytes each. At most 254
+#endif
+#ifndef DCC_AUTOMATION_LOCKS
+#define DCC_AUTOMATION_LOCKS    16
+#endif
+#define DCC_AUTOMATION_BUDGET   8 //slot visits per update() call
+#define DCC_AUTOMATION_NONE     0xFF
+#define DCC_AUTOMATION_MAX_STEPS 255 //in a program, END included
+
+typedef uint8_t (*DCC_sensor_source_t)(uint16_t sensor); //non-zero while the sensor is active (occupied)
+
+//opcodes; OR in DCC_AUTO_LONG for a long loco address
+#define DCC_AUTO_OP_END         0x00
+#define DCC_AUTO_OP_SPEED       0x01 //address, arg = steps (0 = default), value = speed as int8_t [-127,127]
+#define DCC_AUTO_OP_FUNCTIONS   0x02 //address, value = function bitmask, F0 = bit 0
+#define DCC_AUTO_OP_E_STOP      0x03 //address
+#define DCC_AUTO_OP_ACCESSORY   0x04 //address, arg = function, value = 1 to set, 0 to unset
+#define DCC_AUTO_OP_PULSE       0x05 //address, arg = function, value = ms (needs DCC_PULSE_TIMERS)
+#define DCC_AUTO_OP_WAIT        0x06 //value = ms
+#define DCC_AUTO_OP_WAIT_SENSOR 0x07 //address = sensor, arg = state to wait for (0 or 1)
+#define DCC_AUTO_OP_LOCK        0x08 //arg = lock; waits until no other sequence holds it
+#define DCC_AUTO_OP_UNLOCK      0x09 //arg = lock
+#define DCC_AUTO_OP_JUMP        0x0A //value = step index
+#define DCC_AUTO_OP_MASK        0x7F
+#define DCC_AUTO_LONG           0x80
+
+struct DCCAutomationStep
+{
+  uint8_t op;
+  uint8_t arg;
+  uint16_t address;
+  uint16_t value;
+};
+
+#define DCC_AUTO_SPEED(address, speed, steps)       { DCC_AUTO_OP_SPEED, (steps), (address), (uint16_t)(int16_t)(speed) }
+#define DCC_AUTO_FUNCTIONS(address, functions)      { DCC_AUTO_OP_FUNCTIONS, 0, (address), (functions) }
+#define DCC_AUTO_E_STOP(address)                    { DCC_AUTO_OP_E_STOP, 0, (address), 0 }
+#define DCC_AUTO_ACCESSORY(address, function, on)   { DCC_AUTO_OP_ACCESSORY, (function), (address), (on) }
+#define DCC_AUTO_PULSE(address, function, ms)       { DCC_AUTO_OP_PULSE, (function), (address), (ms) }
+#define DCC_AUTO_WAIT_MS(ms)                        { DCC_AUTO_OP_WAIT, 0, 0, (ms) }
+#define DCC_AUTO_WAIT_SENSOR(sensor, state)         { DCC_AUTO_OP_WAIT_SENSOR, (state), (sensor), 0 }
+#define DCC_AUTO_LOCK(lock)                         { DCC_AUTO_OP_LOCK, (lock), 0, 0 }
+#define DCC_AUTO_UNLOCK(lock)                       { DCC_AUTO_OP_UNLOCK, (lock), 0, 0 }
+#define DCC_AUTO_JUMP(step)                         { DCC_AUTO_OP_JUMP, 0, 0, (step) }
+#define DCC_AUTO_END()                              { DCC_AUTO_OP_END, 0, 0, 0 }
+
+#define DCC_AUTO_RUNNING  0x01
+#define DCC_AUTO_WAITING  0x02 //wake is set for the WAIT step at pc
+#define DCC_AUTO_F0_SENT  0x04 //the FUNCTIONS step at pc has queued F0-F4
+#define DCC_AUTO_F5_SENT  0x08 //and F5-F8
+
+struct DCCAutomationSlot
+{
+  const DCCAutomationStep *program;
+  unsigned long wake; //millis()
+  uint16_t loco;
+  uint8_t loco_kind;
+  uint8_t pc;
+  uint8_t length; //steps before the program's END
+  uint8_t flags;
+};
+
+class DCCAutomation
+{
+  public:
+    DCCAutomation(DCCPacketScheduler &new_scheduler, DCC_sensor_source_t new_sensors = 0);
+
+    inline void setSensorSource(DCC_sensor_source_t new_sensors) { sensors = new_sensors; }
+
+    //run program for loco; returns the slot, or DCC_AUTOMATION_NONE if every slot is busy or program has no END
+    uint8_t start(const DCCAutomationStep *program, uint16_t loco = 0, uint8_t loco_kind = DCC_SHORT_ADDRESS);
+    void stop(uint8_t slot); //also releases its locks; the loco keeps whatever speed it had
+    void stopAll(void);
+    inline bool isRunning(uint8_t slot) { return slots[slot].flags & DCC_AUTO_RUNNING; }
+    inline uint8_t getStep(uint8_t slot) { return slots[slot].pc; }
+    uint8_t getRunning(void);
+
+    //to be called periodically within loop(); visits at most budget slots
+    void update(uint8_t budget = DCC_AUTOMATION_BUDGET);
+
+    //results
+    uint32_t steps_run;
+    uint32_t retries; //commands the scheduler refused, tried again later
+    uint32_t bad_steps; //sequences stopped at a step they could not run
+
+  public: //protected:
+    void step(uint8_t slot); //run or retry the step at the slot's pc
+    bool command(DCCAutomationSlot *slot, const DCCAutomationStep *s);
+
+    DCCPacketScheduler &scheduler;
+    DCC_sensor_source_t sensors;
+    DCCAutomationSlot slots[DCC_AUTOMATION_SLOTS];
+    uint8_t lock_owner[DCC_AUTOMATION_LOCKS]; //slot, or DCC_AUTOMATION_NONE
+    uint8_t cursor; //next slot to visit
+};
+
+#endif //__DCCAUTOMATION_H__
@@ -0,0 +1,260 @@
+#include "DCCBenchmark.h"
+
+#if !defined(ARDUINO)
+
+#include <chrono>
+#include <string.h>
+#include "DCCPacketScheduler.h"
+#include "DCCHardwareHost.h"
+#include "DCCSimulator.h"
+#include "DCCCommandParser.h"
+#include "DCCBinaryProtocol.h"
+
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Put packets on the rails until the pool has free slots again (or give up), so the next commands decoded
+/// meet queues with room in them rather than being turned away
+static void drain(DCCPacketScheduler &scheduler, uint8_t free)
+{
+  for(uint16_t i = 0; i < 1000 && scheduler.packet_pool.getFreeCount() < free; ++i)
+  {
+    scheduler.update();
+    if(!DCC_waveform_ready())
+      DCC_host_waveform_complete();
+  }
+}
+
+DCCBenchmark::DCCBenchmark(uint32_t new_iterations) : iterations(new_iterations), sink(0)
+{
+}
+
+void DCCBenchmark::record(const char *name, uint64_t ns, double wire_bytes)
+{
+  DCCBenchResult result = { name, iterations, (double)ns / iterations, wire_bytes };
+  results.push_back(result);
+}
+
+void DCCBenchmark::run(void)
+{
+  benchBitstream();
+  benchQueue();
+  benchRepeatQueue();
+  benchUpdate();
+  benchTextDecode();
+  benchBinaryDecode();
+}
+
+void DCCBenchmark::benchBitstream(void)
+{
+  uint8_t data[] = {0x3F, 0x00};
+  uint8_t bitstream[6];
+  DCCPacket p(3, DCC_SHORT_ADDRESS);
+  p.addData(data, 2);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    data[1] = i;
+    p.addData(data, 2);
+    sink += p.getBitstream(bitstream) + bitstream[2];
+  }
+  record("bitstream", elapsed_ns(start));
+}
+
+void DCCBenchmark::benchQueue(void)
+{
+  uint8_t data[] = {0x3F, 0x00};
+  DCCPacketPool pool;
+  DCCPacketQueue queue;
+  pool.setup(PACKET_POOL_SIZE);
+  queue.setup(&pool, 4);
+  DCCPacket p(3, DCC_SHORT_ADDRESS);
+  p.addData(data, 2);
+  p.setKind(speed_packet_kind);
+  DCCPacket out;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    p.setAddress(3 + (i & 0x07));
+    queue.insertPacket(&p);
+    if(i & 0x01) //keep a couple of packets queued, so inserts scan for duplicates
+      sink += queue.readPacket(&out) + out.getAddress();
+  }
+  record("queue", elapsed_ns(start));
+}
+
+void DCCBenchmark::benchRepeatQueue(void)
+{
+  uint8_t data[] = {0x80};
+  DCCPacketPool pool;
+  DCCRepeatQueue queue;
+  pool.setup(PACKET_POOL_SIZE);
+  queue.setup(&pool, 8);
+  DCCPacket p(3, DCC_SHORT_ADDRESS);
+  p.addData(data, 1);
+  p.setKind(function_packet_1_kind);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    if(queue.isEmpty())
+    {
+      for(uint8_t a = 0; a < 8; ++a)
+      {
+        p.setAddress(3 + a);
+        p.setRepeat(3);
+        queue.insertPacket(&p);
+      }
+    }
+    sink += queue.peekPacket()->getAddress();
+    queue.releasePacket();
+  }
+  record("repeat_queue", elapsed_ns(start));
+}
+
+void DCCBenchmark::benchUpdate(void)
+{
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    if(!(i & 0x0F))
+      scheduler.setSpeed(3 + ((i >> 4) & 0x07), DCC_SHORT_ADDRESS, 2 + ((i >> 7) & 0x3F));
+    if(!(i & 0x3F))
+      scheduler.setFunctions(3 + ((i >> 6) & 0x07), DCC_SHORT_ADDRESS, (uint16_t)(i >> 6));
+    scheduler.update();
+    sink += DCC_host_packet[0];
+    DCC_host_waveform_complete();
+  }
+  record("update", elapsed_ns(start));
+}
+
+void DCCBenchmark::decodeCommand(uint32_t i, uint16_t *address, bool *functions, int16_t *value)
+{
+  *address = 3 + (i & 0x07);
+  *functions = (i & 0x03) == 0x03;
+  *value = *functions ? (int16_t)((i >> 3) & 0x1FFF) : (int16_t)((i >> 3) % 255) - 127;
+}
+
+void DCCBenchmark::benchTextDecode(void)
+{
+  std::vector<char> stream;
+  std::vector<size_t> batches; //where each batch of DCC_BINARY_MAX_COMMANDS lines ends, as a frame would
+  char line[16];
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    if(i && !(i % DCC_BINARY_MAX_COMMANDS))
+      batches.push_back(stream.size());
+    uint16_t address;
+    bool functions;
+    int16_t value;
+    decodeCommand(i, &address, &functions, &value);
+    int size = snprintf(line, sizeof(line), "%c %u %d\n", functions ? 'F' : 'S', address, value);
+    stream.insert(stream.end(), line, line + size);
+  }
+  batches.push_back(stream.size());
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  drain(scheduler, PACKET_POOL_SIZE);
+  uint8_t free = scheduler.packet_pool.getFreeCount();
+  DCCCommandParser parser(scheduler);
+  uint64_t ns = 0;
+  size_t i = 0;
+  for(size_t batch = 0; batch < batches.size(); ++batch)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(; i < batches[batch]; ++i)
+      sink += parser.parse(stream[i]);
+    ns += elapsed_ns(start);
+    drain(scheduler, free); //untimed
+  }
+  record("text_decode", ns, (double)stream.size() / iterations);
+}
+
+void DCCBenchmark::benchBinaryDecode(void)
+{
+  std::vector<uint8_t> stream;
+  uint8_t checksum = 0;
+  for(uint32_t i = 0; i < iterations; ++i)
+  {
+    if(!(i % DCC_BINARY_MAX_COMMANDS))
+    {
+      uint8_t count = (iterations - i < DCC_BINARY_MAX_COMMANDS) ? iterations - i : DCC_BINARY_MAX_COMMANDS;
+      stream.push_back(DCC_BINARY_SYNC);
+      stream.push_back(count);
+      checksum = count;
+    }
+    uint16_t address;
+    bool functions;
+    int16_t value;
+    decodeCommand(i, &address, &functions, &value);
+    uint8_t command[DCC_BINARY_COMMAND_SIZE] = { (uint8_t)(functions ? DCC_BINARY_OP_FUNCTIONS : DCC_BINARY_OP_SPEED),
+      (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(functions ? value >> 8 : value), (uint8_t)(functions ? value : 0) };
+    for(uint8_t b = 0; b < DCC_BINARY_COMMAND_SIZE; ++b)
+    {
+      stream.push_back(command[b]);
+      checksum ^= command[b];
+    }
+    if(i % DCC_BINARY_MAX_COMMANDS == DCC_BINARY_MAX_COMMANDS - 1 || i == iterations - 1)
+      stream.push_back(checksum);
+  }
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  drain(scheduler, PACKET_POOL_SIZE);
+  uint8_t free = scheduler.packet_pool.getFreeCount();
+  DCCBinaryProtocol protocol(scheduler);
+  uint64_t ns = 0;
+  size_t i = 0;
+  while(i < stream.size())
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(i < stream.size() && !protocol.receive(stream[i++])) //a frame at a time
+      ;
+    sink += protocol.getReply()[1];
+    ns += elapsed_ns(start);
+    drain(scheduler, free); //untimed
+  }
+  record("binary_decode", ns, (double)stream.size() / iterations);
+}
+
+void DCCBenchmark::report(FILE *out)
+{
+  double text_bytes = 0, binary_bytes = 0;
+  for(size_t i = 0; i < results.size(); ++i)
+  {
+    fprintf(out, "%-14s %10u iterations %8.1fns/op", results[i].name, results[i].iterations, results[i].ns_per_op);
+    if(results[i].wire_bytes)
+      fprintf(out, " %10.0f commands/s %5.2f wire bytes/command", 1e9 / results[i].ns_per_op, results[i].wire_bytes);
+    fprintf(out, "\n");
+    if(!strcmp(results[i].name, "text_decode"))
+      text_bytes = results[i].wire_bytes;
+    else if(!strcmp(results[i].name, "binary_decode"))
+      binary_bytes = results[i].wire_bytes;
+  }
+  if(text_bytes && binary_bytes)
+    fprintf(out, "wire bytes, text/binary: %.2f\n", text_bytes / binary_bytes);
+}
+
+void DCCBenchmark::writeResults(FILE *out, DCCSimulator *load)
+{
+  fprintf(out, "{\"profile\":\"%s\",\"microbenchmarks\":{", DCC_PROFILE_NAME);
+  for(size_t i = 0; i < results.size(); ++i)
+  {
+    fprintf(out, "%s\"%s\":{\"iterations\":%u,\"ns_per_op\":%.2f", i ? "," : "", results[i].name,
+      results[i].iterations, results[i].ns_per_op);
+    if(results[i].wire_bytes)
+      fprintf(out, ",\"commands_per_s\":%.0f,\"wire_bytes_per_command\":%.2f", 1e9 / results[i].ns_per_op, results[i].wire_bytes);
+    fprintf(out, "}");
+  }
+  fprintf(out, "}");
+  if(load)
+  {
+    fprintf(out, ",\"load\":");
+    load->writeResults(out);
+  }
+  fprintf(out, "}\n");
+}
+
+#endif //!ARDUINO
@@ -0,0 +1,78 @@
+#ifndef __DCCBENCHMARK_H__
+#define __DCCBENCHMARK_H__
+
+/**
+ * Host microbenchmarks for the packet pipeline, for catching performance regressions before
+ * flashing a board. Each benchmark times one operation in a tight loop on the host CPU:
+ *   bitstream     DCCPacket::getBitstream() of a 128-step speed packet
+ *   queue         DCCPacketQueue::insertPacket() then readPacket(), cycling through 8 addresses
+ *   repeat_queue  DCCRepeatQueue::peekPacket()/releasePacket() rotating 8 packets that repeat
+ *   update        DCCPacketScheduler::update() with one packet completed per call, under a
+ *                 steady trickle of speed and function commands
+ *   text_decode   DCCCommandParser::parse() of a stream of speed and function commands for 8 locos, per command
+ *   binary_decode DCCBinaryProtocol::receive() of the same commands in full frames, per command
+ * The two decode benchmarks also give commands/s and the wire bytes each command took, and report() the ratio
+ * of text bytes to binary bytes. Between frames (12 commands; 12 lines of text) the queues are drained, untimed,
+ * so every command is decoded into a queue with room for it, as on a layout that keeps up.
+ * Absolute numbers are host numbers; compare them between builds on the same machine, not with the AVR.
+ *
+ * Together with a DCCSimulator load run (a recorded script via loadFile(), or the add*() generators,
+ * replayed in simulated time far faster than real time), writeResults() produces one JSON document:
+ *   {"profile":"full","microbenchmarks":{"bitstream":{"iterations":N,"ns_per_op":X},...},"load":{...}}
+ * with "load" as written by DCCSimulator::writeResults(). extras/host builds the library against an Arduino
+ * shim, with dcc_bench wrapping all of this:
+ *
+ *   make -C extras/host bench                 writes extras/host/bench_results.json
+ *   make -C extras/host PROFILE=1 bench       the same for another build profile
+ *
+ * and its -s option replays a recorded script instead of the synthetic load.
+**/
+
+#if !defined(ARDUINO)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+class DCCSimulator;
+
+#define DCC_BENCH_DEFAULT_ITERATIONS 200000
+
+struct DCCBenchResult
+{
+  const char *name;
+  uint32_t iterations;
+  double ns_per_op;
+  double wire_bytes; //per op, for the decode benchmarks; 0 otherwise
+};
+
+class DCCBenchmark
+{
+  public:
+    DCCBenchmark(uint32_t new_iterations = DCC_BENCH_DEFAULT_ITERATIONS);
+    
+    void run(void); //all of the microbenchmarks below
+    void benchBitstream(void);
+    void benchQueue(void);
+    void benchRepeatQueue(void);
+    void benchUpdate(void);
+    void benchTextDecode(void);
+    void benchBinaryDecode(void);
+    
+    void report(FILE *out); //human-readable
+    void writeResults(FILE *out, DCCSimulator *load = 0); //JSON, as above
+    
+    std::vector<DCCBenchResult> results;
+    
+  private:
+    void record(const char *name, uint64_t ns, double wire_bytes = 0);
+    //the command benchDecode*() sends as the ith: speeds, and every 4th a function update, for locos 3-10
+    static void decodeCommand(uint32_t i, uint16_t *address, bool *functions, int16_t *value);
+    
+    uint32_t iterations;
+    uint32_t sink; //folds in every result so the loops cannot be optimised away
+};
+
+#endif //!ARDUINO
+
+#endif //__DCCBENCHMARK_H__
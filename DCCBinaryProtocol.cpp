@@ -0,0 +1,153 @@
+#include "DCCBinaryProtocol.h"
+
+DCCBinaryProtocol::DCCBinaryProtocol(DCCPacketScheduler &new_scheduler) : malformed(0), scheduler(new_scheduler), received(0), count(0), checksum(0), reply_size(0)
+{
+}
+
+bool DCCBinaryProtocol::receive(uint8_t b)
+{
+  if(!received) //hunting for the start of a frame
+  {
+    if(b == DCC_BINARY_SYNC)
+      received = 1;
+    return false;
+  }
+  
+  if(received == 1) //COUNT
+  {
+    if(!b || b > DCC_BINARY_MAX_COMMANDS)
+    {
+      received = 0;
+      reply[0] = DCC_BINARY_NAK;
+      reply_size = 1;
+      return true;
+    }
+    count = b;
+    checksum = b;
+    ++received;
+    return false;
+  }
+  
+  uint8_t body_size = count*DCC_BINARY_COMMAND_SIZE;
+  if(received - 2 < body_size) //command bytes
+  {
+    frame[received - 2] = b;
+    checksum ^= b;
+    ++received;
+    return false;
+  }
+  
+  //CHECKSUM: the frame is complete
+  received = 0;
+  if(b != checksum)
+  {
+    reply[0] = DCC_BINARY_NAK;
+    reply_size = 1;
+    return true;
+  }
+  for(uint8_t i = 0; i < count; ++i)
+  {
+    if(!check(frame + i*DCC_BINARY_COMMAND_SIZE))
+    {
+      ++malformed;
+      reply[0] = DCC_BINARY_MALFORMED;
+      reply[1] = i;
+      reply_size = 2;
+      return true;
+    }
+  }
+  reply[0] = DCC_BINARY_ACK;
+  reply[1] = dispatch(frame, count);
+  reply[2] = count;
+  reply_size = 3;
+  return true;
+}
+
+bool DCCBinaryProtocol::check(const uint8_t *command)
+{
+  uint16_t address = ((uint16_t)command[1] << 8) | command[2];
+  bool long_address = command[0] & DCC_BINARY_LONG_ADDRESS;
+  switch(command[0] & DCC_BINARY_OP_MASK)
+  {
+    case DCC_BINARY_OP_SPEED:
+      if(command[3] == 0x80) //-128 has no speed step
+        return false;
+      if(command[4] && command[4] != 14 && command[4] != 28 && command[4] != 128)
+        return false;
+      break;
+    case DCC_BINARY_OP_FUNCTIONS:
+    case DCC_BINARY_OP_POM: //10 bits of CV-1 can't leave 1-1024
+    case DCC_BINARY_OP_E_STOP:
+      break;
+    case DCC_BINARY_OP_ACCESSORY:
+      return (address <= 511) && (command[3] <= 3) && (command[4] <= 1); //9-bit address, one of its 4 outputs
+    default:
+      return false;
+  }
+  return address <= (long_address ? 10239 : 127); //getBitstream() would wrap a larger one onto another loco
+}
+
+uint8_t DCCBinaryProtocol::dispatch(const uint8_t *commands, uint8_t command_count)
+{
+  uint8_t accepted = 0;
+  for(const uint8_t *command = commands; command_count--; command += DCC_BINARY_COMMAND_SIZE)
+  {
+    uint16_t address = ((uint16_t)command[1] << 8) | command[2];
+    uint8_t address_kind = (command[0] & DCC_BINARY_LONG_ADDRESS) ? DCC_LONG_ADDRESS : DCC_SHORT_ADDRESS;
+    bool ok = false;
+    if(((command[0] & DCC_BINARY_OP_MASK) != DCC_BINARY_OP_E_STOP) && !limiter.allow())
+      continue; //over this source's rate limit
+    switch(command[0] & DCC_BINARY_OP_MASK)
+    {
+      case DCC_BINARY_OP_SPEED:
+        ok = address ? scheduler.setSpeed(address, address_kind, (int8_t)command[3], command[4]) :
+                       scheduler.setSpeedGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, (int8_t)command[3], command[4]);
+        break;
+      case DCC_BINARY_OP_FUNCTIONS:
+        ok = address ? scheduler.setFunctions(address, address_kind, (uint16_t)(((uint16_t)command[3] << 8) | command[4])) :
+                       scheduler.setFunctionsGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, (uint16_t)(((uint16_t)command[3] << 8) | command[4]));
+        break;
+      case DCC_BINARY_OP_ACCESSORY:
+#if DCC_ACCESSORIES
+        ok = command[4] ? scheduler.setBasicAccessory(address, command[3]) : scheduler.unsetBasicAccessory(address, command[3]);
+#endif
+        break;
+      case DCC_BINARY_OP_POM:
+#if DCC_OPS_PROGRAMMING
+        ok = scheduler.opsProgramCV(address, address_kind, ((((uint16_t)command[0] & 0x03) << 8) | command[3]) + 1, command[4]);
+#endif
+        break;
+      case DCC_BINARY_OP_E_STOP:
+        switch(command[0] & 0x03)
+        {
+          case 0:
+            ok = address ? scheduler.eStop(address, address_kind) : scheduler.eStop();
+            break;
+#if DCC_ESTOP_SNAPSHOT
+          case DCC_BINARY_SUSPEND:
+            ok = scheduler.suspend();
+            break;
+          case DCC_BINARY_RESUME:
+          case DCC_BINARY_RESTART:
+            ok = scheduler.resume((command[0] & 0x03) == DCC_BINARY_RESTART);
+            break;
+#endif
+        }
+        break;
+    }
+    if(ok)
+      ++accepted;
+  }
+  return accepted;
+}
+
+#if defined(ARDUINO)
+void DCCBinaryProtocol::update(Stream &port, uint8_t budget)
+{
+  while(budget-- && port.available() > 0)
+  {
+    if(receive(port.read()))
+      port.write(reply, reply_size);
+  }
+}
+#endif
@@ -0,0 +1,89 @@
+#ifndef __DCCBINARYPROTOCOL_H__
+#define __DCCBINARYPROTOCOL_H__
+
+#include "Arduino.h"
+#include "DCCPacketScheduler.h"
+
+/**
+ * A compact, framed binary alternative to DCCCommandParser for busy host links.
+ * One frame carries many commands, each a fixed five bytes, so a speed or function update costs
+ * 5 bytes (plus 3 per frame) on the wire instead of the 8-16 ASCII bytes of the text form.
+ * Frames are received into a fixed buffer and, once the checksum checks out, decoded in place
+ * and dispatched straight into the scheduler's queues.
+ *
+ * Frame:    SYNC(0xA5) COUNT CMD[COUNT] CHECKSUM     CHECKSUM = XOR of COUNT and every command byte
+ * Command:  OP AH AL X Y
+ *   OP: bits 7-4 opcode, bit 3 set for a long address, bits 1-0 opcode-specific
+ *   AH AL: address, big-endian
+ *   speed      X = speed as int8_t [-127,127], Y = steps: 0 (default), 14, 28 or 128
+ *   functions  X Y = function bitmask, big-endian, F0 = bit 0
+ *   accessory  AH AL = address 0-511, X = function 0-3, Y = 1 to set, 0 to unset
+ *   POM        OP bits 1-0 and X = CV-1 (10 bits, so CV 1-1024), Y = value
+ *   e-stop     address 0 stops everything; OP bits 1-0: 0 eStop(), 1 suspend(), 2 resume(), 3 resume() with restart
+ *   speed and functions to address 0 go to every loco (setSpeedGroup(), setFunctionsGroup() with DCC_GROUP_ALL)
+ *   A short address is at most 127 and a long one at most 10239.
+ * Reply:    ACK(0xA6) ACCEPTED COUNT, or a lone NAK(0xA7) for a frame with a bad checksum or count (resend it), or
+ *           MALFORMED(0xA8) INDEX for a frame with a field out of range or an unknown opcode, INDEX being the first
+ *           such command. A malformed frame is refused whole, so none of its commands are dispatched.
+**/
+
+#define DCC_BINARY_MAX_COMMANDS     12
+#define DCC_BINARY_COMMAND_SIZE     5
+#define DCC_BINARY_BUDGET           32 //bytes consumed per update() call, at most
+
+#define DCC_BINARY_SYNC             0xA5
+#define DCC_BINARY_ACK              0xA6
+#define DCC_BINARY_NAK              0xA7
+#define DCC_BINARY_MALFORMED        0xA8
+
+#define DCC_BINARY_OP_SPEED         0x10
+#define DCC_BINARY_OP_FUNCTIONS     0x20
+#define DCC_BINARY_OP_ACCESSORY     0x30
+#define DCC_BINARY_OP_POM           0x40
+#define DCC_BINARY_OP_E_STOP        0x50
+#define DCC_BINARY_OP_MASK          0xF0
+#define DCC_BINARY_LONG_ADDRESS     0x08
+#define DCC_BINARY_SUSPEND          0x01 //with DCC_BINARY_OP_E_STOP
+#define DCC_BINARY_RESUME           0x02
+#define DCC_BINARY_RESTART          0x03
+
+class DCCBinaryProtocol
+{
+  public:
+    DCCBinaryProtocol(DCCPacketScheduler &new_scheduler);
+    
+    //feed a single byte. Returns true once a frame has been completed (and dispatched, if it was valid);
+    //the reply to send back is then available from getReply().
+    bool receive(uint8_t b);
+    //decode and dispatch command_count commands at commands; returns how many the scheduler accepted.
+    //Each should have passed check().
+    uint8_t dispatch(const uint8_t *commands, uint8_t command_count);
+    //are the command's opcode and fields in range?
+    static bool check(const uint8_t *command);
+    
+    //limit this source to rate commands per second, in bursts of up to burst (see DCCFairShare.h); rate 0 for no limit
+    inline void setRateLimit(uint8_t rate, uint8_t burst) { limiter.setLimit(rate, burst); }
+    
+    inline const uint8_t *getReply(void) { return reply; }
+    inline uint8_t getReplySize(void) { return reply_size; }
+    
+    //results
+    uint32_t malformed; //frames refused with DCC_BINARY_MALFORMED
+    
+#if defined(ARDUINO)
+    //to be called periodically within loop(); never reads more than budget bytes, never waits for more
+    void update(Stream &port, uint8_t budget=DCC_BINARY_BUDGET);
+#endif
+
+  private:
+    DCCPacketScheduler &scheduler;
+    DCCRateLimiter limiter;
+    uint8_t frame[DCC_BINARY_MAX_COMMANDS*DCC_BINARY_COMMAND_SIZE];
+    uint8_t received; //bytes of the current frame received so far, counting SYNC and COUNT
+    uint8_t count;
+    uint8_t checksum;
+    uint8_t reply[3];
+    uint8_t reply_size;
+};
+
+#endif //__DCCBINARYPROTOCOL_H__
@@ -0,0 +1,146 @@
+#include "DCCCapture.h"
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+
+#if DCC_SNIFFER || !defined(ARDUINO)
+
+#if (DCC_CAPTURE_RING & (DCC_CAPTURE_RING - 1)) || (DCC_CAPTURE_RING > 128)
+#error "DCC_CAPTURE_RING must be a power of two, at most 128"
+#endif
+
+/// Head and tail count edges, wrapping at 256, so head - tail is the number in the ring even when it is full
+static DCC_HOST_THREAD uint16_t DCC_capture_ring[DCC_CAPTURE_RING];
+static DCC_HOST_THREAD uint8_t DCC_capture_head = 0; //written by the producer only
+static DCC_HOST_THREAD uint8_t DCC_capture_tail = 0; //written by the consumer only
+static DCC_HOST_THREAD volatile uint16_t DCC_capture_lost = 0;
+
+void DCC_capture_edge(uint16_t ticks)
+{
+  uint8_t head = DCC_capture_head;
+  if((uint8_t)(head - __atomic_load_n(&DCC_capture_tail, __ATOMIC_ACQUIRE)) == DCC_CAPTURE_RING)
+  {
+    ++DCC_capture_lost;
+    return;
+  }
+  DCC_capture_ring[head & (DCC_CAPTURE_RING - 1)] = ticks;
+  __atomic_store_n(&DCC_capture_head, (uint8_t)(head + 1), __ATOMIC_RELEASE); //publish the slot only once it is written
+}
+
+uint8_t DCC_capture_read(uint16_t *ticks, uint8_t max)
+{
+  uint8_t tail = DCC_capture_tail;
+  uint8_t available = __atomic_load_n(&DCC_capture_head, __ATOMIC_ACQUIRE) - tail;
+  uint8_t i;
+  if(available > max)
+    available = max;
+  for(i = 0; i < available; ++i)
+    ticks[i] = DCC_capture_ring[(uint8_t)(tail + i) & (DCC_CAPTURE_RING - 1)];
+  __atomic_store_n(&DCC_capture_tail, (uint8_t)(tail + available), __ATOMIC_RELEASE); //hand the slots back
+  return available;
+}
+
+uint16_t DCC_capture_overruns(void)
+{
+  uint16_t lost;
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli(); //two bytes; don't let the ISR change one between reads
+  lost = DCC_capture_lost;
+  SREG = sreg;
+#else
+  lost = DCC_capture_lost;
+#endif
+  return lost;
+}
+
+#if defined(__AVR__)
+
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define DCC_CAPTURE_TCCRA   TCCR4A
+#define DCC_CAPTURE_TCCRB   TCCR4B
+#define DCC_CAPTURE_ICR     ICR4
+#define DCC_CAPTURE_TIMSK   TIMSK4
+#define DCC_CAPTURE_TIFR    TIFR4
+#define DCC_CAPTURE_ICIE    ICIE4
+#define DCC_CAPTURE_ICF     ICF4
+#define DCC_CAPTURE_ICES    ICES4
+#define DCC_CAPTURE_ICNC    ICNC4
+#define DCC_CAPTURE_CS      CS41
+#define DCC_CAPTURE_vect    TIMER4_CAPT_vect
+#else
+#define DCC_CAPTURE_TCCRA   TCCR1A
+#define DCC_CAPTURE_TCCRB   TCCR1B
+#define DCC_CAPTURE_ICR     ICR1
+#define DCC_CAPTURE_TIMSK   TIMSK1
+#define DCC_CAPTURE_TIFR    TIFR1
+#define DCC_CAPTURE_ICIE    ICIE1
+#define DCC_CAPTURE_ICF     ICF1
+#define DCC_CAPTURE_ICES    ICES1
+#define DCC_CAPTURE_ICNC    ICNC1
+#define DCC_CAPTURE_CS      CS11
+#define DCC_CAPTURE_vect    TIMER1_CAPT_vect
+#endif
+
+void DCC_capture_setup(void)
+{
+  uint8_t sreg = SREG;
+  cli();
+  DCC_capture_head = DCC_capture_tail = 0;
+  DCC_capture_lost = 0;
+
+  //ICP1 is Port B/Pin 0 on the UNO; ICP4 is Port L/Pin 0 on the MEGA
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  DDRL &= ~(1<<DDL0);
+#else
+  DDRB &= ~(1<<DDB0);
+#endif
+
+  //normal mode, free running at /8 so that timestamps are 0.5us; the noise canceller delays every edge alike
+  DCC_CAPTURE_TCCRA = 0;
+  DCC_CAPTURE_TCCRB = (1<<DCC_CAPTURE_ICNC) | (1<<DCC_CAPTURE_ICES) | (1<<DCC_CAPTURE_CS);
+  DCC_CAPTURE_TIFR = (1<<DCC_CAPTURE_ICF);
+  DCC_CAPTURE_TIMSK = (1<<DCC_CAPTURE_ICIE);
+  SREG = sreg;
+}
+
+/// Input capture ISR: timestamp the edge, then wait for the opposite one
+ISR(DCC_CAPTURE_vect)
+{
+  uint16_t ticks = DCC_CAPTURE_ICR;
+  DCC_CAPTURE_TCCRB ^= (1<<DCC_CAPTURE_ICES);
+  DCC_CAPTURE_TIFR = (1<<DCC_CAPTURE_ICF); //changing the edge can set the flag; clear it, as the datasheet asks
+  DCC_capture_edge(ticks);
+}
+
+#else
+
+/// Timestamp of the last edge DCC_host_capture_timings() pushed
+static DCC_HOST_THREAD uint16_t DCC_host_capture_clock = 0;
+
+void DCC_capture_setup(void)
+{
+  DCC_capture_head = DCC_capture_tail = 0;
+  DCC_capture_lost = 0;
+  DCC_host_capture_clock = 0;
+}
+
+#if !defined(ARDUINO)
+uint16_t DCC_host_capture_timings(const uint16_t *timings, uint16_t count)
+{
+  uint16_t i;
+  for(i = 0; i < count; ++i)
+  {
+    if((uint8_t)(DCC_capture_head - DCC_capture_tail) == DCC_CAPTURE_RING)
+      break;
+    DCC_host_capture_clock += timings[i] * DCC_CAPTURE_TICKS_PER_US; //wraps, as the timer does
+    DCC_capture_edge(DCC_host_capture_clock);
+  }
+  return i;
+}
+#endif
+
+#endif
+
+#endif //DCC_SNIFFER || !ARDUINO
@@ -0,0 +1,63 @@
+#ifndef __DCCCAPTURE_H__
+#define __DCCCAPTURE_H__
+
+#include <stdint.h>
+#include "DCCHardware.h"
+
+/// Rail edge capture, for a track sniffer (see DCCSniffer.h)
+/** The input capture ISR timestamps every edge of the rail signal (through an optocoupler, say) and pushes
+    the timestamp onto a ring of DCC_CAPTURE_RING entries; the decoder takes them off again from loop().
+    The ring is single-producer, single-consumer and lock-free: only the producer writes the head and only
+    the consumer the tail, each a single byte, and a slot is published by moving the head only once it has
+    been written. Neither side ever waits for the other or turns interrupts off. An edge that finds the ring
+    full is dropped and counted; the decoder sees one long half-period and resynchronises on the next preamble.
+
+    On AVR the capture uses Timer1's input capture unit on ICP1 (pin 8 on an Uno), at the /8 prescaler the
+    waveform generator uses, toggling the edge it waits for after every capture, so both edges are seen.
+    Timer1 is the waveform generator's, so on an Uno a board sniffs or generates, never both. The Mega has
+    no header for ICP1, so Timer4 and ICP4 (pin 49) stand in for it there, leaving Timer1 alone; the capture
+    ISR still adds to the waveform ISR's latency, so check the ISR profile (DCCIsrProfile.h) before
+    running both on one Mega.
+
+    Other targets call DCC_capture_edge() from their own capture interrupt. Host builds feed the ring from
+    a half-period timing array, such as DCC_host_timings[], with DCC_host_capture_timings().
+
+    The capture ISR claims its timer's capture vector and the ring takes 2 * DCC_CAPTURE_RING bytes, so on
+    AVR both are only built with DCC_SNIFFER non-zero: a sniffer board defines it in its build flags (or
+    edits the default below). Host builds always have the capture, so DCCSimulator can read its rails back.
+*/
+
+#ifndef DCC_SNIFFER
+#define DCC_SNIFFER 0
+#endif
+
+#ifndef DCC_CAPTURE_RING
+#define DCC_CAPTURE_RING          64 //edges, 2 bytes each; a power of two, at most 128
+#endif
+#define DCC_CAPTURE_TICKS_PER_US  2 //Timer1 at /8 of 16MHz
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Empty the ring and, on AVR, take the timer over and start capturing.
+void DCC_capture_setup(void);
+/// Producer side: push an edge's timestamp, in ticks. Called by the capture ISR.
+void DCC_capture_edge(uint16_t ticks);
+/// Consumer side: move up to max timestamps, oldest first, into ticks[]; returns how many were moved.
+uint8_t DCC_capture_read(uint16_t *ticks, uint8_t max);
+/// Edges dropped because the ring was full, since setup.
+uint16_t DCC_capture_overruns(void);
+
+#if !defined(ARDUINO)
+/// Push the edges between count half-periods, in microseconds, each following the last edge pushed;
+/// stops at a full ring rather than dropping any. Returns how many half-periods were taken.
+uint16_t DCC_host_capture_timings(const uint16_t *timings, uint16_t count);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DCCCAPTURE_H__
@@ -0,0 +1,232 @@
+#include "DCCCommandParser.h"
+
+DCCCommandParser::DCCCommandParser(DCCPacketScheduler &new_scheduler) : rate_limited(0), unsupported(0), scheduler(new_scheduler)
+{
+  reset();
+}
+
+void DCCCommandParser::reset(void)
+{
+  command = 0;
+  field_count = 0;
+  address_kind = DCC_SHORT_ADDRESS;
+  in_field = false;
+  negative = false;
+  digits = false;
+  malformed = false;
+}
+
+char DCCCommandParser::parse(char c)
+{
+  if(c == '\n' || c == '\r')
+  {
+    if(!command) //blank line, or the second half of a CR LF pair
+      return DCC_COMMAND_PENDING;
+    char status = malformed ? DCC_COMMAND_MALFORMED : dispatch();
+    reset();
+    return status;
+  }
+  
+  if(malformed) //swallow the rest of a bad line
+    return DCC_COMMAND_PENDING;
+
+  if(!command)
+  {
+    if(c == ' ')
+      return DCC_COMMAND_PENDING;
+    command = c & ~0x20; //accept lower case, too
+    if(command < 'A' || command > 'Z')
+      malformed = true;
+    return DCC_COMMAND_PENDING;
+  }
+
+  if(c == ' ' || c == ',')
+  {
+    if(in_field)
+    {
+      if(!digits) //a sign or an 'L' on its own
+      {
+        malformed = true;
+        return DCC_COMMAND_PENDING;
+      }
+      if(negative)
+        fields[field_count] = -fields[field_count];
+      ++field_count;
+      in_field = false;
+      negative = false;
+      digits = false;
+    }
+    return DCC_COMMAND_PENDING;
+  }
+
+  if(!in_field)
+  {
+    if(field_count == DCC_COMMAND_MAX_FIELDS)
+    {
+      malformed = true;
+      return DCC_COMMAND_PENDING;
+    }
+    in_field = true;
+    fields[field_count] = 0;
+    if(c == '-')
+    {
+      negative = true;
+      return DCC_COMMAND_PENDING;
+    }
+    if((c == 'L' || c == 'l') && !field_count) //long address prefix
+    {
+      address_kind = DCC_LONG_ADDRESS;
+      return DCC_COMMAND_PENDING;
+    }
+  }
+
+  if(c < '0' || c > '9' || fields[field_count] > 100000) //not a digit, or absurdly large
+  {
+    malformed = true;
+    return DCC_COMMAND_PENDING;
+  }
+  fields[field_count] = fields[field_count]*10 + (c - '0');
+  digits = true;
+  return DCC_COMMAND_PENDING;
+}
+
+#if defined(ARDUINO)
+void DCCCommandParser::update(Stream &port, uint8_t budget)
+{
+  while(budget-- && port.available() > 0)
+  {
+    char status = parse(port.read());
+    if(status)
+    {
+      port.write(status);
+      port.write('\n');
+    }
+  }
+}
+#endif
+
+char DCCCommandParser::dispatch(void)
+{
+  if(in_field) //close off the last field
+  {
+    if(!digits)
+      return DCC_COMMAND_MALFORMED;
+    if(negative)
+      fields[field_count] = -fields[field_count];
+    ++field_count;
+  }
+  
+  for(uint8_t i = 0; i < field_count; ++i)
+  {
+    if(fields[i] < 0 && !(command == 'S' && i == 1)) //only a speed has a sign
+      return DCC_COMMAND_MALFORMED;
+  }
+
+  uint16_t address = fields[0];
+  if(field_count && fields[0] > 127)
+    address_kind = DCC_LONG_ADDRESS;
+  if(field_count && fields[0] > 10239) //largest long address
+    return DCC_COMMAND_MALFORMED;
+  
+  bool accepted = false; //stays false for packet kinds compiled out in DCCConfig.h
+  switch(command)
+  {
+    case 'S':
+      if(field_count < 2 || field_count > 3 || fields[1] < -127 || fields[1] > 127)
+        return DCC_COMMAND_MALFORMED;
+      if(field_count == 3 && fields[2] && fields[2] != 14 && fields[2] != 28 && fields[2] != 128)
+        return DCC_COMMAND_MALFORMED;
+      if(field_count == 3 && ((fields[2] == 14 && !DCC_SPEED_14) || (fields[2] == 28 && !DCC_SPEED_28)))
+      {
+        ++unsupported;
+        return DCC_COMMAND_REJECTED;
+      }
+      if(!admit())
+        return DCC_COMMAND_REJECTED;
+      if(!address)
+        accepted = scheduler.setSpeedGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, fields[1], (field_count == 3) ? fields[2] : 0);
+      else
+        accepted = scheduler.setSpeed(address, address_kind, fields[1], (field_count == 3) ? fields[2] : 0);
+      break;
+    case 'F':
+      if(field_count < 2 || field_count > (address ? 2 : 3))
+        return DCC_COMMAND_MALFORMED;
+      if(!admit())
+        return DCC_COMMAND_REJECTED;
+      if(!address)
+        accepted = scheduler.setFunctionsGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, (uint16_t)fields[1], (field_count == 3) ? (uint16_t)fields[2] : 0x1FFF);
+      else
+        accepted = scheduler.setFunctions(address, address_kind, (uint16_t)fields[1]);
+      break;
+    case 'A':
+      if(field_count < 2 || field_count > 4 || fields[0] > 511 || fields[1] > 3 //9-bit address, one of its 4 outputs
+          || ((field_count == 4) && (!fields[2] || fields[3] < 1 || fields[3] > 65535)))
+        return DCC_COMMAND_MALFORMED;
+#if DCC_ACCESSORIES
+      if((field_count == 4) && !DCC_PULSE_TIMERS)
+        ++unsupported;
+      else if(!admit())
+        return DCC_COMMAND_REJECTED;
+      else if((field_count == 3) && !fields[2])
+        accepted = scheduler.unsetBasicAccessory(address, fields[1]);
+#if DCC_PULSE_TIMERS
+      else if(field_count == 4)
+        accepted = scheduler.pulseAccessory(address, fields[1], fields[3]);
+#endif
+      else
+        accepted = scheduler.setBasicAccessory(address, fields[1]);
+#else
+      ++unsupported;
+#endif
+      break;
+    case 'P':
+      if(field_count != 3 || fields[1] < 1 || fields[1] > 1024 || fields[2] > 255)
+        return DCC_COMMAND_MALFORMED;
+#if DCC_OPS_PROGRAMMING
+      if(!admit())
+        return DCC_COMMAND_REJECTED;
+      accepted = scheduler.opsProgramCV(address, address_kind, fields[1], fields[2]);
+#else
+      ++unsupported;
+#endif
+      break;
+    case 'E':
+      if(field_count > 1)
+        return DCC_COMMAND_MALFORMED;
+      accepted = field_count ? scheduler.eStop(address, address_kind) : scheduler.eStop();
+      break;
+    case 'H':
+      if(field_count)
+        return DCC_COMMAND_MALFORMED;
+#if DCC_ESTOP_SNAPSHOT
+      accepted = scheduler.suspend();
+#else
+      accepted = scheduler.eStop();
+#endif
+      break;
+    case 'R':
+      if(field_count > 1)
+        return DCC_COMMAND_MALFORMED;
+#if DCC_ESTOP_SNAPSHOT
+      if(!admit())
+        return DCC_COMMAND_REJECTED;
+      accepted = scheduler.resume(field_count && fields[0]);
+#else
+      ++unsupported;
+#endif
+      break;
+    default:
+      return DCC_COMMAND_MALFORMED;
+  }
+  return accepted ? DCC_COMMAND_OK : DCC_COMMAND_REJECTED;
+}
+
+/// Take a rate limit token for a command that passed validation, just before it reaches the scheduler; E and H
+/// never ask, so a stop always gets through
+bool DCCCommandParser::admit(void)
+{
+  if(limiter.allow())
+    return true;
+  ++rate_limited;
+  return false;
+}
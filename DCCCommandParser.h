@@ -0,0 +1,81 @@
+#ifndef __DCCCOMMANDPARSER_H__
+#define __DCCCOMMANDPARSER_H__
+
+#include "Arduino.h"
+#include "DCCPacketScheduler.h"
+
+/**
+ * An incremental, non-blocking text command front end for DCCPacketScheduler.
+ * Bytes are consumed one at a time as they arrive; numeric fields are accumulated as they are
+ * read, so there is no line buffer, no String and no heap. A command is dispatched as soon as
+ * its terminating newline arrives, and answered with a one-character status frame.
+ *
+ * Commands (one per line, fields separated by spaces; prefix an address with 'L' to force a long address,
+ * addresses above 127 are always long):
+ *   S addr speed [steps]   setSpeed(); speed in [-127,127], steps 0 (default), 14, 28 or 128
+ *   F addr functions       setFunctions(); functions is a bitmask, F0 = bit 0 ... F12 = bit 12
+ *   S 0 speed [steps]      setSpeedGroup() for every loco: "S 0 1" stops them all with one broadcast packet
+ *   F 0 functions [mask]   setFunctionsGroup() for every loco, changing only the functions in mask (default all);
+ *                          a mask covering part of a function group needs the roster
+ *   A addr function [on]   setBasicAccessory(), or unsetBasicAccessory() if on is 0; addr 0-511, function 0-3
+ *   A addr function 1 ms   pulseAccessory(): on, then off again ms later
+ *   P addr CV value        opsProgramCV(); CV 1-1024, value 0-255
+ *   E [addr]               eStop(), for every loco or just one
+ *   H                      suspend(): e-stop every loco, setting queued work aside
+ *   R [restart]            resume() after H; restart 1 also gives each loco its speed back
+ *
+ * Only a speed may be negative; a minus sign anywhere else makes the command malformed, as does a field with no digits
+ * ("S 3 -").
+ *
+ * Status frames: "+\n" accepted, "-\n" rejected: by the scheduler (queue full), over the rate limit, or for a packet
+ * kind or speed step mode this build leaves out (DCCConfig.h), "?\n" malformed. The counters below tell the
+ * rejections apart.
+**/
+
+#define DCC_COMMAND_MAX_FIELDS    4
+#define DCC_COMMAND_BUDGET        16 //bytes consumed per update() call, at most
+
+#define DCC_COMMAND_PENDING       0x00
+#define DCC_COMMAND_OK            '+'
+#define DCC_COMMAND_REJECTED      '-'
+#define DCC_COMMAND_MALFORMED     '?'
+
+class DCCCommandParser
+{
+  public:
+    DCCCommandParser(DCCPacketScheduler &new_scheduler);
+    
+    //feed a single byte; returns DCC_COMMAND_PENDING until a command completes, then its status
+    char parse(char c);
+    
+#if defined(ARDUINO)
+    //to be called periodically within loop(); never reads more than budget bytes, never waits for more
+    void update(Stream &port, uint8_t budget=DCC_COMMAND_BUDGET);
+#endif
+
+    void reset(void); //discard any partially received command
+    //limit this source to rate commands per second, in bursts of up to burst (see DCCFairShare.h); rate 0 for no limit.
+    //Malformed commands, those this build leaves out, E and H take no token
+    inline void setRateLimit(uint8_t rate, uint8_t burst) { limiter.setLimit(rate, burst); }
+
+    //results
+    uint32_t rate_limited; //commands rejected by the rate limit
+    uint32_t unsupported; //commands rejected because this build leaves out what they need
+
+  private:
+    char dispatch(void);
+    bool admit(void);
+    
+    DCCPacketScheduler &scheduler;
+    DCCRateLimiter limiter;
+    char command;
+    uint8_t field_count;
+    uint8_t address_kind;
+    bool in_field;
+    bool negative;
+    bool digits; //the field being read has had at least one
+    bool malformed;
+    int32_t fields[DCC_COMMAND_MAX_FIELDS];
+};
+
+#endif //__DCCCOMMANDPARSER_H__
@@ -0,0 +1,189 @@
+#ifndef __DCCCONFIG_H__
+#define __DCCCONFIG_H__
+
+/**
+ * Compile-time build profiles: which packet kinds and speed modes DCCPacketScheduler is built with,
+ * how deep its queues are, and how much RAM it is allowed. Pick one by defining DCC_BUILD_PROFILE
+ * (in the build flags, or by editing the default below); any single setting can still be overridden
+ * on its own by defining it first.
+ *
+ *   DCC_BUILD_FULL     every packet kind and speed mode, 28-slot pool (Mega and other large boards)
+ *   DCC_BUILD_COMPACT  28/128 steps, ops mode programming and accessories, 24-slot pool (328/168-class boards)
+ *   DCC_BUILD_TINY     128 steps and functions only, 12-slot pool, no roster (boards with little RAM to spare;
+ *                      DCCHardware.c drives the ATmega Timer1, so ATtiny parts are not supported)
+ *   DCC_BUILD_HOST     everything, 240-slot pool, 128-loco roster: the scheduler run off the board by
+ *                      DCCStreamDaemon, which streams packets to a thin firmware (DCCPacketStreamer.h)
+ *
+ * COMPACT is the default on ATmega328 and 168 parts, FULL on everything else. On the board profiles the
+ * roster, fair share, group commands, accessory pulses and the e-stop snapshot are opt-in: define
+ * DCC_ROSTER_SIZE, DCC_FAIR_ADDRESSES, DCC_GROUP_COMMANDS, DCC_PULSE_TIMERS or DCC_ESTOP_SNAPSHOT to turn
+ * one on, and DCC_RAM_BUDGET too if the result no longer fits. So is the packet trace, DCC_TRACE_DEPTH.
+ *
+ * Each profile carries a RAM budget for the scheduler and its packet pool. avr-gcc builds check it with
+ * static_assert in DCCPacketScheduler.cpp; host builds can only check the pool that way, as the host's
+ * pointers are bigger, so "make avr-size" (part of "make test") in extras/host checks the scheduler as
+ * avr-gcc would lay it out. DCCSimulator::reportBuild() prints the resulting configuration and RAM use
+ * on the host, and "make sizes" lists the code size and RAM of every profile.
+ *
+ * Compiled-out features simply do not exist: calling setSpeed14() in a build without DCC_SPEED_14 is a
+ * compile error, while setSpeed() with 14 steps, and the serial protocols, reject the command.
+**/
+
+#define DCC_BUILD_FULL    0
+#define DCC_BUILD_COMPACT 1
+#define DCC_BUILD_TINY    2
+#define DCC_BUILD_HOST    3
+
+#ifndef DCC_BUILD_PROFILE
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega328PB__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168A__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168PA__)
+#define DCC_BUILD_PROFILE DCC_BUILD_COMPACT //2KB of RAM or less, shared with the sketch
+#else
+#define DCC_BUILD_PROFILE DCC_BUILD_FULL
+#endif
+#endif
+
+#if DCC_BUILD_PROFILE == DCC_BUILD_FULL
+#define DCC_PROFILE_NAME                "full"
+#define DCC_PROFILE_SPEED_14            1
+#define DCC_PROFILE_SPEED_28            1
+#define DCC_PROFILE_OPS_PROGRAMMING     1
+#define DCC_PROFILE_ACCESSORIES         1
+#define DCC_PROFILE_POOL_SIZE           28
+#define DCC_PROFILE_HIGH_RESERVE        4
+#define DCC_PROFILE_ROSTER_SIZE         0
+#define DCC_PROFILE_FAIR_ADDRESSES      0
+#define DCC_PROFILE_GROUP_COMMANDS      0
+#define DCC_PROFILE_PULSE_TIMERS        0
+#define DCC_PROFILE_ESTOP_SNAPSHOT      0
+#define DCC_PROFILE_TRACE_DEPTH         0
+#define DCC_PROFILE_RAM_BUDGET          640
+#elif DCC_BUILD_PROFILE == DCC_BUILD_COMPACT
+#define DCC_PROFILE_NAME                "compact"
+#define DCC_PROFILE_SPEED_14            0
+#define DCC_PROFILE_SPEED_28            1
+#define DCC_PROFILE_OPS_PROGRAMMING     1
+#define DCC_PROFILE_ACCESSORIES         1
+#define DCC_PROFILE_POOL_SIZE           24
+#define DCC_PROFILE_HIGH_RESERVE        4
+#define DCC_PROFILE_ROSTER_SIZE         0
+#define DCC_PROFILE_FAIR_ADDRESSES      0
+#define DCC_PROFILE_GROUP_COMMANDS      0
+#define DCC_PROFILE_PULSE_TIMERS        0
+#define DCC_PROFILE_ESTOP_SNAPSHOT      0
+#define DCC_PROFILE_TRACE_DEPTH         0
+#define DCC_PROFILE_RAM_BUDGET          448
+#elif DCC_BUILD_PROFILE == DCC_BUILD_TINY
+#define DCC_PROFILE_NAME                "tiny"
+#define DCC_PROFILE_SPEED_14            0
+#define DCC_PROFILE_SPEED_28            0
+#define DCC_PROFILE_OPS_PROGRAMMING     0
+#define DCC_PROFILE_ACCESSORIES         0
+#define DCC_PROFILE_POOL_SIZE           12
+#define DCC_PROFILE_HIGH_RESERVE        3
+#define DCC_PROFILE_ROSTER_SIZE         0
+#define DCC_PROFILE_FAIR_ADDRESSES      0
+#define DCC_PROFILE_GROUP_COMMANDS      0 //broadcasts only: a group command costs 12 bytes the budget has no room for
+#define DCC_PROFILE_PULSE_TIMERS        0
+#define DCC_PROFILE_ESTOP_SNAPSHOT      0
+#define DCC_PROFILE_TRACE_DEPTH         0
+#define DCC_PROFILE_RAM_BUDGET          192
+#elif DCC_BUILD_PROFILE == DCC_BUILD_HOST
+#define DCC_PROFILE_NAME                "host"
+#define DCC_PROFILE_SPEED_14            1
+#define DCC_PROFILE_SPEED_28            1
+#define DCC_PROFILE_OPS_PROGRAMMING     1
+#define DCC_PROFILE_ACCESSORIES         1
+#define DCC_PROFILE_POOL_SIZE           240
+#define DCC_PROFILE_HIGH_RESERVE        16
+#define DCC_PROFILE_ROSTER_SIZE         128
+#define DCC_PROFILE_FAIR_ADDRESSES      64
+#define DCC_PROFILE_GROUP_COMMANDS      8
+#define DCC_PROFILE_PULSE_TIMERS        128
+#define DCC_PROFILE_ESTOP_SNAPSHOT      1
+#define DCC_PROFILE_TRACE_DEPTH         64
+#define DCC_PROFILE_RAM_BUDGET          16384
+#else
+#error "unknown DCC_BUILD_PROFILE"
+#endif
+
+//speed step modes. 128 steps, the default, are always built
+#ifndef DCC_SPEED_14
+#define DCC_SPEED_14 DCC_PROFILE_SPEED_14
+#endif
+#ifndef DCC_SPEED_28
+#define DCC_SPEED_28 DCC_PROFILE_SPEED_28
+#endif
+
+//packet kinds
+#ifndef DCC_OPS_PROGRAMMING
+#define DCC_OPS_PROGRAMMING DCC_PROFILE_OPS_PROGRAMMING //opsProgramCV()
+#endif
+#ifndef DCC_ACCESSORIES
+#define DCC_ACCESSORIES DCC_PROFILE_ACCESSORIES //setBasicAccessory(), unsetBasicAccessory()
+#endif
+
+//all queues share one pool of packet slots. Each queue is guaranteed its *_QUEUE_RESERVE slots;
+//the rest of the pool goes to whichever queues need it. 28 slots plus their links take the same
+//RAM as the 2/10/10/10 private arrays they replace.
+#ifndef PACKET_POOL_SIZE
+#define PACKET_POOL_SIZE            DCC_PROFILE_POOL_SIZE
+#endif
+#ifndef E_STOP_QUEUE_RESERVE
+#define E_STOP_QUEUE_RESERVE        2
+#endif
+#ifndef HIGH_PRIORITY_QUEUE_RESERVE
+#define HIGH_PRIORITY_QUEUE_RESERVE DCC_PROFILE_HIGH_RESERVE
+#endif
+#ifndef LOW_PRIORITY_QUEUE_RESERVE
+#define LOW_PRIORITY_QUEUE_RESERVE  2
+#endif
+#ifndef REPEAT_QUEUE_RESERVE
+#define REPEAT_QUEUE_RESERVE        2
+#endif
+
+#ifndef DCC_ROSTER_SIZE
+#define DCC_ROSTER_SIZE DCC_PROFILE_ROSTER_SIZE
+#endif
+
+//addresses DCCFairShare round-robins between; 0 serves each queue strictly in order
+#ifndef DCC_FAIR_ADDRESSES
+#define DCC_FAIR_ADDRESSES DCC_PROFILE_FAIR_ADDRESSES
+#endif
+
+//multicast group commands (setSpeedGroup(), setFunctionsGroup()) that can be expanding at once.
+//Commands to every loco that go out as a single broadcast packet do not take one.
+#ifndef DCC_GROUP_COMMANDS
+#define DCC_GROUP_COMMANDS DCC_PROFILE_GROUP_COMMANDS
+#endif
+
+//accessory pulses (pulseAccessory()) that can be running or waiting to start at once; at most 254.
+//Each costs 8 bytes, plus 48 for the timer wheel: 32 fit in the FULL budget, 8 in COMPACT's. Needs DCC_ACCESSORIES.
+#ifndef DCC_PULSE_TIMERS
+#define DCC_PULSE_TIMERS DCC_PROFILE_PULSE_TIMERS
+#endif
+#if !DCC_ACCESSORIES
+#undef DCC_PULSE_TIMERS
+#define DCC_PULSE_TIMERS 0
+#endif
+
+//suspend() and resume(): an e-stop that sets queued work aside instead of discarding it
+#ifndef DCC_ESTOP_SNAPSHOT
+#define DCC_ESTOP_SNAPSHOT DCC_PROFILE_ESTOP_SNAPSHOT
+#endif
+
+//packets DCCPacketTrace keeps, the last ones put on the rails, to dump after the fact; 11 bytes each, at most 255
+#ifndef DCC_TRACE_DEPTH
+#define DCC_TRACE_DEPTH DCC_PROFILE_TRACE_DEPTH
+#endif
+
+//bytes of RAM the scheduler object and its packet pool may take, on the target
+#ifndef DCC_RAM_BUDGET
+#define DCC_RAM_BUDGET DCC_PROFILE_RAM_BUDGET
+#endif
+
+#if E_STOP_QUEUE_RESERVE + HIGH_PRIORITY_QUEUE_RESERVE + LOW_PRIORITY_QUEUE_RESERVE + REPEAT_QUEUE_RESERVE > PACKET_POOL_SIZE
+#error "the queue reserves add up to more than PACKET_POOL_SIZE"
+#endif
+
+#endif //__DCCCONFIG_H__
@@ -0,0 +1,79 @@
+#include "DCCFairShare.h"
+#include "DCCPacket.h"
+
+static inline uint16_t fair_key(uint16_t address, uint8_t address_kind)
+{
+  return address | ((address_kind == DCC_LONG_ADDRESS) ? 0x8000 : 0);
+}
+
+#if DCC_FAIR_ADDRESSES
+DCCFairShare::DCCFairShare(void) : clock(0), used(0)
+{
+}
+
+uint16_t DCCFairShare::age(uint16_t address, uint8_t address_kind)
+{
+  uint16_t key = fair_key(address, address_kind);
+  for(uint8_t i = 0; i < used; ++i)
+  {
+    if(keys[i] == key)
+      return clock - stamps[i];
+  }
+  return 0xFFFF;
+}
+
+void DCCFairShare::served(uint16_t address, uint8_t address_kind)
+{
+  uint16_t key = fair_key(address, address_kind);
+  uint8_t oldest = 0;
+  ++clock;
+  for(uint8_t i = 0; i < used; ++i)
+  {
+    if(keys[i] == key)
+    {
+      stamps[i] = clock;
+      return;
+    }
+    if((uint16_t)(clock - stamps[i]) > (uint16_t)(clock - stamps[oldest]))
+      oldest = i;
+  }
+  if(used < DCC_FAIR_ADDRESSES)
+    oldest = used++;
+  keys[oldest] = key;
+  stamps[oldest] = clock;
+}
+
+#endif //DCC_FAIR_ADDRESSES
+
+/*****************************/
+
+DCCRateLimiter::DCCRateLimiter(void) : rate(0), burst(0), tokens(0), last_refill(0)
+{
+}
+
+void DCCRateLimiter::setLimit(uint8_t new_rate, uint8_t new_burst)
+{
+  rate = new_rate;
+  burst = new_burst ? new_burst : 1;
+  tokens = burst;
+  last_refill = millis();
+}
+
+bool DCCRateLimiter::allow(void)
+{
+  if(!rate)
+    return true;
+  unsigned long now = millis();
+  unsigned long interval = 1000 / rate; //ms per token
+  while((tokens < burst) && (now - last_refill >= interval))
+  {
+    ++tokens;
+    last_refill += interval;
+  }
+  if(tokens >= burst)
+    last_refill = now; //a full bucket does not bank time
+  if(!tokens)
+    return false;
+  --tokens;
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef __DCCFAIRSHARE_H__
+#define __DCCFAIRSHARE_H__
+
+#include "Arduino.h"
+#include "DCCConfig.h"
+
+/**
+ * Fairness between locos and between command sources.
+ *
+ * DCCFairShare remembers, for the last DCC_FAIR_ADDRESSES addresses put on the rails, how many packets
+ * ago each was sent. DCCPacketQueue::selectFair() uses it to serve whichever queued address has waited
+ * longest, rather than strict FIFO: round-robin across addresses with a quantum of one packet, so one
+ * loco's commands and repeats cannot crowd the others out however often its throttle sends, and a loco
+ * waits at most one packet per other active address. An address not in the table counts as having
+ * waited longest; when the table is full the least recently served address is forgotten.
+ *
+ * DCCRateLimiter is a token bucket for one command source (a DCCCommandParser or DCCBinaryProtocol):
+ * burst commands at once, refilled at rate per second. Commands over the limit are rejected, so the
+ * throttle's next update carries the newest value anyway; the scheduler already coalesces a loco's
+ * queued speed and function packets. E-stops are never limited.
+**/
+
+#ifndef DCC_FAIR_ADDRESSES
+#define DCC_FAIR_ADDRESSES 16
+#endif
+
+class DCCFairShare
+{
+  public:
+    DCCFairShare(void);
+    
+    //packets sent since this address was last on the rails; 0xFFFF if not seen lately
+    uint16_t age(uint16_t address, uint8_t address_kind);
+    //a packet for this address has just been put on the rails
+    void served(uint16_t address, uint8_t address_kind);
+    
+  private:
+    uint16_t keys[DCC_FAIR_ADDRESSES]; //address, with bit 15 set for long addresses
+    uint16_t stamps[DCC_FAIR_ADDRESSES]; //clock when last served
+    uint16_t clock; //packets served
+    uint8_t used;
+};
+
+class DCCRateLimiter
+{
+  public:
+    DCCRateLimiter(void);
+    
+    //rate commands per second, with bursts of up to burst; rate 0 removes the limit
+    void setLimit(uint8_t new_rate, uint8_t new_burst);
+    //takes a token if there is one
+    bool allow(void);
+    
+  private:
+    uint8_t rate;
+    uint8_t burst;
+    uint8_t tokens;
+    unsigned long last_refill;
+};
+
+#endif //__DCCFAIRSHARE_H__
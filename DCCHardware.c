@@ -1,23 +1,38 @@
 #include "Arduino.h"
+#include "DCCHardware.h"
+#include "DCCIsrProfile.h"
+#include "DCCOvercurrent.h"
+
+/// AVR Timer1 backend for the waveform HAL declared in DCCHardware.h.
+/** The ISR clocks the packet in current_packet out one bit per compare match.
+    Host builds supply the HAL from DCCHardwareHost.c; any other Arduino board stops the build here.
+*/
+#if defined(__AVR__)
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include "DCCHardware.h"
+#include <avr/eeprom.h>
 
 /// An enumerated type for keeping track of the state machine used in the timer1 ISR
 /** Given the structure of a DCC packet, the ISR can be in one of 5 states.
       *dos_idle: there is nothing to put on the rails. In this case, the only legal thing
                  to do is to put a '1' on the rails.  The ISR should almost never be in this state.
       *dos_send_premable: A packet has been made available, and so we should broadcast the preamble: 14 '1's in a row
+                          (or as many as the timing profile asks for; see DCC_waveform_set_timing())
       *dos_send_bstart: Each data uint8_t is preceded by a '0'
       *dos_send_uint8_t: Sending the current data uint8_t
-      *dos_end_bit: After the final uint8_t is sent, send a '0'.
+      *dos_end_bit: After the final uint8_t is sent, send a '1'.
+    With DCC_RAILCOM, dos_end_bit may be followed by the three dos_cutout* states (see DCC_railcom_cutout()).
 */                 
 typedef enum  {
   dos_idle,
   dos_send_preamble,
   dos_send_bstart,
   dos_send_uint8_t,
-  dos_end_bit
+  dos_end_bit,
+  dos_cutout_start, //RailCom: the end bit is done; keep the '1' going until the cutout starts
+  dos_cutout, //RailCom: both outputs have just gone low
+  dos_cutout_end //RailCom: the cutout is over; restart the outputs
 } DCC_output_state_t;
 
 DCC_output_state_t DCC_state = dos_idle; //just to start out
@@ -29,7 +44,7 @@ volatile uint8_t current_packet_size = 0;
 /// How many uint8_ts remain to be put on the rails?
 volatile uint8_t current_uint8_t_counter = 0;
 /// How many bits remain in the current data uint8_t/preamble before changing states?
-volatile uint8_t current_bit_counter = 14; //init to 14 1's for the preamble
+volatile uint8_t current_bit_counter = 14; //reloaded with the profile's preamble length as each packet starts
 /// A fixed-content packet to send when idle
 //uint8_t DCC_Idle_Packet[3] = {255,0,255};
 /// A fixed-content packet to send to reset all decoders on layout
@@ -61,6 +76,9 @@ volatile uint8_t current_bit_counter = 14; //init to 14 1's for the preamble
  9900us = (8*(1+OCR1A)) / (16MHz)
  9900us * 2MHz = 1+OCR1A
  OCR1A = 19799
+
+ DCC_timing_throughput (DCCWaveformBuffer.h) sends 57us ones and 97us zeros, OCR1A = 113 and 193, rather than the
+ 55us/95us minimums, OCR1A = 109 and 189: a resonator running 0.5% fast would take those out of spec.
  
 */
 
@@ -68,6 +86,26 @@ uint16_t one_count=115; //58us
 uint16_t zero_high_count=199; //100us
 uint16_t zero_low_count=199; //100us
 
+/// The timing profile the counts above were loaded from, and the one DCC_waveform_set_timing() has asked for.
+/// The ISR switches between them in dos_idle, as a new packet starts.
+static const DCC_timing_profile_t *DCC_timing_active = &DCC_timing_standard;
+static const DCC_timing_profile_t * volatile DCC_timing_requested = &DCC_timing_standard;
+
+/// Zero while DCC_waveform_output() has the outputs disconnected, so the end of a cutout does not reconnect them
+static volatile uint8_t DCC_outputs_enabled = 1;
+
+#if DCC_RAILCOM
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) || defined(__AVR_AT90CAN128__) || defined(__AVR_AT90CAN64__) || defined(__AVR_AT90CAN32__)
+#define DCC_OC1A_PIN PINB5
+#define DCC_OC1B_PIN PINB6
+#else
+#define DCC_OC1A_PIN PINB1
+#define DCC_OC1B_PIN PINB2
+#endif
+static volatile uint8_t DCC_railcom_enabled = 0;
+static volatile uint8_t DCC_railcom_cutout_count = 0;
+#endif
+
 /// Setup phase: configure and enable timer1 CTC interrupt, set OC1A and OC1B to toggle on CTC
 void setup_DCC_waveform_generator() {
   
@@ -99,9 +137,151 @@ void DCC_waveform_generation_hasshin()
   TIMSK1 |= (1<<OCIE1A);
 }
 
+uint8_t DCC_waveform_ready(void)
+{
+  //the ISR has consumed the last packet once it has counted down all of its bytes
+  return !current_uint8_t_counter;
+}
+
+uint8_t *DCC_waveform_packet_buffer(void)
+{
+  return current_packet;
+}
+
+void DCC_waveform_send_packet(uint8_t size)
+{
+  current_packet_size = size;
+  current_uint8_t_counter = size; //setting this non-zero is what tells the ISR the packet is ready, so do it last
+}
+
+void DCC_waveform_output(uint8_t enable)
+{
+  DCC_outputs_enabled = enable;
+  if(enable)
+  {
+    //back to toggling OC1A and OC1B on compare match; they pick up from their (complementary) internal state
+    TCCR1A |= (1<<COM1A0) | (1<<COM1B0);
+  }
+  else
+  {
+    //hand the pins back to PORTB, and drive both low
+    TCCR1A &= ~((1<<COM1A1) | (1<<COM1A0) | (1<<COM1B1) | (1<<COM1B0));
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) || defined(__AVR_AT90CAN128__) || defined(__AVR_AT90CAN64__) || defined(__AVR_AT90CAN32__)
+    PORTB &= ~((1<<PORTB5) | (1<<PORTB6));
+#else
+    PORTB &= ~((1<<PORTB1) | (1<<PORTB2));
+#endif
+  }
+}
+
+uint8_t DCC_waveform_set_timing(const DCC_timing_profile_t *profile)
+{
+  uint8_t sreg;
+  if(!DCC_timing_valid(profile))
+    return 0;
+  sreg = SREG;
+  cli(); //a pointer is two bytes; don't let the ISR see half of one
+  DCC_timing_requested = profile;
+  SREG = sreg;
+  return 1;
+}
+
+const DCC_timing_profile_t *DCC_waveform_timing(void)
+{
+  return DCC_timing_requested;
+}
+
+/// Called by the ISR at the start of each packet: load the requested profile's counts, and its preamble length
+static inline void DCC_timing_latch(void)
+{
+  const DCC_timing_profile_t *profile = DCC_timing_requested;
+  if(profile != DCC_timing_active)
+  {
+    DCC_timing_active = profile;
+    one_count = profile->one_us * 2 - 1; //0.5us ticks; see above
+    zero_high_count = profile->zero_high_us * 2 - 1;
+    zero_low_count = profile->zero_low_us * 2 - 1;
+  }
+  current_bit_counter = profile->preamble_bits;
+}
+
+uint8_t DCC_eeprom_read(uint16_t address)
+{
+  return eeprom_read_byte((const uint8_t *)address);
+}
+
+void DCC_eeprom_write(uint16_t address, uint8_t value)
+{
+  eeprom_update_byte((uint8_t *)address, value);
+}
+
+uint8_t DCC_eeprom_ready(void)
+{
+  return eeprom_is_ready();
+}
+
+#if DCC_RAILCOM
+void DCC_railcom_enable(uint8_t enable)
+{
+  DCC_railcom_enabled = enable;
+}
+
+uint8_t DCC_railcom_cutouts(void)
+{
+  return DCC_railcom_cutout_count;
+}
+
+/// The ISR's cutout states that fall outside the usual one-bit-per-cycle pattern. Returns non-zero if the
+/// interrupt has been dealt with, zero if the ISR should carry on as usual.
+static inline uint8_t DCC_railcom_cutout(void)
+{
+  if(DCC_state == dos_cutout)
+  {
+    //OC1B was cleared by this compare match, and OC1A was already low: hold them there for the cutout
+    OCR1A = OCR1B = (DCC_RAILCOM_CUTOUT_END_US - DCC_RAILCOM_CUTOUT_START_US) * 2 - 1;
+    DCC_state = dos_cutout_end;
+    return 1;
+  }
+  if(DCC_state == dos_cutout_end)
+  {
+    //back to toggling, then force OC1B high so the outputs are complementary again, starting a new '1'
+    if(DCC_outputs_enabled)
+    {
+      TCCR1A = (TCCR1A & ~((1<<COM1A1) | (1<<COM1B1))) | (1<<COM1A0) | (1<<COM1B0);
+      if(!(PINB & (1<<DCC_OC1B_PIN)))
+        TCCR1C |= (1<<FOC1B);
+    }
+    ++DCC_railcom_cutout_count;
+    DCC_state = dos_idle; //and on to the next packet's preamble, as if from the end bit
+  }
+  return 0;
+}
+#else
+void DCC_railcom_enable(uint8_t enable)
+{
+  (void)enable;
+}
+
+uint8_t DCC_railcom_cutouts(void)
+{
+  return 0;
+}
+#endif
+
 /// This is the Interrupt Service Routine (ISR) for Timer1 compare match.
 ISR(TIMER1_COMPA_vect)
 {
+#if DCC_PROFILE_ISR
+  uint16_t entry_ticks = TCNT1; //how late did we get here?
+#endif
+#if DCC_OVERCURRENT
+  if(DCC_overcurrent_sample()) //tripped: the outputs are off, so there is nothing to clock out
+    return;
+#endif
+#if DCC_RAILCOM
+  if(DCC_railcom_cutout()) //mid-cutout: nothing to clock out
+    return;
+#endif
   //in CTC mode, timer TCINT1 automatically resets to 0 when it matches OCR1A. Depending on the next bit to output,
   //we may have to alter the value in OCR1A, maybe.
   //to switch between "one" waveform and "zero" waveform, we assign a value to OCR1A.
@@ -128,7 +308,8 @@ ISR(TIMER1_COMPA_vect)
      //if this is the last bit to send, queue up another packet (might be the idle packet).
     switch(DCC_state)
     {
-      /// Idle: Check if a new packet is ready. If it is, fall through to dos_send_premable. Otherwise just stick a '1' out there.
+      /// Idle: Check if a new packet is ready. If it is, switch timing profiles if asked to, and fall through to
+      /// dos_send_premable. Otherwise just stick a '1' out there.
       case dos_idle:
         if(!current_uint8_t_counter) //if no new packet
         {
@@ -148,8 +329,9 @@ ISR(TIMER1_COMPA_vect)
 //          }
 //          Serial.println("");
 //        }
+        DCC_timing_latch(); //no bit of the last packet is still on the rails, so this is where the timing may change
         DCC_state = dos_send_preamble; //and fall through to dos_send_preamble
-      /// Preamble: In the process of producing 14 '1's, counter by current_bit_counter; when complete, move to dos_send_bstart
+      /// Preamble: In the process of producing the profile's preamble_bits '1's, counter by current_bit_counter; when complete, move to dos_send_bstart
       case dos_send_preamble:
         OCR1A = OCR1B = one_count;
 //        Serial.print("P");
@@ -191,9 +373,32 @@ ISR(TIMER1_COMPA_vect)
       case dos_end_bit:
         OCR1A = OCR1B = one_count;
         DCC_state = dos_idle;
-        current_bit_counter = 14; //in preparation for a premable...
+#if DCC_RAILCOM
+        if(DCC_railcom_enabled)
+          DCC_state = dos_cutout_start;
+#endif
 //        Serial.println(" 1");
         break;
+#if DCC_RAILCOM
+      /// RailCom: the end bit is over and OC1A has just gone low. OC1B carries on high into what would be the next '1',
+      /// but is set to clear at the next match instead of toggling, which starts the cutout with both outputs low.
+      case dos_cutout_start:
+        if(DCC_outputs_enabled)
+          TCCR1A = (TCCR1A & ~((1<<COM1A0) | (1<<COM1B0))) | (1<<COM1A1) | (1<<COM1B1);
+        OCR1A = OCR1B = DCC_RAILCOM_CUTOUT_START_US * 2 - 1;
+        DCC_state = dos_cutout;
+        break;
+      case dos_cutout:
+      case dos_cutout_end:
+        break; //dealt with by DCC_railcom_cutout()
+#endif
     }
   }
+#if DCC_PROFILE_ISR
+  DCC_isr_profile_record(entry_ticks, TCNT1, OCR1A);
+#endif
 }
+
+#elif defined(ARDUINO)
+#error "unsupported target: DCCHardware.c drives the AVR Timer1, and there is no waveform backend for this board"
+#endif //__AVR__
@@ -1,6 +1,37 @@
 #ifndef __DCCHARDWARE_H__
 #define __DCCHARDWARE_H__
 
+#include <stdint.h>
+#include "DCCWaveformBuffer.h"
+
+/// Waveform hardware abstraction layer
+/** DCCPacketScheduler talks to the waveform generator only through the functions below, so the
+    scheduler is identical whichever backend is linked in. Exactly one backend provides them:
+      *DCCHardware.c: AVR Timer1 compare-match ISR, one bit per interrupt.
+      *DCCHardwareHost.c: host builds; encodes every packet into a timing array in memory for verification.
+    Buffer-driven peripherals (DMA-fed PWM, RMT and the like) implement the same functions by encoding
+    each packet with DCC_waveform_encode_timings() (DCCWaveformBuffer.h) and handing the array to the peripheral.
+*/
+
+/// RailCom cutout
+/** With DCC_RAILCOM non-zero, and the cutout enabled at run time, the generator follows every packet end bit
+    with a RailCom cutout (RCN-217): DCC_RAILCOM_CUTOUT_START_US after the end bit both outputs are held low,
+    until DCC_RAILCOM_CUTOUT_END_US after it, so decoders can answer through a detector's UART (see DCCRailCom.h).
+    The preamble of the next packet follows the cutout in full.
+*/
+#ifndef DCC_RAILCOM
+#define DCC_RAILCOM 0
+#endif
+#define DCC_RAILCOM_CUTOUT_START_US 29 //26-32us after the end bit
+#define DCC_RAILCOM_CUTOUT_END_US   470 //454-488us after the end bit
+
+/// Host builds keep every backend's state per thread, so that several simulated command stations can run
+/// side by side, one per thread (see DCCLayoutSimulator.h). On the target there is only ever one.
+#if defined(ARDUINO) || defined(__AVR__)
+#define DCC_HOST_THREAD
+#else
+#define DCC_HOST_THREAD __thread
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -10,8 +41,36 @@ extern "C"
 void setup_DCC_waveform_generator(void);
 void DCC_waveform_generation_hasshin(void);
 
+/// Non-zero once the generator is done with the last packet and can take another.
+uint8_t DCC_waveform_ready(void);
+/// Where the next packet's bytes (at most 6) are to be written; only valid while DCC_waveform_ready().
+uint8_t *DCC_waveform_packet_buffer(void);
+/// Hand the size bytes in DCC_waveform_packet_buffer() to the generator.
+void DCC_waveform_send_packet(uint8_t size);
+/// Connect (non-zero) or disconnect the outputs; disconnected, both are held low. Safe to call from an ISR.
+void DCC_waveform_output(uint8_t enable);
+
+/// Send packets with profile (DCCWaveformBuffer.h) from the start of the next packet on; the packet on the rails
+/// finishes as it began. profile must stay valid while in use, as the predefined ones do. Returns zero, and
+/// changes nothing, if the profile is out of spec (DCC_timing_valid()). Every backend starts with DCC_timing_standard.
+uint8_t DCC_waveform_set_timing(const DCC_timing_profile_t *profile);
+/// The profile last set, in use from the next packet on if not already.
+const DCC_timing_profile_t *DCC_waveform_timing(void);
+
+/// Turn the RailCom cutout on or off (it starts off); takes effect from the next packet. Only with DCC_RAILCOM.
+void DCC_railcom_enable(uint8_t enable);
+/// Cutouts completed so far, wrapping at 256; a change means a detector may have received another reply.
+uint8_t DCC_railcom_cutouts(void);
+
+/// Non-volatile byte storage, used by DCCRoster to survive a reset.
+uint8_t DCC_eeprom_read(uint16_t address);
+/// Start writing one byte; skipped if the byte already holds value. Only call while DCC_eeprom_ready().
+void DCC_eeprom_write(uint16_t address, uint8_t value);
+/// Non-zero when no write is in progress, so DCC_eeprom_write() will not block.
+uint8_t DCC_eeprom_ready(void);
+
 #ifdef __cplusplus
 }
 #endif
 
-#endif //__DCCHARDWARE_H__
\ No newline at end of file
+#endif //__DCCHARDWARE_H__
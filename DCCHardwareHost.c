@@ -0,0 +1,176 @@
+#include "DCCHardwareHost.h"
+#include "DCCOvercurrent.h"
+#include <string.h>
+
+/// Host backend for the waveform HAL; see DCCHardwareHost.h
+#if !defined(ARDUINO)
+
+DCC_HOST_THREAD uint8_t DCC_host_packet[DCC_MAX_PACKET_SIZE];
+DCC_HOST_THREAD uint8_t DCC_host_packet_size = 0;
+DCC_HOST_THREAD uint16_t DCC_host_timings[DCC_WAVEFORM_MAX_HALF_PERIODS];
+DCC_HOST_THREAD uint16_t DCC_host_timings_count = 0;
+DCC_HOST_THREAD uint32_t DCC_host_packets_sent = 0;
+DCC_HOST_THREAD uint8_t DCC_host_output_enabled = 1;
+DCC_HOST_THREAD uint8_t DCC_host_eeprom[DCC_HOST_EEPROM_SIZE];
+DCC_HOST_THREAD uint32_t DCC_host_eeprom_wear[DCC_HOST_EEPROM_SIZE];
+DCC_HOST_THREAD uint32_t DCC_host_eeprom_writes = 0;
+/// Lets the first EEPROM access erase the array, so a harness need not call DCC_host_eeprom_erase()
+static DCC_HOST_THREAD uint8_t DCC_host_eeprom_valid = 0;
+
+/// Set while a packet is "on the rails", i.e. between send and DCC_host_waveform_complete()
+static DCC_HOST_THREAD uint8_t DCC_host_busy = 0;
+
+static DCC_HOST_THREAD const DCC_timing_profile_t *DCC_host_timing = &DCC_timing_standard;
+
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_enabled = 0;
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_cutouts = 0;
+/// Reply to be received in the coming cutout, and what the detector has received but not yet been read
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_pending[8];
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_pending_count = 0;
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_uart[64];
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_uart_head = 0;
+static DCC_HOST_THREAD uint8_t DCC_host_railcom_uart_count = 0;
+
+void setup_DCC_waveform_generator(void)
+{
+  DCC_host_packet_size = 0;
+  DCC_host_timings_count = 0;
+  DCC_host_packets_sent = 0;
+  DCC_host_busy = 0;
+  DCC_host_output_enabled = 1;
+  DCC_host_timing = &DCC_timing_standard;
+  DCC_host_railcom_cutouts = 0;
+  DCC_host_railcom_pending_count = 0;
+  DCC_host_railcom_uart_count = 0;
+}
+
+void DCC_waveform_generation_hasshin(void)
+{
+  //nothing to start; packets are encoded as soon as they are sent
+}
+
+uint8_t DCC_waveform_ready(void)
+{
+  return !DCC_host_busy;
+}
+
+uint8_t *DCC_waveform_packet_buffer(void)
+{
+  return DCC_host_packet;
+}
+
+void DCC_waveform_send_packet(uint8_t size)
+{
+  DCC_host_packet_size = size;
+  DCC_host_timings_count = DCC_waveform_encode_timings(DCC_host_packet, size, DCC_host_timings, DCC_host_timing);
+  for(uint16_t i = 0; i < DCC_host_timings_count; ++i)
+    DCC_overcurrent_sample();
+  ++DCC_host_packets_sent;
+  DCC_host_busy = 1;
+}
+
+void DCC_waveform_output(uint8_t enable)
+{
+  DCC_host_output_enabled = enable;
+}
+
+uint8_t DCC_waveform_set_timing(const DCC_timing_profile_t *profile)
+{
+  if(!DCC_timing_valid(profile))
+    return 0;
+  DCC_host_timing = profile; //each packet is encoded whole as it is sent, so this can only apply from the next one
+  return 1;
+}
+
+const DCC_timing_profile_t *DCC_waveform_timing(void)
+{
+  return DCC_host_timing;
+}
+
+void DCC_host_waveform_complete(void)
+{
+  uint8_t i;
+  DCC_host_busy = 0;
+  if(!DCC_host_railcom_enabled)
+    return;
+  //the cutout is over: whatever was sent in it is now in the detector's UART
+  for(i = 0; i < DCC_host_railcom_pending_count && DCC_host_railcom_uart_count < sizeof(DCC_host_railcom_uart); ++i)
+    DCC_host_railcom_uart[(DCC_host_railcom_uart_head + DCC_host_railcom_uart_count++) % sizeof(DCC_host_railcom_uart)] = DCC_host_railcom_pending[i];
+  DCC_host_railcom_pending_count = 0;
+  ++DCC_host_railcom_cutouts;
+}
+
+uint32_t DCC_host_packet_duration(void)
+{
+  uint32_t duration = 0;
+  uint16_t i;
+  for(i = 0; i < DCC_host_timings_count; ++i)
+    duration += DCC_host_timings[i];
+  if(DCC_host_railcom_enabled)
+    duration += DCC_RAILCOM_CUTOUT_END_US;
+  return duration;
+}
+
+void DCC_railcom_enable(uint8_t enable)
+{
+  DCC_host_railcom_enabled = DCC_RAILCOM && enable;
+}
+
+uint8_t DCC_railcom_cutouts(void)
+{
+  return DCC_host_railcom_cutouts;
+}
+
+void DCC_host_railcom_reply(const uint8_t *bytes, uint8_t count)
+{
+  if(count > sizeof(DCC_host_railcom_pending))
+    count = sizeof(DCC_host_railcom_pending);
+  memcpy(DCC_host_railcom_pending, bytes, count);
+  DCC_host_railcom_pending_count = count;
+}
+
+int16_t DCC_host_railcom_read(void)
+{
+  uint8_t b;
+  if(!DCC_host_railcom_uart_count)
+    return -1;
+  b = DCC_host_railcom_uart[DCC_host_railcom_uart_head];
+  DCC_host_railcom_uart_head = (DCC_host_railcom_uart_head + 1) % sizeof(DCC_host_railcom_uart);
+  --DCC_host_railcom_uart_count;
+  return b;
+}
+
+void DCC_host_eeprom_erase(void)
+{
+  memset(DCC_host_eeprom, 0xFF, sizeof(DCC_host_eeprom));
+  memset(DCC_host_eeprom_wear, 0, sizeof(DCC_host_eeprom_wear));
+  DCC_host_eeprom_writes = 0;
+  DCC_host_eeprom_valid = 1;
+}
+
+uint8_t DCC_eeprom_read(uint16_t address)
+{
+  if(!DCC_host_eeprom_valid)
+    DCC_host_eeprom_erase();
+  return DCC_host_eeprom[address % DCC_HOST_EEPROM_SIZE];
+}
+
+void DCC_eeprom_write(uint16_t address, uint8_t value)
+{
+  if(!DCC_host_eeprom_valid)
+    DCC_host_eeprom_erase();
+  address %= DCC_HOST_EEPROM_SIZE;
+  if(DCC_host_eeprom[address] != value)
+  {
+    DCC_host_eeprom[address] = value;
+    ++DCC_host_eeprom_wear[address];
+    ++DCC_host_eeprom_writes;
+  }
+}
+
+uint8_t DCC_eeprom_ready(void)
+{
+  return 1;
+}
+
+#endif //!ARDUINO
@@ -0,0 +1,58 @@
+#ifndef __DCCHARDWAREHOST_H__
+#define __DCCHARDWAREHOST_H__
+
+#include <stdint.h>
+#include "DCCHardware.h"
+#include "DCCWaveformBuffer.h"
+
+/// Host backend for the waveform HAL
+/** Built only when not compiling for an Arduino. Each packet handed to DCC_waveform_send_packet()
+    is encoded into DCC_host_timings[] exactly as a buffer-driven peripheral would receive it, and the
+    backend stays busy until the test harness calls DCC_host_waveform_complete(), standing in for the
+    peripheral's end-of-transfer interrupt. The overcurrent source is sampled once per half-period
+    of every packet sent, as the AVR ISR would. The EEPROM is an array in memory, erased to 0xFF,
+    that counts the writes each byte has taken. With DCC_RAILCOM, each packet is followed by a cutout
+    that lasts until DCC_RAILCOM_CUTOUT_END_US after the end bit; a harness plays the part of the decoders
+    and the detector with DCC_host_railcom_reply(), and DCC_host_railcom_read() is the detector's UART.
+*/
+
+#define DCC_HOST_EEPROM_SIZE 1024
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// The bytes of the last packet sent
+extern DCC_HOST_THREAD uint8_t DCC_host_packet[DCC_MAX_PACKET_SIZE];
+extern DCC_HOST_THREAD uint8_t DCC_host_packet_size;
+/// The half-period timing array of the last packet sent, in microseconds
+extern DCC_HOST_THREAD uint16_t DCC_host_timings[DCC_WAVEFORM_MAX_HALF_PERIODS];
+extern DCC_HOST_THREAD uint16_t DCC_host_timings_count;
+/// Total packets sent since setup_DCC_waveform_generator()
+extern DCC_HOST_THREAD uint32_t DCC_host_packets_sent;
+/// Zero while DCC_waveform_output() has the outputs disconnected
+extern DCC_HOST_THREAD uint8_t DCC_host_output_enabled;
+/// EEPROM contents, erased on first use; it outlives any scheduler, so a second DCCPacketScheduler
+/// set up in the same process sees what the first left behind, as after a reset
+extern DCC_HOST_THREAD uint8_t DCC_host_eeprom[DCC_HOST_EEPROM_SIZE];
+/// Writes each EEPROM byte has taken, and the total (writes of an unchanged value are skipped, as on AVR)
+extern DCC_HOST_THREAD uint32_t DCC_host_eeprom_wear[DCC_HOST_EEPROM_SIZE];
+extern DCC_HOST_THREAD uint32_t DCC_host_eeprom_writes;
+
+/// Mark the last packet as fully transmitted, so DCC_waveform_ready() reports true again.
+void DCC_host_waveform_complete(void);
+/// Duration of the last packet on the rails, in microseconds.
+uint32_t DCC_host_packet_duration(void);
+/// Bytes the detector will receive during the cutout after the packet now on the rails (at most 8).
+void DCC_host_railcom_reply(const uint8_t *bytes, uint8_t count);
+/// A DCC_railcom_source_t (DCCRailCom.h): the next byte received in a cutout so far, or -1.
+int16_t DCC_host_railcom_read(void);
+/// Erase the EEPROM to 0xFF and zero the wear counters.
+void DCC_host_eeprom_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DCCHARDWAREHOST_H__
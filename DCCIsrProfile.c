@@ -0,0 +1,64 @@
+#include "DCCIsrProfile.h"
+#include "DCCHardware.h"
+#include <string.h>
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+#endif
+
+#if DCC_PROFILE_ISR || !defined(ARDUINO)
+
+static DCC_HOST_THREAD volatile DCC_isr_profile_t DCC_isr_profile = {{0}, {0}, 0, 0, 0xFFFF, 0, 0};
+
+static uint8_t bucket(uint16_t ticks)
+{
+  ticks /= DCC_ISR_PROFILE_BUCKET_TICKS;
+  return (ticks < DCC_ISR_PROFILE_BUCKETS) ? ticks : DCC_ISR_PROFILE_BUCKETS-1;
+}
+
+void DCC_isr_profile_record(uint16_t entry_ticks, uint16_t exit_ticks, uint16_t new_top)
+{
+  uint16_t duration = exit_ticks - entry_ticks;
+  ++DCC_isr_profile.latency[bucket(entry_ticks)];
+  ++DCC_isr_profile.duration[bucket(duration)];
+  if(entry_ticks > DCC_isr_profile.max_latency)
+    DCC_isr_profile.max_latency = entry_ticks;
+  if(duration > DCC_isr_profile.max_duration)
+    DCC_isr_profile.max_duration = duration;
+  if(exit_ticks >= new_top)
+  {
+    ++DCC_isr_profile.late_reloads;
+    DCC_isr_profile.min_margin = 0;
+  }
+  else if(new_top - exit_ticks < DCC_isr_profile.min_margin)
+  {
+    DCC_isr_profile.min_margin = new_top - exit_ticks;
+  }
+  ++DCC_isr_profile.samples;
+}
+
+void DCC_isr_profile_read(DCC_isr_profile_t *profile)
+{
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+#endif
+  memcpy(profile, (const void *)&DCC_isr_profile, sizeof(DCC_isr_profile_t));
+#if defined(__AVR__)
+  SREG = sreg;
+#endif
+}
+
+void DCC_isr_profile_reset(void)
+{
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+#endif
+  memset((void *)&DCC_isr_profile, 0, sizeof(DCC_isr_profile_t));
+  DCC_isr_profile.min_margin = 0xFFFF;
+#if defined(__AVR__)
+  SREG = sreg;
+#endif
+}
+
+#endif //DCC_PROFILE_ISR || !ARDUINO
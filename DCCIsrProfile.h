@@ -0,0 +1,52 @@
+#ifndef __DCCISRPROFILE_H__
+#define __DCCISRPROFILE_H__
+
+#include <stdint.h>
+
+/// Timer1 ISR timing and jitter profile
+/** The waveform is only as good as the ISR's ability to reload OCR1A/OCR1B in time. In CTC mode
+    TCNT1 restarts from 0 at each compare match, so TCNT1 read on entry to the ISR is exactly how late
+    the ISR started, and TCNT1 read on exit is how far into the new half-period the reload landed.
+    If the reload lands after TCNT1 has already passed the new TOP, the timer runs on to 0xFFFF before
+    matching again and that half-period is ruined: the profile counts those as late reloads, and
+    keeps the smallest margin seen so you can tell how close a sketch comes to corrupting the waveform.
+
+    With DCC_PROFILE_ISR non-zero the AVR ISR records every interrupt. Host builds always have the
+    recorder, so DCCSimulator can feed it modelled interrupt latencies. All values are Timer1 ticks (0.5us).
+    The counts are 32 bits, like samples: the ISR runs 10,000 times a second or more, so 16-bit counts
+    would wrap within seconds. That makes the profile 142 bytes of RAM.
+*/
+
+#ifndef DCC_PROFILE_ISR
+#define DCC_PROFILE_ISR 0
+#endif
+
+#define DCC_ISR_PROFILE_BUCKETS       16
+#define DCC_ISR_PROFILE_BUCKET_TICKS  4  //2us per bucket; the last bucket collects everything beyond
+
+typedef struct
+{
+  uint32_t latency[DCC_ISR_PROFILE_BUCKETS]; //TCNT1 on entry
+  uint32_t duration[DCC_ISR_PROFILE_BUCKETS]; //TCNT1 on exit less TCNT1 on entry
+  uint16_t max_latency;
+  uint16_t max_duration;
+  uint16_t min_margin; //smallest (new TOP - TCNT1 on exit) seen
+  uint32_t late_reloads; //reloads that landed after TCNT1 had passed the new TOP
+  uint32_t samples;
+} DCC_isr_profile_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void DCC_isr_profile_record(uint16_t entry_ticks, uint16_t exit_ticks, uint16_t new_top);
+/// Copy the profile out with interrupts held off, so the copy is consistent.
+void DCC_isr_profile_read(DCC_isr_profile_t *profile);
+void DCC_isr_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DCCISRPROFILE_H__
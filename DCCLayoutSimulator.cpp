@@ -0,0 +1,222 @@
+#include "DCCLayoutSimulator.h"
+
+#if !defined(ARDUINO)
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#define DCC_LAYOUT_EVERY_DISTRICT 0xFF
+
+DCCLayoutSimulator::DCCLayoutSimulator(uint8_t district_count, uint32_t new_epoch) : handoffs(0), wall_ns(0), next_command(0), unsorted(false),
+    next_handoff(0), clock(0), epoch(new_epoch), generation(0), running(0), epoch_end(0), stopping(false)
+{
+  for(uint8_t i = 0; i < district_count; ++i)
+    districts.push_back(new District());
+}
+
+DCCLayoutSimulator::~DCCLayoutSimulator(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  start.notify_all();
+  for(size_t i = 0; i < districts.size(); ++i)
+  {
+    if(districts[i]->worker.joinable())
+      districts[i]->worker.join();
+    delete districts[i];
+  }
+}
+
+void DCCLayoutSimulator::place(uint16_t address, uint8_t district)
+{
+  location[address] = district;
+}
+
+void DCCLayoutSimulator::addCommand(uint64_t time_us, const char *command)
+{
+  DCCSimEvent e;
+  e.time = time_us;
+  strncpy(e.command, command, sizeof(e.command)-1);
+  e.command[sizeof(e.command)-1] = 0;
+  //append; route() sorts the not-yet-routed part once, as DCCSimulator::run() does
+  if(commands.size() > next_command && time_us < commands.back().time)
+    unsorted = true;
+  commands.push_back(e);
+}
+
+void DCCLayoutSimulator::addThrottle(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us)
+{
+  std::vector<DCCSimEvent> throttle;
+  DCCSimulator::throttleEvents(address, updates_per_second, start_us, end_us, throttle);
+  for(size_t i = 0; i < throttle.size(); ++i)
+    addCommand(throttle[i].time, throttle[i].command);
+}
+
+void DCCLayoutSimulator::addHandoff(uint64_t time_us, uint16_t address, uint8_t to_district)
+{
+  DCCLayoutHandoff h = { time_us, address, to_district };
+  std::vector<DCCLayoutHandoff>::iterator i = handoff_list.begin() + next_handoff;
+  while(i != handoff_list.end() && i->time <= time_us)
+    ++i;
+  handoff_list.insert(i, h);
+}
+
+/// Which district a command goes to: the one holding its loco, or all of them if it names none
+uint8_t DCCLayoutSimulator::owner(const char *command)
+{
+  const char *field = command + 1;
+  field += strspn(field, " ");
+  if(*field == 'L' || *field == 'l')
+    ++field;
+  char *end;
+  unsigned long address = strtoul(field, &end, 10);
+  if(end == field)
+    return DCC_LAYOUT_EVERY_DISTRICT;
+  std::map<uint16_t, uint8_t>::iterator i = location.find(address);
+  return (i == location.end()) ? 0 : i->second;
+}
+
+void DCCLayoutSimulator::route(uint64_t until)
+{
+  if(unsorted)
+  {
+    std::stable_sort(commands.begin() + next_command, commands.end());
+    unsorted = false;
+  }
+  for(; next_command < commands.size() && commands[next_command].time < until; ++next_command)
+  {
+    DCCSimEvent &e = commands[next_command];
+    uint8_t d = owner(e.command);
+    if(d == DCC_LAYOUT_EVERY_DISTRICT)
+    {
+      for(size_t i = 0; i < districts.size(); ++i)
+        districts[i]->simulator.addCommand(e.time, e.command);
+    }
+    else if(d < districts.size())
+    {
+      districts[d]->simulator.addCommand(e.time, e.command);
+    }
+  }
+}
+
+void DCCLayoutSimulator::handoff(DCCLayoutHandoff &h)
+{
+  uint8_t from = location.count(h.address) ? location[h.address] : 0;
+  location[h.address] = h.district;
+  if((from == h.district) || (h.district >= districts.size()))
+    return;
+  ++handoffs;
+#if DCC_ROSTER_SIZE
+  //the new district takes over where the old one left off; the old one lets the loco go
+  DCCRoster &roster = districts[from]->scheduler.roster;
+  DCCRosterEntry *e = roster.find(h.address, DCC_SHORT_ADDRESS);
+  if(!e)
+    e = roster.find(h.address, DCC_LONG_ADDRESS);
+  if(!e)
+    return;
+  const char *prefix = ((e->address_kind == DCC_LONG_ADDRESS) && (e->address <= 127)) ? "L" : "";
+  char command[24];
+  snprintf(command, sizeof(command), "S %s%u %d %u", prefix, e->address, e->speed, e->steps);
+  districts[h.district]->simulator.addCommand(clock, command);
+  snprintf(command, sizeof(command), "F %s%u %u", prefix, e->address, e->functions);
+  districts[h.district]->simulator.addCommand(clock, command);
+  roster.remove(e);
+#endif
+}
+
+void DCCLayoutSimulator::work(uint8_t i)
+{
+  District &d = *districts[i];
+  d.scheduler.setup(); //on this thread, so it sets up this thread's waveform backend
+  uint32_t seen = 0;
+  for(;;)
+  {
+    uint64_t end;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      start.wait(guard, [&]{ return stopping || (generation != seen); });
+      if(stopping)
+        return;
+      seen = generation;
+      end = epoch_end;
+    }
+    d.simulator.run(end);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(--running == 0)
+        done.notify_one();
+    }
+  }
+}
+
+void DCCLayoutSimulator::run(uint64_t end_us)
+{
+  std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < districts.size(); ++i)
+  {
+    if(!districts[i]->worker.joinable())
+      districts[i]->worker = std::thread(&DCCLayoutSimulator::work, this, (uint8_t)i);
+  }
+  while(clock < end_us)
+  {
+    uint64_t next = clock + epoch;
+    if(next > end_us)
+      next = end_us;
+    //the workers are all waiting, so their districts can be touched from here
+    for(; next_handoff < handoff_list.size() && handoff_list[next_handoff].time <= clock; ++next_handoff)
+      handoff(handoff_list[next_handoff]);
+    route(next);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      epoch_end = next;
+      running = districts.size();
+      ++generation;
+    }
+    start.notify_all();
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      done.wait(guard, [&]{ return running == 0; });
+    }
+    clock = next;
+  }
+  wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start).count();
+}
+
+void DCCLayoutSimulator::report(FILE *out)
+{
+  DCCSimHistogram latency;
+  uint32_t packets = 0, idle = 0, issued = 0, rejected = 0, limited = 0, malformed = 0;
+  for(size_t i = 0; i < districts.size(); ++i)
+  {
+    DCCSimulator &s = districts[i]->simulator;
+    packets += s.packets_sent;
+    idle += s.idle_packets_sent;
+    issued += s.commands_issued;
+    rejected += s.commands_rejected;
+    limited += s.commands_limited;
+    malformed += s.commands_malformed;
+    for(size_t j = 0; j < s.latency.samples.size(); ++j)
+      latency.record(s.latency.samples[j]);
+  }
+  fprintf(out, "layout: %u districts, simulated %.3fs in %.3fs (%.0fx real time), %u handoffs\n", (unsigned)districts.size(),
+    clock / 1e6, wall_ns / 1e9, wall_ns ? clock * 1e3 / wall_ns : 0.0, handoffs);
+  fprintf(out, "packets: %u (%u idle, %.1f%%), %.1f packets/s across the layout\n", packets, idle,
+    packets ? 100.0 * idle / packets : 0.0, clock ? packets * 1e6 / clock : 0.0);
+  fprintf(out, "commands: %u issued, %u rejected with the queues full (%.2f%%), %u over the rate limit, %u malformed or not built\n",
+    issued, rejected, issued ? 100.0 * rejected / issued : 0.0, limited, malformed);
+  latency.print(out, "latency");
+  for(size_t i = 0; i < districts.size(); ++i)
+  {
+    DCCSimulator &s = districts[i]->simulator;
+    fprintf(out, "district %u: %u packets (%.1f%% idle), %u commands, %u rejected, latency mean=%lluus max=%lluus, pool high water %u\n",
+      (unsigned)i, s.packets_sent, s.packets_sent ? 100.0 * s.idle_packets_sent / s.packets_sent : 0.0, s.commands_issued,
+      s.commands_rejected, s.latency.count ? (unsigned long long)(s.latency.total / s.latency.count) : 0ULL,
+      (unsigned long long)s.latency.max, districts[i]->scheduler.packet_pool.getHighWater());
+  }
+}
+
+#endif //!ARDUINO
@@ -0,0 +1,107 @@
+#ifndef __DCCLAYOUTSIMULATOR_H__
+#define __DCCLAYOUTSIMULATOR_H__
+
+/**
+ * Simulation of a layout split into power districts, each with its own command station, for host
+ * builds only. Every district is a DCCPacketScheduler with its own DCCSimulator, run on its own
+ * worker thread (the host backend keeps its state per thread; see DCC_HOST_THREAD in DCCHardware.h),
+ * so a session with many districts uses as many host cores.
+ *
+ * The districts share one simulated clock, advanced in epochs of epoch_us: every worker runs its
+ * district to the end of the epoch, then waits for the others. Between epochs the layout
+ *   *routes each layout-wide command due in the next epoch to the district holding its loco then
+ *    (commands without an address, such as a broadcast E, go to every district);
+ *   *carries out handoffs: the loco's speed and functions are read from the old district's roster
+ *    and sent by the new district at once, and the old district forgets the loco.
+ * Handoffs therefore take effect on the first epoch boundary at or after their time.
+ *
+ * A loco's latency is measured from its command's scenario time, as in DCCSimulator, so commands that
+ * follow a loco across a handoff are measured too. report() sums throughput and latency over the layout
+ * and lists each district, along with the simulated time against the host time it took.
+ *
+ * The harness's millis() should use DCCSimulator::current(), which is per thread.
+**/
+
+#if !defined(ARDUINO)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "DCCSimulator.h"
+
+#define DCC_LAYOUT_DEFAULT_EPOCH_US 20000
+
+struct DCCLayoutHandoff
+{
+  uint64_t time; //us
+  uint16_t address;
+  uint8_t district; //moving to
+};
+
+class DCCLayoutSimulator
+{
+  public:
+    DCCLayoutSimulator(uint8_t district_count, uint32_t new_epoch = DCC_LAYOUT_DEFAULT_EPOCH_US);
+    ~DCCLayoutSimulator(void);
+    
+    //scenario construction
+    void place(uint16_t address, uint8_t district); //where a loco starts; unplaced locos start in district 0
+    void addCommand(uint64_t time_us, const char *command); //DCCCommandParser syntax, routed by address
+    void addThrottle(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us);
+    void addHandoff(uint64_t time_us, uint16_t address, uint8_t to_district);
+    //one district's own simulator, for commands that belong to it alone (accessories, say); only between runs
+    inline DCCSimulator &district(uint8_t i) { return districts[i]->simulator; }
+    inline uint8_t getDistrictCount(void) { return districts.size(); }
+    
+    //runs every district from the current simulated time until end_us
+    void run(uint64_t end_us);
+    void report(FILE *out);
+    
+    inline uint64_t now(void) { return clock; }
+    
+    //results
+    uint32_t handoffs;
+    uint64_t wall_ns; //host time spent in run()
+    
+  private:
+    struct District
+    {
+      DCCPacketScheduler scheduler;
+      DCCSimulator simulator;
+      std::thread worker;
+      
+      District(void) : simulator(scheduler) {}
+    };
+    
+    void work(uint8_t i); //worker thread body
+    void route(uint64_t until); //hand out layout commands due before until
+    void handoff(DCCLayoutHandoff &h);
+    uint8_t owner(const char *command);
+    
+    std::vector<District *> districts;
+    std::vector<DCCSimEvent> commands; //layout-wide, sorted by time from next_command on, unless unsorted
+    size_t next_command;
+    bool unsorted; //a command was added out of order since route() last sorted them
+    std::vector<DCCLayoutHandoff> handoff_list; //sorted by time
+    size_t next_handoff;
+    std::map<uint16_t, uint8_t> location; //loco address -> district
+    uint64_t clock;
+    uint32_t epoch;
+    
+    //epoch hand-over between this thread and the workers
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint32_t generation; //bumped to start an epoch
+    uint8_t running; //workers still in the current epoch
+    uint64_t epoch_end;
+    bool stopping;
+};
+
+#endif //!ARDUINO
+
+#endif //__DCCLAYOUTSIMULATOR_H__
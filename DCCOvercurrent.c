@@ -0,0 +1,76 @@
+#include "DCCOvercurrent.h"
+#include "DCCHardware.h"
+#if defined(__AVR__)
+#include <avr/io.h>
+#endif
+
+static DCC_HOST_THREAD DCC_current_source_t DCC_current_source = 0;
+static DCC_HOST_THREAD uint16_t DCC_current_threshold = 0xFFFF;
+static DCC_HOST_THREAD uint8_t DCC_current_debounce = 1;
+static DCC_HOST_THREAD volatile uint8_t DCC_current_over = 0; //consecutive readings above threshold
+static DCC_HOST_THREAD volatile uint8_t DCC_current_tripped = 0;
+static DCC_HOST_THREAD volatile uint16_t DCC_current_trips = 0;
+
+void DCC_overcurrent_setup(DCC_current_source_t source, uint16_t threshold, uint8_t debounce)
+{
+  DCC_current_source = source;
+  DCC_current_threshold = threshold;
+  DCC_current_debounce = debounce ? debounce : 1;
+  DCC_current_over = 0;
+  DCC_current_tripped = 0;
+  DCC_current_trips = 0;
+}
+
+uint8_t DCC_overcurrent_sample(void)
+{
+  if(DCC_current_tripped || !DCC_current_source)
+    return DCC_current_tripped;
+  if(DCC_current_source() > DCC_current_threshold)
+  {
+    if(++DCC_current_over >= DCC_current_debounce)
+    {
+      DCC_waveform_output(0); //kill the track right now
+      DCC_current_tripped = 1;
+      ++DCC_current_trips;
+    }
+  }
+  else
+  {
+    DCC_current_over = 0;
+  }
+  return DCC_current_tripped;
+}
+
+uint8_t DCC_overcurrent_tripped(void)
+{
+  return DCC_current_tripped;
+}
+
+void DCC_overcurrent_clear(void)
+{
+  DCC_current_over = 0;
+  DCC_current_tripped = 0;
+  DCC_waveform_output(1);
+}
+
+uint16_t DCC_overcurrent_trips(void)
+{
+  return DCC_current_trips;
+}
+
+#if defined(__AVR__)
+void DCC_overcurrent_adc_setup(uint8_t channel)
+{
+  ADMUX = (1<<REFS0) | (channel & 0x07); //AVcc reference
+#if defined(ADCSRB)
+  ADCSRB = 0; //free running
+#endif
+  //enable, start, auto-trigger (free running), /128 prescalar
+  ADCSRA = (1<<ADEN) | (1<<ADSC) | (1<<ADATE) | (1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0);
+}
+
+uint16_t DCC_overcurrent_adc_read(void)
+{
+  return ADC; //last completed conversion; never waits
+}
+#endif
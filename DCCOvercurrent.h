@@ -0,0 +1,45 @@
+#ifndef __DCCOVERCURRENT_H__
+#define __DCCOVERCURRENT_H__
+
+#include <stdint.h>
+
+/// Overcurrent / short circuit trip
+/** The current sense reading comes from a pluggable source that must return immediately: typically
+    the last conversion of a free-running ADC (see DCC_overcurrent_adc_setup()), or a mock on host builds.
+    With DCC_OVERCURRENT non-zero, the waveform ISR samples it every half-period; debounce consecutive
+    readings above threshold trip the breaker, and the ISR cuts both outputs on the spot, within one
+    half-period of the fault being seen. The scheduler then stops feeding packets until the trip is cleared,
+    either by the sketch calling DCC_overcurrent_clear() or by DCCPacketScheduler's auto-retry policy.
+*/
+
+#ifndef DCC_OVERCURRENT
+#define DCC_OVERCURRENT 0
+#endif
+
+typedef uint16_t (*DCC_current_source_t)(void);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void DCC_overcurrent_setup(DCC_current_source_t source, uint16_t threshold, uint8_t debounce);
+/// Take one reading; trips and cuts the outputs if need be. Returns non-zero while tripped.
+uint8_t DCC_overcurrent_sample(void);
+uint8_t DCC_overcurrent_tripped(void);
+/// Re-arm the breaker and turn the outputs back on.
+void DCC_overcurrent_clear(void);
+/// How many times the breaker has tripped since setup.
+uint16_t DCC_overcurrent_trips(void);
+
+#if defined(__AVR__)
+/// Put the ADC in free-running mode on channel, for DCC_overcurrent_adc_read(). analogRead() must not be used afterwards.
+void DCC_overcurrent_adc_setup(uint8_t channel);
+uint16_t DCC_overcurrent_adc_read(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DCCOVERCURRENT_H__
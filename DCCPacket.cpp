@@ -74,6 +74,83 @@ uint8_t DCCPacket::getBitstream(uint8_t rawbytes[]) //returns size of array.
 	return 0; //ERROR! SHOULD NEVER REACH HERE! do something useful, like transform it into an idle packet or something! TODO
 }
 
+uint8_t DCCPacket::setBitstream(const uint8_t rawbytes[], uint8_t size)
+{
+	kind = other_packet_kind;
+	if (size < 3 || size > 6)
+		return 0;
+	uint8_t XOR = 0;
+	uint8_t i;
+	for (i = 0; i < size; ++i) {
+		XOR ^= rawbytes[i];
+	}
+	if (XOR)
+		return 0;
+
+	if (rawbytes[0] == 0xFF) //idle: FF 00 FF
+	{
+		if (size != 3 || rawbytes[1])
+			return 0;
+		setAddress(0xFF, DCC_SHORT_ADDRESS);
+		data[0] = 0x00;
+		size_repeat = (size_repeat & 0x3F) | (1<<6);
+		kind = idle_packet_kind;
+		return 1;
+	}
+
+	if ((rawbytes[0] & 0xC0) == 0x80) //10AAAAAA 1AAACDDD: basic accessory, undoing getBitstream() above
+	{
+		if (!(rawbytes[1] & 0x80) || size > 5) //an extended accessory, or more programming bytes than data[] holds
+			return 0;
+		setAddress((rawbytes[0] & 0x3F) | ((~rawbytes[1] & 0x70) << 2), DCC_SHORT_ADDRESS);
+		data[0] = rawbytes[1] & 0x07;
+		for (i = 2; i < size - 1; ++i) {
+			data[i - 1] = rawbytes[i];
+		}
+		size_repeat = (size_repeat & 0x3F) | ((size - 2)<<6);
+		kind = basic_accessory_packet_kind;
+		return 1;
+	}
+
+	uint8_t first = 1; //index of the first instruction byte
+	if ((rawbytes[0] & 0xC0) == 0xC0) //11AAAAAA AAAAAAAA: long address; 0xE8 and above are reserved
+	{
+		if (rawbytes[0] > 0xE7)
+			return 0;
+		setAddress(((rawbytes[0] & 0x3F) << 8) | rawbytes[1], DCC_LONG_ADDRESS);
+		first = 2;
+	} else
+	{
+		setAddress(rawbytes[0], DCC_SHORT_ADDRESS);
+	}
+	uint8_t count = size - 1 - first;
+	if (count < 1 || count > 3)
+		return 0;
+	for (i = 0; i < count; ++i) {
+		data[i] = rawbytes[first + i];
+	}
+	size_repeat = (size_repeat & 0x3F) | (count<<6);
+
+	uint8_t instruction = data[0];
+	if (!address && count == 1 && !instruction) //reset: 00 00 00
+		kind = reset_packet_kind;
+	else if ((instruction & 0xC0) == 0x40) //01DCSSSS: 14 or 28 steps; speed 0001 is an emergency stop
+		kind = ((instruction & 0x0F) == 0x01) ? e_stop_packet_kind : speed_packet_kind;
+	else if (instruction == 0x3F && count == 2) //128 steps; speed 1 is an emergency stop
+		kind = ((data[1] & 0x7F) == 0x01) ? e_stop_packet_kind : speed_packet_kind;
+	else if ((instruction & 0xE0) == 0x80) //100DDDDD: F0-F4
+		kind = function_packet_1_kind;
+	else if ((instruction & 0xF0) == 0xB0) //1011DDDD: F5-F8
+		kind = function_packet_2_kind;
+	else if ((instruction & 0xF0) == 0xA0) //1010DDDD: F9-F12
+		kind = function_packet_3_kind;
+	else if ((instruction & 0xF0) == 0xE0) //1110CCVV: ops mode CV access, long form
+		kind = ops_mode_programming_kind;
+	else
+		return 0; //a valid packet, but not one this class builds; the address is kept
+	return 1;
+}
+
 uint8_t DCCPacket::getSize(void)
 {
   return (size_repeat>>6);
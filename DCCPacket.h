@@ -52,6 +52,9 @@ class DCCPacket
     DCCPacket(uint16_t decoder_address=0xFF, uint8_t decoder_address_kind=0x00);
     
     uint8_t getBitstream(uint8_t rawuint8_ts[]); //returns size of array.
+    //the reverse, for packets read off the rails: takes address, kind and data from size bytes, error byte included.
+    //Returns 0, leaving an other_packet_kind packet, if the error byte is wrong or the packet is not one this class can build.
+    uint8_t setBitstream(const uint8_t rawuint8_ts[], uint8_t size);
     uint8_t getSize(void);
     inline uint16_t getAddress(void) { return address; }
     inline uint8_t getAddressKind(void) { return address_kind; }
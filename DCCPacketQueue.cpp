@@ -1,108 +1,328 @@
 #include "DCCPacketQueue.h"
 
-DCCPacketQueue::DCCPacketQueue(void) : read_pos(0), write_pos(0), size(10), written(0)
+DCCPacketPool::DCCPacketPool(void) : slots(0), next(0), free_head(DCC_POOL_END), size(0), free_count(0), unmet(0), high_water(0)
 {
   return;
 }
 
-void DCCPacketQueue::setup(byte length)
+void DCCPacketPool::setup(byte length)
 {
   size = length;
-  queue = (DCCPacket *)malloc(sizeof(DCCPacket) *size);
+  slots = (DCCPacket *)malloc(sizeof(DCCPacket) *size);
+  next = (byte *)malloc(size);
+  //thread every slot onto the free list
   for(int i = 0; i<size; ++i)
   {
-    queue[i] = DCCPacket();
+    slots[i] = DCCPacket();
+    next[i] = i+1;
   }
+  next[size-1] = DCC_POOL_END;
+  free_head = 0;
+  free_count = size;
 }
 
-bool DCCPacketQueue::insertPacket(DCCPacket *packet)
+byte DCCPacketPool::allocate(void)
+{
+  byte slot = free_head;
+  if(slot != DCC_POOL_END)
+  {
+    free_head = next[slot];
+    next[slot] = DCC_POOL_END;
+    --free_count;
+    if(size - free_count > high_water)
+      high_water = size - free_count;
+  }
+  return slot;
+}
+
+void DCCPacketPool::release(byte slot)
+{
+  next[slot] = free_head;
+  free_head = slot;
+  ++free_count;
+}
+
+
+/*****************************/
+
+DCCPacketQueue::DCCPacketQueue(void) : pool(0), head(DCC_POOL_END), tail(DCC_POOL_END), reserve(0), written(0), reserved(DCC_POOL_END)
+{
+  return;
+}
+
+void DCCPacketQueue::setup(DCCPacketPool *new_pool, byte new_reserve)
+{
+  pool = new_pool;
+  reserve = new_reserve;
+  pool->unmet += reserve;
+}
+
+byte DCCPacketQueue::take(void)
+{
+  if(isFull())
+    return DCC_POOL_END;
+  if(written < reserve) //drawing on our own reservation
+    --pool->unmet;
+  ++written;
+  return pool->allocate();
+}
+
+void DCCPacketQueue::give(byte slot)
+{
+  disclaim();
+  pool->slots[slot] = DCCPacket(); //revert to default value
+  pool->release(slot);
+}
+
+void DCCPacketQueue::disclaim(void)
+{
+  if(!written) //never below zero, whatever a caller does
+    return;
+  --written;
+  if(written < reserve) //that slot goes back to covering our reservation
+    ++pool->unmet;
+}
+
+byte DCCPacketQueue::unlink(void)
+{
+  byte slot = head;
+  head = pool->next[slot];
+  if(head == DCC_POOL_END)
+    tail = DCC_POOL_END;
+  pool->next[slot] = DCC_POOL_END;
+  return slot;
+}
+
+bool DCCPacketQueue::adopt(byte slot)
+{
+  //as if the slot were released and then taken again, but without touching its contents
+  if((written >= reserve) && (pool->free_count < pool->unmet))
+  {
+    pool->slots[slot] = DCCPacket();
+    pool->release(slot);
+    return false;
+  }
+  if(written < reserve)
+    --pool->unmet;
+  ++written;
+  append(slot);
+  return true;
+}
+
+void DCCPacketQueue::append(byte slot)
+{
+  if(tail == DCC_POOL_END)
+    head = slot;
+  else
+    pool->next[tail] = slot;
+  tail = slot;
+}
+
+void DCCPacketQueue::pop(void)
+{
+  give(unlink());
+}
+
+DCCPacket *DCCPacketQueue::reservePacket(uint16_t address, uint8_t address_kind, uint8_t kind)
+{
+  //First: reuse any packet with the same address and kind; if no such packet THEN take a fresh slot for the end
+  byte slot;
+  for(slot = head; slot != DCC_POOL_END; slot = pool->next[slot])
+  {
+    if( (pool->slots[slot].getAddress() == address) && (pool->slots[slot].getKind() == kind))
+      break;
+  }
+  if(slot != DCC_POOL_END)
+  {
+    reserved = DCC_POOL_END; //overwritten in place: do not increment written or relink
+  }
+  else
+  {
+    slot = take();
+    if(slot == DCC_POOL_END)
+      return 0; //Queue is full!
+    reserved = slot;
+  }
+  DCCPacket *p = &pool->slots[slot];
+  *p = DCCPacket(address, address_kind);
+  p->setKind(kind);
+  return p;
+}
+
+bool DCCPacketQueue::commitPacket(void)
+{
+  if(reserved != DCC_POOL_END)
+  {
+    append(reserved);
+    reserved = DCC_POOL_END;
+  }
+  return true;
+}
+
+void DCCPacketQueue::releasePacket(void)
 {
-//  Serial.print("Enqueueing a packet of kind: ");
-//  Serial.println(packet->getKind(), DEC);
-   //First: Overwrite any packet with the same address and kind; if no such packet THEN hitup the packet at write_pos
-  byte i = read_pos;
-  while(i != (read_pos+written)%(size) )//(size+1) ) //size+1 so we can check the last slot, too…
+  if(!isEmpty())
+    pop();
+}
+
+bool DCCPacketQueue::transferPacket(DCCPacketQueue *destination)
+{
+  byte slot = unlink();
+  disclaim();
+  DCCPacket *p = &pool->slots[slot];
+  //the destination may already hold a packet with the same address and kind; if so, that one is superseded
+  for(byte i = destination->head; i != DCC_POOL_END; i = pool->next[i])
   {
-    if( (queue[i].getAddress() == packet->getAddress()) && (queue[i].getKind() == packet->getKind()))
+    if( (pool->slots[i].getAddress() == p->getAddress()) && (pool->slots[i].getKind() == p->getKind()))
     {
-//      Serial.print("Overwriting existing packet at index ");
-//      Serial.println(i, DEC);
-      memcpy(&queue[i],packet,sizeof(DCCPacket));
-      //do not increment written or modify write_pos
+      memcpy(&pool->slots[i],p,sizeof(DCCPacket));
+      pool->slots[slot] = DCCPacket();
+      pool->release(slot);
       return true;
     }
-    i = (i+1)%size;
-  }
-  
-  //else, tack it on to the end
-  if(!isFull())
-  {
-    //else, just write it at the end of the queue.
-    memcpy(&queue[write_pos],packet,sizeof(DCCPacket));
-//    Serial.print("Write packet to index ");
-//    Serial.println(write_pos, DEC);
-    write_pos = (write_pos + 1) % size;
-    ++written;
-    return true;
   }
-//  Serial.println("Queue is full!");
+  return destination->adopt(slot);
+}
+
+#if DCC_FAIR_ADDRESSES
+bool DCCPacketQueue::holdsOther(uint16_t last_address)
+{
+  for(byte i = head; i != DCC_POOL_END; i = pool->next[i])
+  {
+    if(pool->slots[i].getAddress() != last_address)
+      return true; //most often the head
+  }
   return false;
 }
 
-// void DCCPacketQueue::printQueue(void)
-// {
-//   byte i, j;
-//   for(i = 0; i < size; ++i)
-//   {
-//     for(j = 0; j < (queue[i].size_repeat>>4); ++j)
-//     {
-//       Serial.print(queue[i].data[j],BIN);
-//       Serial.print(" ");
-//     }
-//     if(i == read_pos) Serial.println("   r");
-//     else if(i == write_pos) Serial.println("    w");
-//     else Serial.println("");
-//   }
-// }
+bool DCCPacketQueue::selectFair(DCCFairShare *share, uint16_t last_address)
+{
+  byte best = DCC_POOL_END;
+  byte best_prev = DCC_POOL_END;
+  uint16_t best_age = 0;
+  byte prev = DCC_POOL_END;
+  for(byte i = head; i != DCC_POOL_END; prev = i, i = pool->next[i])
+  {
+    DCCPacket *p = &pool->slots[i];
+    if(p->getAddress() == last_address)
+      continue;
+    uint16_t age = share->age(p->getAddress(), p->getAddressKind());
+    if((best == DCC_POOL_END) || (age > best_age)) //ties go to the earlier packet, so each address keeps its own order
+    {
+      best = i;
+      best_prev = prev;
+      best_age = age;
+      if(age == 0xFFFF) //not served lately: none can have waited longer
+        break;
+    }
+  }
+  if(best == DCC_POOL_END)
+    return false;
+  if(best != head) //relink it at the head
+  {
+    pool->next[best_prev] = pool->next[best];
+    if(tail == best)
+      tail = best_prev;
+    pool->next[best] = head;
+    head = best;
+  }
+  return true;
+}
+#endif
+
+bool DCCPacketQueue::insertPacket(DCCPacket *packet)
+{
+  DCCPacket *slot = reservePacket(packet->getAddress(), packet->getAddressKind(), packet->getKind());
+  if(!slot)
+    return false;
+  memcpy(slot,packet,sizeof(DCCPacket));
+  return commitPacket();
+}
 
 bool DCCPacketQueue::readPacket(DCCPacket *packet)
 {
   if(!isEmpty())
   {
-//    Serial.print("Reading a packet from index: ");
-//    Serial.println(read_pos, DEC);
-    memcpy(packet,&queue[read_pos],sizeof(DCCPacket));
-    read_pos = (read_pos + 1) % size;
-    --written;
+    memcpy(packet,peekPacket(),sizeof(DCCPacket));
+    releasePacket();
     return true;
   }
   return false;
 }
 
-bool DCCPacketQueue::forget(uint16_t address, uint8_t address_kind)
+bool DCCPacketQueue::holds(uint16_t address, uint8_t kind)
+{
+  for(byte i = head; i != DCC_POOL_END; i = pool->next[i])
+  {
+    if( (pool->slots[i].getAddress() == address) && (pool->slots[i].getKind() == kind))
+      return true;
+  }
+  return false;
+}
+
+bool DCCPacketQueue::forget(uint16_t address, uint8_t address_kind, uint8_t kind)
 {
   bool found = false;
-  for(int i = 0; i < size; ++i)
+  byte prev = DCC_POOL_END;
+  byte i = head;
+  while(i != DCC_POOL_END)
   {
-    if( (queue[i].getAddress() == address) && (queue[i].getAddressKind() == address_kind) )
+    byte following = pool->next[i];
+    if( (pool->slots[i].getAddress() == address) && (pool->slots[i].getAddressKind() == address_kind) &&
+        ((kind == DCC_ANY_KIND) || (pool->slots[i].getKind() == kind)) )
     {
       found = true;
-      queue[i] = DCCPacket(); //revert to default value
+      //unlink slot i
+      if(prev == DCC_POOL_END)
+        head = following;
+      else
+        pool->next[prev] = following;
+      if(tail == i)
+        tail = prev;
+      give(i);
     }
+    else
+    {
+      prev = i;
+    }
+    i = following;
   }
-  --written;
   return found;
 }
 
-void DCCPacketQueue::clear(void)
+bool DCCPacketQueue::forgetKind(uint8_t kind)
 {
-  read_pos = 0;
-  write_pos = 0;
-  written = 0;
-  for(int i = 0; i<size; ++i)
+  bool found = false;
+  byte prev = DCC_POOL_END;
+  byte i = head;
+  while(i != DCC_POOL_END)
   {
-    queue[i] = DCCPacket();
+    byte following = pool->next[i];
+    if(pool->slots[i].getKind() == kind)
+    {
+      found = true;
+      if(prev == DCC_POOL_END)
+        head = following;
+      else
+        pool->next[prev] = following;
+      if(tail == i)
+        tail = prev;
+      give(i);
+    }
+    else
+    {
+      prev = i;
+    }
+    i = following;
   }
+  return found;
+}
+
+void DCCPacketQueue::clear(void)
+{
+  //walk the list itself rather than trusting written, so a slot reserved and never committed can't run it off the end
+  while(head != DCC_POOL_END)
+    pop();
 }
 
 
@@ -121,22 +341,21 @@ bool DCCRepeatQueue::insertPacket(DCCPacket *packet)
   return false;
 }
 
-bool DCCRepeatQueue::readPacket(DCCPacket *packet)
+void DCCRepeatQueue::releasePacket(void)
 {
   if(!isEmpty())
   {
-    memcpy(packet,&queue[read_pos],sizeof(DCCPacket));
-    read_pos = (read_pos + 1) % size;
-    --written;
-
-    if(packet->getRepeat()) //the packet needs to be sent out at least one more time
-    {     
-      packet->setRepeat(packet->getRepeat()-1);
-      insertPacket(packet);
+    DCCPacket *p = peekPacket();
+    if(p->getRepeat() > 1) //the packet needs to be sent out at least one more time: move it to the back
+    {
+      p->setRepeat(p->getRepeat()-1);
+      append(unlink());
+    }
+    else
+    {
+      pop();
     }
-    return true;
   }
-  return false;
 }
 
 
@@ -147,20 +366,14 @@ DCCEmergencyQueue::DCCEmergencyQueue(void) : DCCPacketQueue()
 }
 
 /* Goes through each packet in the queue, repeats it getRepeat() times, and discards it */
-bool DCCEmergencyQueue::readPacket(DCCPacket *packet)
+void DCCEmergencyQueue::releasePacket(void)
 {
   if(!isEmpty()) //anything in the queue?
   {
-    queue[read_pos].setRepeat(queue[read_pos].getRepeat()-1); //decrement the current packet's repeat count
-    if(queue[read_pos].getRepeat()) //if the topmost packet needs repeating
-    {
-      memcpy(packet,&queue[read_pos],sizeof(DCCPacket));
-      return true;
-    }
-    else //the topmost packet is ready to be discarded; use the DCCPacketQueue mechanism
-    {
-      return(DCCPacketQueue::readPacket(packet));
-    }
+    DCCPacket *top = peekPacket();
+    if(top->getRepeat() > 1) //if the topmost packet needs repeating
+      top->setRepeat(top->getRepeat()-1); //decrement the current packet's repeat count
+    else //the topmost packet is ready to be discarded
+      pop();
   }
-  return false;
 }
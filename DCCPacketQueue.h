@@ -4,34 +4,66 @@
 #include "Arduino.h"
 
 /**
- * A FIFO queue for holding DCC packets, implemented as a circular buffer.
+ * FIFO queues for holding DCC packets, all drawing their slots from one shared DCCPacketPool.
+ * Each queue is an intrusive singly-linked list of slot indices. A queue is guaranteed its
+ * reservation; beyond that it may borrow from the shared remainder of the pool, as long as
+ * enough slots stay free to honour every other queue's unfilled reservation. A burst on one
+ * queue can thus soak up slots the others are not using, without starving them.
  * Copyright 2010 D.E. Goodman-Wilson
- * TODO
 **/
 
 #include "DCCPacket.h"
+#include "DCCFairShare.h"
 
-class DCCPacketQueue
+#define DCC_POOL_END 0xFF //list terminator; pools hold at most 254 slots
+#define DCC_ANY_KIND 0xFF //for forget(): packets of every kind
+
+class DCCPacketPool
 {
   public: //protected:
-    DCCPacket *queue;
-    byte read_pos;
-    byte write_pos;
+    DCCPacket *slots;
+    byte *next; //next[i] is the slot after slot i in whichever list it belongs to
+    byte free_head;
     byte size;
-    byte written; //how many cells have valid data? used for determining full status.  
+    byte free_count;
+    byte unmet; //slots that must stay free to cover the queues' unfilled reservations
+    byte high_water; //most slots ever in use at once
   public:
-    DCCPacketQueue(void);
+    DCCPacketPool(void);
     
-    virtual void setup(byte);
+    void setup(byte);
     
-    ~DCCPacketQueue(void)
+    ~DCCPacketPool(void)
     {
-      free(queue);
+      free(slots);
+      free(next);
     }
     
+    byte allocate(void); //returns DCC_POOL_END if none are free
+    void release(byte slot);
+    
+    inline byte getHighWater(void) { return high_water; }
+    inline byte getFreeCount(void) { return free_count; }
+};
+
+class DCCPacketQueue
+{
+  public: //protected:
+    DCCPacketPool *pool;
+    byte head;
+    byte tail;
+    byte reserve; //slots this queue is guaranteed
+    byte written; //how many slots does this queue hold?
+    byte reserved; //slot handed out by reservePacket() and awaiting commitPacket(), or DCC_POOL_END
+  public:
+    DCCPacketQueue(void);
+    
+    virtual void setup(DCCPacketPool *, byte);
+    
     virtual inline bool isFull(void)
     {
-      return (written == size);
+      //below its reservation a queue can always grow; above it, only while the pool can spare a slot
+      return (written >= reserve) && (pool->free_count <= pool->unmet);
     }
     virtual inline bool isEmpty(void)
     {
@@ -44,16 +76,47 @@ class DCCPacketQueue
     
     virtual inline bool notRepeat(unsigned int address)
     {
-      return (address != queue[read_pos].getAddress());
+      return (head == DCC_POOL_END) || (address != pool->slots[head].getAddress());
     }
     
+#if DCC_FAIR_ADDRESSES
+    //Fair dequeue: bring to the head the first packet for whichever queued address the share says has waited
+    //longest, skipping packets for last_address. Returns false if there is no such packet.
+    bool selectFair(DCCFairShare *share, uint16_t last_address);
+    //is a packet for some address other than last_address queued? What selectFair() would return, without the search
+    bool holdsOther(uint16_t last_address);
+#endif
+    
     //void printQueue(void);
     
-    virtual bool insertPacket(DCCPacket *packet); //makes a local copy, does not take over memory management!
-    virtual bool readPacket(DCCPacket *packet); //does not hand off memory management of packet. used immediately.
+    //Zero-copy enqueue: reservePacket() returns the slot to build the packet in, already set to address and kind,
+    //or NULL if the queue is full. If a packet with the same address and kind is already queued, that slot is
+    //returned to be overwritten in place. Build the packet, then commitPacket() before the next read.
+    DCCPacket *reservePacket(uint16_t address, uint8_t address_kind, uint8_t kind);
+    bool commitPacket(void);
+    //Zero-copy dequeue: peekPacket() returns the packet to send next, or NULL; once it has been encoded,
+    //releasePacket() disposes of it as the queue requires (discards it, or repeats it).
+    inline DCCPacket *peekPacket(void) { return (head == DCC_POOL_END) ? 0 : &pool->slots[head]; }
+    virtual void releasePacket(void);
+    //move the head packet to the tail of another queue without copying it; returns false if it had to be dropped
+    bool transferPacket(DCCPacketQueue *destination);
     
-    bool forget(uint16_t address, uint8_t address_kind);
+    bool insertPacket(DCCPacket *packet); //makes a local copy, does not take over memory management!
+    bool readPacket(DCCPacket *packet); //does not hand off memory management of packet. used immediately.
+    
+    bool holds(uint16_t address, uint8_t kind); //is a packet with this address and kind queued?
+    bool forget(uint16_t address, uint8_t address_kind, uint8_t kind = DCC_ANY_KIND);
+    bool forgetKind(uint8_t kind); //drop every packet of this kind, whatever its address
     void clear(void);
+    
+  protected:
+    byte take(void); //allocate a slot from the pool against this queue
+    void give(byte slot); //return a slot that has already been unlinked
+    void disclaim(void); //drop this queue's claim on a slot, without releasing it
+    byte unlink(void); //unlink the head slot, without releasing it
+    bool adopt(byte slot); //link an already-allocated slot at the tail, or release it if there is no room
+    void append(byte slot);
+    void pop(void); //unlink and release the head slot
 };
 
 //A queue that, when a packet is read, puts that packet back in the queue if it requires repeating.
@@ -61,9 +124,8 @@ class DCCRepeatQueue: public DCCPacketQueue
 {
   public:
     DCCRepeatQueue(void);
-    //void setup(byte length);
     bool insertPacket(DCCPacket *packet);
-    bool readPacket(DCCPacket *packet);
+    void releasePacket(void);
 };
 
 //A queue that repeats the topmost packet as many times as is indicated by the packet before moving on
@@ -71,7 +133,7 @@ class DCCEmergencyQueue: public DCCPacketQueue
 {
   public:
     DCCEmergencyQueue(void);
-    bool readPacket(DCCPacket *packet);
+    void releasePacket(void);
 };
 
 #endif //__DCCPACKETQUEUE_H__
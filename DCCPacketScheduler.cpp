@@ -1,5 +1,13 @@
 #include "DCCPacketScheduler.h"
 #include "DCCHardware.h"
+#include "DCCOvercurrent.h"
+
+//the scheduler and its packet pool (a slot plus its link byte each) must fit the profile's RAM budget; see DCCConfig.h
+#define DCC_POOL_RAM (PACKET_POOL_SIZE * (sizeof(DCCPacket) + 1))
+static_assert(DCC_POOL_RAM <= DCC_RAM_BUDGET, "PACKET_POOL_SIZE alone exceeds DCC_RAM_BUDGET");
+#if defined(__AVR__) //object sizes are only meaningful on the target, where pointers are 2 bytes
+static_assert(sizeof(DCCPacketScheduler) + DCC_POOL_RAM <= DCC_RAM_BUDGET, "DCCPacketScheduler exceeds DCC_RAM_BUDGET; shrink PACKET_POOL_SIZE or DCC_ROSTER_SIZE");
+#endif
 
 /*
  * DCC Waveform Generator
@@ -29,29 +37,23 @@
  *  
  */
 
-/// The currently queued packet to be put on the rails. Default is a reset packet.
-extern uint8_t current_packet[6];
-/// How many data uint8_ts in the queued packet?
-extern volatile uint8_t current_packet_size;
-/// How many uint8_ts remain to be put on the rails?
-extern volatile uint8_t current_uint8_t_counter;
-/// How many bits remain in the current data uint8_t/preamble before changing states?
-extern volatile uint8_t current_bit_counter; //init to 14 1's for the preamble
-/// A fixed-content packet to send when idle
-//uint8_t DCC_Idle_Packet[3] = {255,0,255};
-/// A fixed-content packet to send to reset all decoders on layout
-//uint8_t DCC_Reset_Packet[3] = {0,0,0};
-
 ///////////////////////////////////////////////
 ///////////////////////////////////////////////
 ///////////////////////////////////////////////
   
-DCCPacketScheduler::DCCPacketScheduler(void) : default_speed_steps(128), last_packet_address(255), packet_counter(1)
+DCCPacketScheduler::DCCPacketScheduler(void) : default_speed_steps(128), last_packet_address(255), packet_counter(1),
+    overcurrent_retry_interval(0), overcurrent_max_retries(0), overcurrent_retries(0), overcurrent_paused(false), overcurrent_time(0)
 {
-  e_stop_queue.setup(E_STOP_QUEUE_SIZE);
-  high_priority_queue.setup(HIGH_PRIORITY_QUEUE_SIZE);
-  low_priority_queue.setup(LOW_PRIORITY_QUEUE_SIZE);
-  repeat_queue.setup(REPEAT_QUEUE_SIZE);
+  packet_pool.setup(PACKET_POOL_SIZE);
+  e_stop_queue.setup(&packet_pool, E_STOP_QUEUE_RESERVE);
+  high_priority_queue.setup(&packet_pool, HIGH_PRIORITY_QUEUE_RESERVE);
+  low_priority_queue.setup(&packet_pool, LOW_PRIORITY_QUEUE_RESERVE);
+  repeat_queue.setup(&packet_pool, REPEAT_QUEUE_RESERVE);
+#if DCC_ESTOP_SNAPSHOT
+  frozen_queue.setup(&packet_pool, 0); //only ever borrows what the other queues can spare
+  suspended = false;
+#endif
+  cancelGroups(0);
   //periodic_refresh_queue.setup(PERIODIC_REFRESH_QUEUE_SIZE);
 }
     
@@ -61,6 +63,13 @@ void DCCPacketScheduler::setDefaultSpeedSteps(uint8_t new_speed_steps)
   default_speed_steps = new_speed_steps;
 }
     
+void DCCPacketScheduler::setOvercurrentRetry(uint16_t interval, uint8_t max_retries)
+{
+  overcurrent_retry_interval = interval;
+  overcurrent_max_retries = max_retries;
+  overcurrent_retries = 0;
+}
+    
 void DCCPacketScheduler::setup(void) //for any post-constructor initialization
 {
   setup_DCC_waveform_generator();
@@ -90,15 +99,26 @@ void DCCPacketScheduler::setup(void) //for any post-constructor initialization
   p.setKind(idle_packet_kind);
   e_stop_queue.insertPacket(&p); //e_stop_queue will be empty, so no need to check if insertion was OK.
   
+#if DCC_ROSTER_SIZE
+  //after a reset, pick up where we left off; update() resends the restored locos once the reset sequence is out
+  roster.restore();
+#endif
 }
 
 //helper functions
-void DCCPacketScheduler::repeatPacket(DCCPacket *p)
+void DCCPacketScheduler::repeatPacket(DCCPacketQueue *from) //move the packet just sent from the head of from into the appropriate repeat queue
 {
+  DCCPacket *p = from->peekPacket();
+  if(!p->getRepeat())
+  {
+    from->releasePacket();
+    return;
+  }
   switch(p->getKind())
   {
     case idle_packet_kind:
     case e_stop_packet_kind: //e_stop packets automatically repeat without having to be put in a special queue
+      from->releasePacket();
       break;
     case speed_packet_kind: //speed packets go to the periodic_refresh queue
     //  periodic_refresh_queue.insertPacket(p);
@@ -111,10 +131,55 @@ void DCCPacketScheduler::repeatPacket(DCCPacket *p)
     case ops_mode_programming_kind:
     case other_packet_kind:
     default:
-      repeat_queue.insertPacket(p);
+      from->transferPacket(&repeat_queue);
   }
 }
     
+#if DCC_ROSTER_SIZE
+void DCCPacketScheduler::resendRestored(void) //put one loco restored from EEPROM back on the rails, if there's room
+{
+  for(uint8_t i = 0; i < roster.getSize(); ++i)
+  {
+    DCCRosterEntry *e = roster.getEntry(i);
+    if(e && (e->flags & DCC_ROSTER_RESTORED))
+    {
+      //the roster already holds these values, so resending them costs no EEPROM writes
+      if(setSpeed(e->address, e->address_kind, e->speed, e->steps) &&
+         setFunctions(e->address, e->address_kind, e->functions))
+        e->flags &= ~DCC_ROSTER_RESTORED;
+      return;
+    }
+  }
+}
+#endif
+    
+bool DCCPacketScheduler::overcurrentHold(void)
+{
+  if(!DCC_overcurrent_tripped())
+  {
+    overcurrent_paused = false;
+    if(overcurrent_retries && (millis() - overcurrent_time > OVERCURRENT_RECOVERY_TIME))
+      overcurrent_retries = 0; //power has held since the last retry, so the fault is gone
+    return false;
+  }
+  
+  //the ISR has already cut the track. Leave the queues alone so that nothing is sent into a dead track;
+  //set*() calls still coalesce into them, so when power returns each loco gets its latest state once.
+  if(!overcurrent_paused)
+  {
+    overcurrent_paused = true;
+    overcurrent_time = millis();
+  }
+  else if((overcurrent_retries < overcurrent_max_retries) && (millis() - overcurrent_time >= overcurrent_retry_interval))
+  {
+    ++overcurrent_retries;
+    overcurrent_paused = false;
+    overcurrent_time = millis();
+    DCC_overcurrent_clear();
+  }
+  return true;
+}
+    
 //for enqueueing packets
 
 //setSpeed* functions:
@@ -132,19 +197,23 @@ bool DCCPacketScheduler::setSpeed(uint16_t address, uint8_t address_kind, int8_t
         
   switch(num_steps)
   {
+#if DCC_SPEED_14
     case 14:
       return(setSpeed14(address, address_kind, new_speed));
+#endif
+#if DCC_SPEED_28
     case 28:
       return(setSpeed28(address, address_kind, new_speed));
+#endif
     case 128:
       return(setSpeed128(address, address_kind, new_speed));
   }
   return false; //invalid number of steps specified.
 }
 
+#if DCC_SPEED_14
 bool DCCPacketScheduler::setSpeed14(uint16_t address, uint8_t address_kind, int8_t new_speed, bool F0)
 {
-  DCCPacket p(address, address_kind);
   uint8_t dir = 1;
   uint8_t speed_data_uint8_ts[] = {0x40};
   uint16_t abs_speed = new_speed;
@@ -162,20 +231,27 @@ bool DCCPacketScheduler::setSpeed14(uint16_t address, uint8_t address_kind, int8
     speed_data_uint8_ts[0] |= map(abs_speed, 2, 127, 2, 15); //convert from [2-127] to [1-14]
   speed_data_uint8_ts[0] |= (0x20*dir); //flip bit 3 to indicate direction;
   //Serial.println(speed_data_uint8_ts[0],BIN);
-  p.addData(speed_data_uint8_ts,1);
+  //speed packets go to the high proirity queue; build the packet right in its slot
+  DCCPacket *p = high_priority_queue.reservePacket(address, address_kind, speed_packet_kind);
+  if(!p)
+    return false;
+  p->addData(speed_data_uint8_ts,1);
 
-  p.setRepeat(SPEED_REPEAT);
+  p->setRepeat(SPEED_REPEAT);
   
-  p.setKind(speed_packet_kind);  
-
-  //speed packets get refreshed indefinitely, and so the repeat doesn't need to be set.
-  //speed packets go to the high proirity queue
-  return(high_priority_queue.insertPacket(&p));
+  if(!high_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setSpeed(address, address_kind, new_speed, 14);
+#endif
+  return true;
 }
 
+#endif //DCC_SPEED_14
+
+#if DCC_SPEED_28
 bool DCCPacketScheduler::setSpeed28(uint16_t address, uint8_t address_kind, int8_t new_speed)
 {
-  DCCPacket p(address, address_kind);
   uint8_t dir = 1;
   uint8_t speed_data_uint8_ts[] = {0x40};
   uint16_t abs_speed = new_speed;
@@ -199,24 +275,29 @@ bool DCCPacketScheduler::setSpeed28(uint16_t address, uint8_t address_kind, int8
   speed_data_uint8_ts[0] |= (0x20*dir); //flip bit 3 to indicate direction;
 //  Serial.println(speed_data_uint8_ts[0],BIN);
 //  Serial.println("=======");
-  p.addData(speed_data_uint8_ts,1);
+  //speed packets go to the high proirity queue; build the packet right in its slot
+  DCCPacket *p = high_priority_queue.reservePacket(address, address_kind, speed_packet_kind);
+  if(!p)
+    return false;
+  p->addData(speed_data_uint8_ts,1);
   
-  p.setRepeat(SPEED_REPEAT);
+  p->setRepeat(SPEED_REPEAT);
   
-  p.setKind(speed_packet_kind);
-    
-  //speed packets get refreshed indefinitely, and so the repeat doesn't need to be set.
-  //speed packets go to the high proirity queue
-  //return(high_priority_queue.insertPacket(&p));
-  return(high_priority_queue.insertPacket(&p));
+  if(!high_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setSpeed(address, address_kind, new_speed, 28);
+#endif
+  return true;
 }
 
+#endif //DCC_SPEED_28
+
 bool DCCPacketScheduler::setSpeed128(uint16_t address, uint8_t address_kind, int8_t new_speed)
 {
   //why do we get things like this?
   // 03 3F 16 15 3F (speed packet addressed to loco 03)
   // 03 3F 11 82 AF  (speed packet addressed to loco 03, speed hex 0x11);
-  DCCPacket p(address, address_kind);
   uint8_t dir = 1;
   uint16_t abs_speed = new_speed;
   uint8_t speed_data_uint8_ts[] = {0x3F,0x00};
@@ -233,18 +314,23 @@ bool DCCPacketScheduler::setSpeed128(uint16_t address, uint8_t address_kind, int
     speed_data_uint8_ts[1] = abs_speed; //no conversion necessary.
 
   speed_data_uint8_ts[1] |= (0x80*dir); //flip bit 7 to indicate direction;
-  p.addData(speed_data_uint8_ts,2);
+  //speed packets go to the high proirity queue; build the packet right in its slot
+  DCCPacket *p = high_priority_queue.reservePacket(address, address_kind, speed_packet_kind);
+  if(!p)
+    return false;
+  p->addData(speed_data_uint8_ts,2);
   //Serial.print(speed_data_uint8_ts[0],BIN);
   //Serial.print(" ");
   //Serial.println(speed_data_uint8_ts[1],BIN);
   
-  p.setRepeat(SPEED_REPEAT);
-  
-  p.setKind(speed_packet_kind);
+  p->setRepeat(SPEED_REPEAT);
   
-  //speed packets get refreshed indefinitely, and so the repeat doesn't need to be set.
-  //speed packets go to the high proirity queue
-  return(high_priority_queue.insertPacket(&p));
+  if(!high_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setSpeed(address, address_kind, new_speed, 128);
+#endif
+  return true;
 }
 
 bool DCCPacketScheduler::setFunctions(uint16_t address, uint8_t address_kind, uint16_t functions)
@@ -270,7 +356,6 @@ bool DCCPacketScheduler::setFunctions0to4(uint16_t address, uint8_t address_kind
 {
 //  Serial.println("setFunctions0to4");
 //  Serial.println(functions,HEX);
-  DCCPacket p(address, address_kind);
   uint8_t data[] = {0x80};
   
   //Obnoxiously, the headlights (F0, AKA FL) are not controlled
@@ -281,10 +366,17 @@ bool DCCPacketScheduler::setFunctions0to4(uint16_t address, uint8_t address_kind
   //get functions 0
   data[0] |= (functions&0x01) << 4;
 
-  p.addData(data,1);
-  p.setKind(function_packet_1_kind);
-  p.setRepeat(FUNCTION_REPEAT);
-  return low_priority_queue.insertPacket(&p);
+  DCCPacket *p = low_priority_queue.reservePacket(address, address_kind, function_packet_1_kind);
+  if(!p)
+    return false;
+  p->addData(data,1);
+  p->setRepeat(FUNCTION_REPEAT);
+  if(!low_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setFunctions(address, address_kind, functions & 0x1F, 0x1F);
+#endif
+  return true;
 }
 
 
@@ -292,31 +384,43 @@ bool DCCPacketScheduler::setFunctions5to8(uint16_t address, uint8_t address_kind
 {
 //  Serial.println("setFunctions5to8");
 //  Serial.println(functions,HEX);
-  DCCPacket p(address, address_kind);
   uint8_t data[] = {0xB0};
   
   data[0] |= functions & 0x0F;
   
-  p.addData(data,1);
-  p.setKind(function_packet_2_kind);
-  p.setRepeat(FUNCTION_REPEAT);
-  return low_priority_queue.insertPacket(&p);
+  DCCPacket *p = low_priority_queue.reservePacket(address, address_kind, function_packet_2_kind);
+  if(!p)
+    return false;
+  p->addData(data,1);
+  p->setRepeat(FUNCTION_REPEAT);
+  if(!low_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setFunctions(address, address_kind, (functions & 0x0F) << 5, 0x1E0);
+#endif
+  return true;
 }
 
 bool DCCPacketScheduler::setFunctions9to12(uint16_t address, uint8_t address_kind, uint8_t functions)
 {
 //  Serial.println("setFunctions9to12");
 //  Serial.println(functions,HEX);
-  DCCPacket p(address, address_kind);
   uint8_t data[] = {0xA0};
   
   //least significant four functions (F5--F8)
   data[0] |= functions & 0x0F;
   
-  p.addData(data,1);
-  p.setKind(function_packet_3_kind);
-  p.setRepeat(FUNCTION_REPEAT);
-  return low_priority_queue.insertPacket(&p);
+  DCCPacket *p = low_priority_queue.reservePacket(address, address_kind, function_packet_3_kind);
+  if(!p)
+    return false;
+  p->addData(data,1);
+  p->setRepeat(FUNCTION_REPEAT);
+  if(!low_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.setFunctions(address, address_kind, (functions & 0x0F) << 9, 0x1E00);
+#endif
+  return true;
 }
 
 
@@ -325,6 +429,7 @@ bool DCCPacketScheduler::setFunctions9to12(uint16_t address, uint8_t address_kin
 //bool DCCPacketScheduler::setTurnout(uint16_t address)
 //bool DCCPacketScheduler::unsetTurnout(uint16_t address)
 
+#if DCC_OPS_PROGRAMMING
 bool DCCPacketScheduler::opsProgramCV(uint16_t address, uint8_t address_kind, uint16_t CV, uint8_t CV_data)
 {
   //format of packet:
@@ -333,7 +438,6 @@ bool DCCPacketScheduler::opsProgramCV(uint16_t address, uint8_t address_kind, ui
   // {preamble} 0 [ AAAAAAAA ] 0 111010VV 0 VVVVVVVV 0 DDDDDDDD 0 EEEEEEEE 1 (bit manipulation)
   // only concerned with "write" form here.
   
-  DCCPacket p(address, address_kind);
   uint8_t data[] = {0xEC, 0x00, 0x00};
   
   // split the CV address up among data uint8_ts 0 and 1
@@ -341,12 +445,34 @@ bool DCCPacketScheduler::opsProgramCV(uint16_t address, uint8_t address_kind, ui
   data[1] = (CV-1) & 0xFF;
   data[2] = CV_data;
   
-  p.addData(data,3);
-  p.setKind(ops_mode_programming_kind);
-  p.setRepeat(OPS_MODE_PROGRAMMING_REPEAT);
+  DCCPacket *p = low_priority_queue.reservePacket(address, address_kind, ops_mode_programming_kind);
+  if(!p)
+    return false;
+  p->addData(data,3);
+  p->setRepeat(OPS_MODE_PROGRAMMING_REPEAT);
   
-  return low_priority_queue.insertPacket(&p);
+  return low_priority_queue.commitPacket();
 }
+
+bool DCCPacketScheduler::opsReadCV(uint16_t address, uint8_t address_kind, uint16_t CV)
+{
+  // {preamble} 0 [ AAAAAAAA ] 0 111001VV 0 VVVVVVVV 0 DDDDDDDD 0 EEEEEEEE 1 (verify)
+  // the data byte is ignored by a RailCom decoder, which answers with the CV's actual value
+  uint8_t data[] = {0xE4, 0x00, 0x00};
+  
+  data[0] |= ((CV-1) & 0x3FF) >> 8;
+  data[1] = (CV-1) & 0xFF;
+  
+  DCCPacket *p = low_priority_queue.reservePacket(address, address_kind, ops_mode_programming_kind);
+  if(!p)
+    return false;
+  p->addData(data,3);
+  p->setRepeat(OPS_MODE_PROGRAMMING_REPEAT);
+  
+  return low_priority_queue.commitPacket();
+}
+#endif //DCC_OPS_PROGRAMMING
+
     
 //more specific functions
 
@@ -354,17 +480,31 @@ bool DCCPacketScheduler::opsProgramCV(uint16_t address, uint8_t address_kind, ui
 bool DCCPacketScheduler::eStop(void)
 {
     // 111111111111 0 00000000 0 01DC0001 0 EEEEEEEE 1
-    DCCPacket e_stop_packet(0); //address 0
     uint8_t data[] = {0x71}; //01110001
-    e_stop_packet.addData(data,1);
-    e_stop_packet.setKind(e_stop_packet_kind);
-    e_stop_packet.setRepeat(10);
-    e_stop_queue.insertPacket(&e_stop_packet);
-    //now, clear all other queues
+    //first, clear all other queues, which makes room for the e-stop in a full pool. Single-loco e-stops still
+    //waiting are covered by this one, and give up their slots too.
     high_priority_queue.clear();
     low_priority_queue.clear();
     repeat_queue.clear();
-    return true;
+    e_stop_queue.forgetKind(e_stop_packet_kind);
+    cancelGroups(0);
+#if DCC_ROSTER_SIZE
+    roster.stopAll();
+#endif
+    DCCPacket *e_stop_packet = e_stop_queue.reservePacket(0, DCC_SHORT_ADDRESS, e_stop_packet_kind); //address 0
+#if DCC_ESTOP_SNAPSHOT
+    //the packets suspend() set aside may hold the last spare slot; the e-stop matters more than the oldest of them
+    while(!e_stop_packet && frozen_queue.notEmpty())
+    {
+      frozen_queue.releasePacket();
+      e_stop_packet = e_stop_queue.reservePacket(0, DCC_SHORT_ADDRESS, e_stop_packet_kind);
+    }
+#endif
+    if(!e_stop_packet)
+      return false;
+    e_stop_packet->addData(data,1);
+    e_stop_packet->setRepeat(10);
+    return e_stop_queue.commitPacket();
 }
     
 bool DCCPacketScheduler::eStop(uint16_t address, uint8_t address_kind)
@@ -372,51 +512,409 @@ bool DCCPacketScheduler::eStop(uint16_t address, uint8_t address_kind)
     // 111111111111 0	0AAAAAAA 0 01001001 0 EEEEEEEE 1
     // or
     // 111111111111 0	0AAAAAAA 0 01000001 0 EEEEEEEE 1
-    DCCPacket e_stop_packet(address, address_kind);
     uint8_t data[] = {0x41}; //01000001
-    e_stop_packet.addData(data,1);
-    e_stop_packet.setKind(e_stop_packet_kind);
-    e_stop_packet.setRepeat(10);
-    e_stop_queue.insertPacket(&e_stop_packet);
-    //now, clear this packet's address from all other queues
-    high_priority_queue.forget(address, address_kind);
-    low_priority_queue.forget(address, address_kind);
-    repeat_queue.forget(address, address_kind);
+    //first, clear this loco's speed packets from all other queues, lest one set it going again, and make room.
+    //Its functions and POM packets don't move it, and stay.
+    high_priority_queue.forget(address, address_kind, speed_packet_kind);
+    repeat_queue.forget(address, address_kind, speed_packet_kind);
+#if DCC_ROSTER_SIZE
+    DCCRosterEntry *e = roster.find(address, address_kind);
+    if(e)
+      roster.stop(e);
+#endif
+    DCCPacket *e_stop_packet = e_stop_queue.reservePacket(address, address_kind, e_stop_packet_kind);
+    if(!e_stop_packet)
+      return false;
+    e_stop_packet->addData(data,1);
+    e_stop_packet->setRepeat(10);
+    return e_stop_queue.commitPacket();
 }
 
-bool DCCPacketScheduler::setBasicAccessory(uint16_t address, uint8_t function)
+#if DCC_ESTOP_SNAPSHOT
+bool DCCPacketScheduler::suspend(void)
+{
+  if(suspended) //keep the first snapshot; the work queued since is stale after a second e-stop
+  {
+    eStop();
+    return false;
+  }
+  //set the queues aside, in the order they would have been sent. Slots move between lists; nothing is copied
+  while(low_priority_queue.notEmpty()) //no speed packets in here
+  {
+    if(!freezable(low_priority_queue.peekPacket()))
+      low_priority_queue.releasePacket();
+    else
+      low_priority_queue.transferPacket(&frozen_queue);
+  }
+  repeat_queue.forgetKind(speed_packet_kind);
+  while(repeat_queue.notEmpty())
+  {
+    DCCPacket *p = repeat_queue.peekPacket();
+    //a newer one may be waiting in low priority
+    if(!freezable(p) || frozen_queue.holds(p->getAddress(), p->getKind()))
+      repeat_queue.DCCPacketQueue::releasePacket(); //discard, rather than go round again
+    else
+      repeat_queue.transferPacket(&frozen_queue);
+  }
+#if DCC_ROSTER_SIZE
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    DCCRosterEntry *e = roster.getEntry(i);
+    frozen_address[i] = e ? e->address : 0;
+    frozen_speed[i] = e ? e->speed : 0;
+  }
+#endif
+  suspended = true;
+  return eStop();
+}
+
+bool DCCPacketScheduler::freezable(DCCPacket *p)
+{
+#if DCC_PULSE_TIMERS
+  //a pulse's "on" sent after the pulser had finished with it would leave the coil on; the pulser resends its own
+  if((p->getKind() == basic_accessory_packet_kind) && pulser.inFlight(p->getAddress()))
+    return false;
+#endif
+  return p->getKind() != speed_packet_kind;
+}
+
+bool DCCPacketScheduler::resume(bool restart)
+{
+  if(!suspended)
+    return false;
+  suspended = false;
+  bool complete = true;
+#if DCC_ROSTER_SIZE
+  //speeds first: they go to the high priority queue, and out ahead of everything below
+  for(uint8_t i = 0; restart && (i < DCC_ROSTER_SIZE); ++i)
+  {
+    DCCRosterEntry *e = roster.getEntry(i);
+    //skip a loco that has left the roster since, or been given a speed of its own
+    if(!e || !frozen_speed[i] || (e->address != frozen_address[i]) || ((e->speed != 1) && (e->speed != -1)))
+      continue;
+    if(!setSpeed(e->address, e->address_kind, frozen_speed[i], e->steps))
+      complete = false;
+  }
+#else
+  (void)restart;
+#endif
+  //the rest go back to low priority, repeats included: one extra copy of a packet does no harm, and they keep their order
+  while(frozen_queue.notEmpty())
+  {
+    DCCPacket *p = frozen_queue.peekPacket();
+    if(low_priority_queue.holds(p->getAddress(), p->getKind()) || repeat_queue.holds(p->getAddress(), p->getKind()))
+      frozen_queue.releasePacket(); //overtaken by a newer one still queued
+    else if(!frozen_queue.transferPacket(&low_priority_queue))
+      complete = false;
+  }
+  return complete;
+}
+#endif
+
+//group commands
+
+bool DCCPacketScheduler::stopAll(void)
 {
-    DCCPacket p(address);
+  // {preamble} 0 00000000 0 01DC000S 0 EEEEEEEE 1 (broadcast stop)
+  // C = 1: decoders may ignore D, so each loco stops facing the way it was going
+  uint8_t data[] = {0x70}; //01110000
+  //a speed packet still queued for a single loco would set it going again
+  high_priority_queue.forgetKind(speed_packet_kind);
+  repeat_queue.forgetKind(speed_packet_kind);
+  cancelGroups(speed_packet_kind);
+  DCCPacket *p = high_priority_queue.reservePacket(0, DCC_SHORT_ADDRESS, speed_packet_kind);
+  if(!p)
+    return false;
+  p->addData(data,1);
+  p->setRepeat(SPEED_REPEAT);
+  if(!high_priority_queue.commitPacket())
+    return false;
+#if DCC_ROSTER_SIZE
+  roster.stopAll();
+#endif
+  return true;
+}
 
-	  uint8_t data[] = { 0x01 | ((function & 0x03) << 1) };
-	  p.addData(data, 1);
-	  p.setKind(basic_accessory_packet_kind);
-	  p.setRepeat(OTHER_REPEAT);
+bool DCCPacketScheduler::setSpeedGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, int8_t new_speed, uint8_t steps)
+{
+  if(addresses == DCC_GROUP_ALL) //the same speed for every loco is always a broadcast
+  {
+    if(!new_speed)
+      return eStop();
+    if((new_speed == 1) || (new_speed == -1))
+      return stopAll();
+    high_priority_queue.forgetKind(speed_packet_kind);
+    repeat_queue.forgetKind(speed_packet_kind);
+    cancelGroups(speed_packet_kind);
+    if(!setSpeed(0, DCC_SHORT_ADDRESS, new_speed, steps))
+      return false;
+#if DCC_ROSTER_SIZE
+    for(uint8_t i = 0; i < roster.getSize(); ++i)
+    {
+      DCCRosterEntry *e = roster.getEntry(i);
+      if(e)
+        roster.setSpeed(e->address, e->address_kind, new_speed, steps);
+    }
+#endif
+    return true;
+  }
+#if DCC_GROUP_COMMANDS
+  DCCGroupCommand *g = newGroup(addresses, count, address_kind, speed_packet_kind);
+  if(!g)
+    return false;
+  g->speed = new_speed;
+  g->steps = steps;
+  expandGroups();
+  return true;
+#else
+  return false;
+#endif
+}
 
-	  return low_priority_queue.insertPacket(&p);
+bool DCCPacketScheduler::setFunctionsGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, uint16_t functions, uint16_t mask)
+{
+  mask &= 0x1FFF;
+  functions &= mask;
+  if(addresses == DCC_GROUP_ALL)
+  {
+    //only a whole function group can be broadcast: a broadcast sets every function in the group on every decoder,
+    //and the roster cannot speak for decoders it has never seen. The rest goes to each loco in the roster in turn
+    static const uint16_t group_masks[] = {0x001F, 0x01E0, 0x1E00};
+    static const uint8_t group_kinds[] = {function_packet_1_kind, function_packet_2_kind, function_packet_3_kind};
+    uint16_t unsent = 0;
+    for(uint8_t i = 0; i < 3; ++i)
+    {
+      if((mask & group_masks[i]) && ((mask & group_masks[i]) != group_masks[i]))
+        unsent |= mask & group_masks[i];
+    }
+#if !DCC_ROSTER_SIZE || !DCC_GROUP_COMMANDS
+    if(unsent)
+      return false; //no roster to expand over, so no way to leave the other functions alone
+#endif
+    for(uint8_t i = 0; i < 3; ++i)
+    {
+      uint16_t group = group_masks[i];
+      if((mask & group) != group)
+        continue;
+      uint16_t bits = functions & group;
+      //function packets still queued for single locos carry what this one replaces
+      low_priority_queue.forgetKind(group_kinds[i]);
+      repeat_queue.forgetKind(group_kinds[i]);
+      cancelGroups(function_packet_1_kind, group);
+      bool ok;
+      if(i == 0)
+        ok = setFunctions0to4(0, DCC_SHORT_ADDRESS, bits);
+      else if(i == 1)
+        ok = setFunctions5to8(0, DCC_SHORT_ADDRESS, bits >> 5);
+      else
+        ok = setFunctions9to12(0, DCC_SHORT_ADDRESS, bits >> 9);
+      if(!ok)
+        return false;
+#if DCC_ROSTER_SIZE
+      for(uint8_t j = 0; j < roster.getSize(); ++j)
+      {
+        DCCRosterEntry *e = roster.getEntry(j);
+        if(e)
+          roster.setFunctions(e->address, e->address_kind, bits, group);
+      }
+#endif
+    }
+    if(!unsent)
+      return true;
+    mask = unsent;
+    functions &= mask;
+  }
+#if DCC_GROUP_COMMANDS
+  DCCGroupCommand *g = newGroup(addresses, count, address_kind, function_packet_1_kind);
+  if(!g)
+    return false;
+  g->functions = functions;
+  g->mask = mask;
+  expandGroups();
+  return true;
+#else
+  return false;
+#endif
+}
+
+void DCCPacketScheduler::cancelGroups(uint8_t kind, uint16_t mask) //kind 0: every group command
+{
+#if DCC_GROUP_COMMANDS
+  for(uint8_t i = 0; i < DCC_GROUP_COMMANDS; ++i)
+  {
+    DCCGroupCommand *g = &groups[i];
+    if(kind && (g->kind != kind))
+      continue;
+    if(kind == function_packet_1_kind)
+    {
+      g->mask &= ~mask; //the functions outside mask are still to be sent
+      g->functions &= g->mask;
+      if(g->mask)
+        continue;
+    }
+    g->kind = 0;
+  }
+#else
+  (void)kind;
+  (void)mask;
+#endif
+}
+
+void DCCPacketScheduler::expandGroups(void)
+{
+#if DCC_GROUP_COMMANDS
+  for(uint8_t i = 0; i < DCC_GROUP_COMMANDS; ++i)
+  {
+    DCCGroupCommand *g = &groups[i];
+    while(g->kind)
+    {
+      if(packet_pool.getFreeCount() <= packet_pool.unmet + GROUP_HEADROOM)
+        return; //leave the rest of the pool to other commands; update() carries on as slots free up
+      uint16_t address;
+      uint8_t address_kind;
+      if(g->addresses)
+      {
+        if(g->next >= g->count)
+        {
+          g->kind = 0; //done
+          break;
+        }
+        address = g->addresses[g->next];
+        address_kind = g->address_kind;
+      }
+      else
+      {
+#if DCC_ROSTER_SIZE
+        if(g->next >= roster.getSize())
+        {
+          g->kind = 0;
+          break;
+        }
+        DCCRosterEntry *e = roster.getEntry(g->next);
+        if(!e)
+        {
+          ++g->next;
+          continue;
+        }
+        address = e->address;
+        address_kind = e->address_kind;
+#else
+        g->kind = 0;
+        break;
+#endif
+      }
+      if(!sendGroup(g, address, address_kind))
+        return;
+      ++g->next;
+    }
+  }
+#endif
+}
+
+#if DCC_GROUP_COMMANDS
+DCCGroupCommand *DCCPacketScheduler::newGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, uint8_t kind)
+{
+  for(uint8_t i = 0; i < DCC_GROUP_COMMANDS; ++i)
+  {
+    DCCGroupCommand *g = &groups[i];
+    if(!g->kind)
+    {
+      g->addresses = addresses;
+      g->count = count;
+      g->next = 0;
+      g->address_kind = address_kind;
+      g->kind = kind;
+      return g;
+    }
+  }
+  return 0; //all busy; try again once one has expanded
+}
+
+bool DCCPacketScheduler::sendGroup(DCCGroupCommand *g, uint16_t address, uint8_t address_kind)
+{
+  if(g->kind == speed_packet_kind)
+    return setSpeed(address, address_kind, g->speed, g->steps);
+  uint16_t functions = g->functions;
+#if DCC_ROSTER_SIZE
+  DCCRosterEntry *e = roster.find(address, address_kind);
+  if(e)
+    functions |= e->functions & ~g->mask;
+#endif
+  //only the function groups the command touches; a group that fails is resent whole next time
+  if((g->mask & 0x001F) && !setFunctions0to4(address, address_kind, functions & 0x1F))
+    return false;
+  if((g->mask & 0x01E0) && !setFunctions5to8(address, address_kind, (functions >> 5) & 0x0F))
+    return false;
+  if((g->mask & 0x1E00) && !setFunctions9to12(address, address_kind, (functions >> 9) & 0x0F))
+    return false;
+  return true;
+}
+#endif //DCC_GROUP_COMMANDS
+
+#if DCC_ACCESSORIES
+bool DCCPacketScheduler::setBasicAccessory(uint16_t address, uint8_t function)
+{
+	  uint8_t data[] = { (uint8_t)(0x01 | ((function & 0x03) << 1)) };
+	  DCCPacket *p = low_priority_queue.reservePacket(address, DCC_SHORT_ADDRESS, basic_accessory_packet_kind);
+	  if(!p)
+	    return false;
+	  p->addData(data, 1);
+	  p->setRepeat(OTHER_REPEAT);
+
+	  return low_priority_queue.commitPacket();
 }
 
 bool DCCPacketScheduler::unsetBasicAccessory(uint16_t address, uint8_t function)
 {
-		DCCPacket p(address);
+		uint8_t data[] = { (uint8_t)((function & 0x03) << 1) };
+		//a repeat of the "on" still queued must not follow this "off", or the coil stays energised
+		repeat_queue.forget(address, DCC_SHORT_ADDRESS, basic_accessory_packet_kind);
+		DCCPacket *p = low_priority_queue.reservePacket(address, DCC_SHORT_ADDRESS, basic_accessory_packet_kind);
+		if(!p)
+		  return false;
+		p->addData(data, 1);
+		p->setRepeat(OTHER_REPEAT);
 
-		uint8_t data[] = { ((function & 0x03) << 1) };
-		p.addData(data, 1);
-		p.setKind(basic_accessory_packet_kind);
-		p.setRepeat(OTHER_REPEAT);
+	  return low_priority_queue.commitPacket();
+}
 
-	  return low_priority_queue.insertPacket(&p);
+#if DCC_PULSE_TIMERS
+bool DCCPacketScheduler::pulseAccessory(uint16_t address, uint8_t function, uint16_t duration_ms)
+{
+  if(!pulser.pulse(address, function, duration_ms))
+    return false;
+  pulser.update(*this, millis()); //the "on" goes out now, if the budget allows
+  return true;
 }
+#endif
+
+#endif //DCC_ACCESSORIES
 
 //to be called periodically within loop()
-void DCCPacketScheduler::update(void) //checks queues, puts whatever's pending on the rails via global current_packet. easy-peasy
+void DCCPacketScheduler::update(void) //checks queues, puts whatever's pending on the rails via the waveform HAL. easy-peasy
 {
   DCC_waveform_generation_hasshin();
 
+#if DCC_PULSE_TIMERS
+  //keeps time even while the track is tripped: the "off" commands coalesce into the queues like any other
+  pulser.update(*this, millis());
+#endif
+
+  if(overcurrentHold())
+    return;
+
+#if DCC_ROSTER_SIZE
+  roster.save();
+  if(e_stop_queue.isEmpty())
+    resendRestored();
+#endif
+  expandGroups();
+
   //TODO ADD POM QUEUE?
-  if(!current_uint8_t_counter) //if the ISR needs a packet:
+  if(DCC_waveform_ready()) //if the waveform generator needs a packet:
   {
-    DCCPacket p;
+    DCCPacketQueue *from = 0; //where the packet comes from; none means send an idle packet
+    uint8_t source = DCC_TRACE_IDLE;
     //Take from e_stop queue first, then high priority queue.
     //every fifth packet will come from low priority queue.
     //every 20th packet will come from periodic refresh queue. (Why 20? because. TODO reasoning)
@@ -425,15 +923,26 @@ void DCCPacketScheduler::update(void) //checks queues, puts whatever's pending o
     if( !e_stop_queue.isEmpty() ) //if there's an e_stop packet, send it now!
     {
       //e_stop
-      e_stop_queue.readPacket(&p); //nothing more to do. e_stop_queue is a repeat_queue, so automatically repeats where necessary.
+      from = &e_stop_queue; //nothing more to do. e_stop_queue automatically repeats where necessary.
+      source = DCC_TRACE_E_STOP;
     }
     else
     {
+#if DCC_FAIR_ADDRESSES
+      //a queue takes its turn if it holds some other address than the last; only the queue chosen is then searched
+      //for the address that has waited longest (below)
+      bool doHigh = high_priority_queue.notEmpty() && high_priority_queue.holdsOther(last_packet_address);
+      bool doLow = low_priority_queue.notEmpty() && low_priority_queue.holdsOther(last_packet_address) &&
+                  !((packet_counter % LOW_PRIORITY_INTERVAL) && doHigh);
+      bool doRepeat = repeat_queue.notEmpty() && repeat_queue.holdsOther(last_packet_address) &&
+                  !((packet_counter % REPEAT_INTERVAL) && (doHigh || doLow));
+#else
       bool doHigh = high_priority_queue.notEmpty() && high_priority_queue.notRepeat(last_packet_address);
       bool doLow = low_priority_queue.notEmpty() && low_priority_queue.notRepeat(last_packet_address) &&
                   !((packet_counter % LOW_PRIORITY_INTERVAL) && doHigh);
       bool doRepeat = repeat_queue.notEmpty() && repeat_queue.notRepeat(last_packet_address) &&
                   !((packet_counter % REPEAT_INTERVAL) && (doHigh || doLow));
+#endif
       //bool doRefresh = periodic_refresh_queue.notEmpty() && periodic_refresh_queue.notRepeat(last_packet_address) &&
       //            !((packet_counter % PERIODIC_REFRESH_INTERVAL) && (doHigh || doLow || doRepeat));
       //examine queues in order from lowest priority to highest.
@@ -446,29 +955,60 @@ void DCCPacketScheduler::update(void) //checks queues, puts whatever's pending o
       if(doRepeat)
       {
         //Serial.println("repeat");
-        repeat_queue.readPacket(&p);
+        from = &repeat_queue;
+        source = DCC_TRACE_REPEAT;
         ++packet_counter;
       }
       else if(doLow)
       {
         //Serial.println("low");
-        low_priority_queue.readPacket(&p);
+        from = &low_priority_queue;
+        source = DCC_TRACE_LOW;
         ++packet_counter;
       }
       else if(doHigh)
       {
         //Serial.println("high");
-        high_priority_queue.readPacket(&p);
+        from = &high_priority_queue;
+        source = DCC_TRACE_HIGH;
         ++packet_counter;
       }
+#if DCC_FAIR_ADDRESSES
+      //within the queue, serve the address that has waited longest rather than the oldest packet
+      if(from)
+        from->selectFair(&fair_share, last_packet_address);
+#endif
       //if none of these conditions hold, DCCPackets initialize to the idle packet, so that's what'll get sent.
       //++packet_counter; //it's a uint8_t; let it overflow, that's OK.
-      //enqueue the packet for repitition, if necessary:
-      //Serial.println("idle");
-      repeatPacket(&p);
     }
-    last_packet_address = p.getAddress(); //remember the address to compare with the next packet
-    current_packet_size = p.getBitstream(current_packet); //feed to the starving ISR.
+    //encode straight from the queue slot; no copy of the packet is made
+    DCCPacket idle;
+    DCCPacket *p = from ? from->peekPacket() : &idle;
+    last_packet_address = p->getAddress(); //remember the address to compare with the next packet
+#if DCC_ESTOP_SNAPSHOT
+    if(suspended && from) //anything set aside for the same address and kind has been overtaken
+      frozen_queue.forget(p->getAddress(), p->getAddressKind(), p->getKind());
+#endif
+#if DCC_FAIR_ADDRESSES
+    if(from)
+      fair_share.served(p->getAddress(), p->getAddressKind());
+#endif
+    uint8_t *current_packet = DCC_waveform_packet_buffer();
+    uint8_t current_packet_size = p->getBitstream(current_packet); //feed to the starving ISR.
+#if DCC_PULSE_TIMERS
+    if(p->getKind() == basic_accessory_packet_kind)
+      pulser.sent(p->getAddress(), current_packet[1] & 0x07); //1AAACDDD
+#endif
+#if DCC_TRACE_DEPTH
+    trace.record(source, p->getKind(), current_packet, current_packet_size);
+#else
+    (void)source;
+#endif
+    //now dispose of the slot: repeat it, move it to the repeat queue, or free it
+    if((from == &high_priority_queue) || (from == &low_priority_queue))
+      repeatPacket(from); //enqueue the packet for repitition, if necessary
+    else if(from)
+      from->releasePacket();
     //output the packet, for checking:
     //if(current_packet[0] != 0xFF) //if not idle
     //{
@@ -479,6 +1019,6 @@ void DCCPacketScheduler::update(void) //checks queues, puts whatever's pending o
     //  }
     //  Serial.println("");
     //}
-    current_uint8_t_counter = current_packet_size;
+    DCC_waveform_send_packet(current_packet_size);
   }
 }
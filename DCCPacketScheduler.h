@@ -1,13 +1,13 @@
 #ifndef __DCCCOMMANDSTATION_H__
 #define __DCCCOMMANDSTATION_H__
+#include "DCCConfig.h"
 #include "DCCPacket.h"
 #include "DCCPacketQueue.h"
+#include "DCCPacketTrace.h"
+#include "DCCRoster.h"
+#include "DCCTimerWheel.h"
 
 
-#define E_STOP_QUEUE_SIZE           2
-#define HIGH_PRIORITY_QUEUE_SIZE    10
-#define LOW_PRIORITY_QUEUE_SIZE     10
-#define REPEAT_QUEUE_SIZE           10
 //#define PERIODIC_REFRESH_QUEUE_SIZE 10
 
 #define LOW_PRIORITY_INTERVAL     5
@@ -20,6 +20,30 @@
 #define OPS_MODE_PROGRAMMING_REPEAT 3
 #define OTHER_REPEAT      2
 
+//pool slots a multicast group command leaves free for other commands while it expands
+#define GROUP_HEADROOM    2
+
+//after an overcurrent auto-retry, the track must stay up this long (ms) before the retry count starts over
+#define OVERCURRENT_RECOVERY_TIME 5000
+
+#define DCC_GROUP_ALL     0 //in place of an address list: every loco on the track
+
+#if DCC_GROUP_COMMANDS
+//a multicast group command, expanded lazily into one set*() per loco as pool slots free up
+struct DCCGroupCommand
+{
+  const uint16_t *addresses; //the caller's list, or DCC_GROUP_ALL for each loco in the roster
+  uint8_t count;
+  uint8_t next; //index of the next loco to expand
+  uint8_t address_kind;
+  uint8_t kind; //speed_packet_kind or function_packet_1_kind; 0 when not in use
+  int8_t speed;
+  uint8_t steps;
+  uint16_t functions;
+  uint16_t mask; //functions this command changes
+};
+#endif
+
 class DCCPacketScheduler
 {
   public:
@@ -28,12 +52,19 @@ class DCCPacketScheduler
     
     //for configuration
     void setDefaultSpeedSteps(uint8_t new_speed_steps);
-    void setup(void); //for any post-constructor initialization
+    void setup(void); //for any post-constructor initialization; call it before any set*(), as it reloads the roster
+    //after an overcurrent trip (see DCCOvercurrent.h), restore power every interval ms, up to max_retries times in a row.
+    //0 retries: stay off until the sketch calls DCC_overcurrent_clear().
+    void setOvercurrentRetry(uint16_t interval, uint8_t max_retries);
     
     //for enqueueing packets
     bool setSpeed(uint16_t address, uint8_t address_kind, int8_t new_speed, uint8_t steps = 0); //new_speed: [-127,127]
+#if DCC_SPEED_14
     bool setSpeed14(uint16_t address, uint8_t address_kind, int8_t new_speed, bool F0=true); //new_speed: [-13,13], and optionally F0 settings.
+#endif
+#if DCC_SPEED_28
     bool setSpeed28(uint16_t address, uint8_t address_kind, int8_t new_speed); //new_speed: [-28,28]
+#endif
     bool setSpeed128(uint16_t address, uint8_t address_kind, int8_t new_speed); //new_speed: [-127,127]
     
     //the function methods are NOT stateful; you must specify all functions each time you call one
@@ -45,14 +76,53 @@ class DCCPacketScheduler
     bool setFunctions9to12(uint16_t address, uint8_t address_kind, uint8_t functions);
     //other cool functions to follow. Just get these working first, I think.
     
+#if DCC_ACCESSORIES
     bool setBasicAccessory(uint16_t address, uint8_t function);
     bool unsetBasicAccessory(uint16_t address, uint8_t function);
+#endif
+#if DCC_PULSE_TIMERS
+    //on now, off again duration_ms later, for solenoids; false if DCC_PULSE_TIMERS pulses are already pending.
+    //Pulses start in order, no more at once than the current budget allows (see DCCTimerWheel.h).
+    bool pulseAccessory(uint16_t address, uint8_t function, uint16_t duration_ms);
+    inline void setAccessoryCurrentBudget(uint16_t budget_ma, uint16_t pulse_ma) { pulser.setCurrentBudget(budget_ma, pulse_ma); }
+#endif
     
+#if DCC_OPS_PROGRAMMING
     bool opsProgramCV(uint16_t address, uint8_t address_kind, uint16_t CV, uint8_t CV_data);
+    //verify-byte form, to which a RailCom decoder answers with the CV's value (see DCCRailCom.h)
+    bool opsReadCV(uint16_t address, uint8_t address_kind, uint16_t CV);
+#endif
 
+    //group commands: one call for many locos. addresses lists count locos, all of address_kind, and must stay valid
+    //until the command has been expanded; DCC_GROUP_ALL means every loco on the track. Commands to every loco go out
+    //as broadcast packets (address 0) where the NMRA semantics allow; the rest are held as a multicast group command
+    //that expands into per-loco packets as slots free up, without crowding out other commands.
+    bool setSpeedGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, int8_t new_speed, uint8_t steps = 0);
+    //only the functions in mask change; each loco keeps its other functions as the roster last saw them. To every loco,
+    //only function groups mask covers in full are broadcast; the rest go to each loco in the roster, and are rejected
+    //in builds without a roster or group commands
+    bool setFunctionsGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, uint16_t functions, uint16_t mask = 0x1FFF);
+    bool stopAll(void); //regular stop for every loco, each keeping its direction: a single broadcast packet
+    
     //more specific functions
-    bool eStop(void); //all locos
-    bool eStop(uint16_t address, uint8_t address_kind); //just one specific loco
+    bool eStop(void); //all locos. Every other queued packet is dropped, which makes room for it in a full pool
+    //just one specific loco. Only its speed packets are dropped; its function, POM and other packets stay queued,
+    //as they cannot set it going again. Returns false if the e-stop packet found no room.
+    bool eStop(uint16_t address, uint8_t address_kind);
+#if DCC_ESTOP_SNAPSHOT
+    //e-stop every loco, as eStop(), but set the queued accessory, function and POM packets and each loco's speed aside
+    //for resume() instead of discarding them. Speed packets are dropped. Packets the pool cannot hold on top of every
+    //queue's reservation are dropped too. Returns false if a snapshot is already held: the first is kept, and what was
+    //queued since is discarded. The e-stop goes out regardless. eStop() while suspended keeps the snapshot as well.
+    bool suspend(void);
+    //back to service after suspend(). The set-aside packets are requeued at low priority in their old order (those
+    //that were waiting, then those that were repeating), less any overtaken by a newer packet for the same address
+    //and kind, sent or still queued, in the meantime.
+    //With restart, every loco still stopped gets its old speed back, ahead of the rest. Returns false if nothing was
+    //suspended, or if some packets found no room.
+    bool resume(bool restart = false);
+    inline bool isSuspended(void) { return suspended; }
+#endif
     
     //to be called periodically within loop()
     void update(void); //checks queues, puts whatever's pending on the rails via global current_packet. easy-peasy
@@ -60,16 +130,59 @@ class DCCPacketScheduler
   //private:
   
   //  void stashAddress(DCCPacket *p); //remember the address to compare with the next packet
-    void repeatPacket(DCCPacket *p); //insert into the appropriate repeat queue
+    void repeatPacket(DCCPacketQueue *from); //move the head of from into the appropriate repeat queue
+    bool overcurrentHold(void); //true while the track is tripped and the queues must be left alone
+#if DCC_ESTOP_SNAPSHOT
+    bool freezable(DCCPacket *p); //can suspend() set p aside for resume()?
+#endif
+#if DCC_ROSTER_SIZE
+    void resendRestored(void);
+#endif
+    void expandGroups(void); //issue pending group commands to as many locos as there is room for
+    void cancelGroups(uint8_t kind, uint16_t mask = 0x1FFF); //drop pending group commands a broadcast has overtaken
+#if DCC_GROUP_COMMANDS
+    DCCGroupCommand *newGroup(const uint16_t *addresses, uint8_t count, uint8_t address_kind, uint8_t kind);
+    bool sendGroup(DCCGroupCommand *group, uint16_t address, uint8_t address_kind);
+#endif
     uint8_t default_speed_steps;
     uint16_t last_packet_address;
   
     uint8_t packet_counter;
     
+    uint16_t overcurrent_retry_interval;
+    uint8_t overcurrent_max_retries;
+    uint8_t overcurrent_retries; //consecutive retries so far
+    bool overcurrent_paused;
+    unsigned long overcurrent_time; //when we last saw the trip, or last retried
+    
+    DCCPacketPool packet_pool;
     DCCEmergencyQueue e_stop_queue;
     DCCPacketQueue high_priority_queue;
     DCCPacketQueue low_priority_queue;
     DCCRepeatQueue repeat_queue;
+#if DCC_TRACE_DEPTH
+    DCCPacketTrace trace; //the last DCC_TRACE_DEPTH packets put on the rails
+#endif
+#if DCC_FAIR_ADDRESSES
+    DCCFairShare fair_share; //which addresses have waited longest for the rails
+#endif
+#if DCC_GROUP_COMMANDS
+    DCCGroupCommand groups[DCC_GROUP_COMMANDS];
+#endif
+#if DCC_PULSE_TIMERS
+    DCCAccessoryPulser pulser; //accessory pulses pending or running
+#endif
+#if DCC_ROSTER_SIZE
+    DCCRoster roster; //last known state of each loco; persisted to EEPROM if DCC_ROSTER_PERSIST
+#endif
+#if DCC_ESTOP_SNAPSHOT
+    DCCPacketQueue frozen_queue; //set aside by suspend(): packets from low_priority_queue, then from repeat_queue
+    bool suspended;
+#if DCC_ROSTER_SIZE
+    uint16_t frozen_address[DCC_ROSTER_SIZE]; //each roster entry's loco and speed at suspend(); speed 0 for none
+    int8_t frozen_speed[DCC_ROSTER_SIZE];
+#endif
+#endif
     //DCCTemporalQueue periodic_refresh_queue;
     
     //TODO to be completed later.
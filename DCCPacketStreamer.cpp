@@ -0,0 +1,139 @@
+#include "DCCPacketStreamer.h"
+
+DCCPacketStreamer::DCCPacketStreamer(void) : head(0), count(0), expected(0), done(0), dropped(0), idles(0), received(0)
+{
+#if defined(ARDUINO)
+  last_status = 0;
+#endif
+}
+
+void DCCPacketStreamer::setup(void)
+{
+  setup_DCC_waveform_generator();
+  DCC_waveform_generation_hasshin();
+}
+
+bool DCCPacketStreamer::receive(uint8_t b)
+{
+  if(!received) //hunting for the start of a frame
+  {
+    if(b == DCC_STREAM_SYNC)
+      received = 1;
+    return false;
+  }
+
+  frame[received - 1] = b;
+  ++received;
+  if(received == 3 && (frame[1] & DCC_STREAM_SIZE_MASK) > DCC_MAX_PACKET_SIZE)
+  {
+    received = 0; //can't be a frame
+    return false;
+  }
+  //SYNC SEQ CTRL PACKET CHECK
+  if(received < 4 + (frame[1] & DCC_STREAM_SIZE_MASK))
+    return false;
+  received = 0;
+
+  uint8_t size = frame[1] & DCC_STREAM_SIZE_MASK;
+  uint8_t sum = 0;
+  uint8_t error = 0;
+  for(uint8_t i = 0; i < size + 2; ++i)
+    sum += frame[i];
+  for(uint8_t i = 0; i < size; ++i)
+    error ^= frame[2 + i];
+  if(sum != frame[size + 2])
+    return false;
+  if(!size) //sync
+  {
+    drop(count);
+    count = 0;
+    expected = frame[0];
+    done = expected;
+    return true;
+  }
+  if(size < 3 || error) //not a packet; counted as dropped once the next good frame shows the gap
+    return false;
+  accept();
+  return false;
+}
+
+void DCCPacketStreamer::accept(void)
+{
+  uint8_t gap = frame[0] - expected;
+  if(gap >= 128) //a duplicate
+    return;
+  drop(gap); //lost on the way
+  expected = frame[0] + 1;
+  if(frame[1] & DCC_STREAM_URGENT)
+  {
+    drop(count);
+    count = 0;
+  }
+  if(count == DCC_STREAM_DEPTH)
+  {
+    drop(1);
+    return;
+  }
+  uint8_t tail = (head + count) & (DCC_STREAM_DEPTH - 1);
+  sizes[tail] = frame[1] & DCC_STREAM_SIZE_MASK;
+  memcpy(packets[tail], frame + 2, sizes[tail]);
+  ++count;
+}
+
+void DCCPacketStreamer::drop(uint8_t frames)
+{
+  done += frames;
+  dropped += frames;
+}
+
+bool DCCPacketStreamer::feed(void)
+{
+  DCC_waveform_generation_hasshin();
+  if(!DCC_waveform_ready())
+    return false;
+  uint8_t *buffer = DCC_waveform_packet_buffer();
+  if(count)
+  {
+    uint8_t size = sizes[head];
+    memcpy(buffer, packets[head], size);
+    head = (head + 1) & (DCC_STREAM_DEPTH - 1);
+    --count;
+    ++done;
+    DCC_waveform_send_packet(size);
+  }
+  else
+  {
+    buffer[0] = 0xFF; //idle
+    buffer[1] = 0x00;
+    buffer[2] = 0xFF;
+    ++idles;
+    DCC_waveform_send_packet(3);
+  }
+  return true;
+}
+
+const uint8_t *DCCPacketStreamer::getStatus(void)
+{
+  status[0] = DCC_STREAM_STATUS;
+  status[1] = done;
+  status[2] = dropped;
+  status[3] = idles;
+  status[4] = DCC_STREAM_DEPTH;
+  status[5] = done + dropped + idles + DCC_STREAM_DEPTH;
+  return status;
+}
+
+#if defined(ARDUINO)
+void DCCPacketStreamer::update(Stream &port, uint8_t budget)
+{
+  bool due = false;
+  while(budget-- && port.available() > 0)
+    due |= receive(port.read());
+  due |= feed();
+  if(due || (millis() - last_status >= DCC_STREAM_STATUS_INTERVAL))
+  {
+    port.write(getStatus(), DCC_STREAM_STATUS_SIZE);
+    last_status = millis();
+  }
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef __DCCPACKETSTREAMER_H__
+#define __DCCPACKETSTREAMER_H__
+
+#include "Arduino.h"
+#include "DCCHardware.h"
+
+/**
+ * The "thin" half of a split command station. The board runs nothing but the waveform generator and
+ * DCCPacketStreamer: packets arrive over serial already encoded (by DCCStreamDaemon, running the full
+ * DCCPacketScheduler on a Linux host), wait in a ring of DCC_STREAM_DEPTH packets, and go to the waveform
+ * HAL in order as it becomes ready. An empty ring puts out idle packets, as the scheduler does.
+ * With no queues or roster on the board, the ring can be deep enough to ride out the host's scheduling
+ * hiccups, and the layout can be as large as the host's memory.
+ *
+ * Flow control is by credit: the host keeps no more frames outstanding than the board has room for.
+ * Every frame carries a sequence number, and every status the board sends carries the count of frames
+ * it is done with, so the host always knows how many are still outstanding. A frame lost on the link
+ * shows up as a gap in the sequence numbers; the board counts the missing frames as done (and dropped)
+ * at once, so the host gets their credit back without a timeout.
+ *
+ * Host to board:  SYNC(0x5A) SEQ CTRL PACKET[CTRL & 7] CHECK      CHECK = 8-bit sum of SEQ, CTRL and PACKET
+ *   CTRL bits 2-0: packet size, or 0 for a sync frame, which carries no packet: the board drops whatever it has
+ *                  buffered and takes SEQ as the next sequence number. A host sends one before anything else.
+ *   CTRL bit 7:    urgent; the buffered packets are dropped and this one is sent next (e-stop)
+ * A frame that fails its checks, or whose packet fails its own error byte, is ignored; one that finds the
+ * ring full is dropped. A sequence number from the last 128 frames is a duplicate and is ignored.
+ * Board to host:  STATUS(0x5B) DONE DROPPED IDLES DEPTH CHECK     CHECK = 8-bit sum of DONE, DROPPED, IDLES and DEPTH
+ *   DONE:    frames taken off the ring, for the waveform or dropped, wrapping at 256
+ *   DROPPED: frames lost on the link, failed their checks, or were flushed by an urgent frame, wrapping at 256
+ *   IDLES:   idle packets put out because the ring was empty, wrapping at 256
+ *   DEPTH:   DCC_STREAM_DEPTH, so the host knows its window
+ * The board sends a status as each packet goes to the waveform, and every DCC_STREAM_STATUS_INTERVAL ms
+ * regardless, so a host started late still finds it.
+**/
+
+#ifndef DCC_STREAM_DEPTH
+#define DCC_STREAM_DEPTH            64 //packets, 7 bytes each; a power of two, at most 128
+#endif
+#define DCC_STREAM_BUDGET           32 //bytes consumed per update() call, at most
+#define DCC_STREAM_STATUS_INTERVAL  100
+
+#define DCC_STREAM_SYNC             0x5A
+#define DCC_STREAM_STATUS           0x5B
+#define DCC_STREAM_URGENT           0x80
+#define DCC_STREAM_SIZE_MASK        0x07
+#define DCC_STREAM_FRAME_MAX        (4 + DCC_MAX_PACKET_SIZE)
+#define DCC_STREAM_STATUS_SIZE      6
+
+class DCCPacketStreamer
+{
+  public:
+    DCCPacketStreamer(void);
+
+    void setup(void); //sets up the waveform generator
+
+    //feed a single byte from the host; a complete, valid frame goes onto the ring.
+    //Returns true if a status is due (after a sync frame).
+    bool receive(uint8_t b);
+    //if the waveform generator can take a packet, give it the next one from the ring, or an idle packet.
+    //Returns true if a packet went out, and a status is due.
+    bool feed(void);
+    //the status frame, as it stands
+    const uint8_t *getStatus(void);
+
+    inline uint8_t getBuffered(void) { return count; }
+
+#if defined(ARDUINO)
+    //to be called as often as possible within loop(); never reads more than budget bytes, never waits for more
+    void update(Stream &port, uint8_t budget=DCC_STREAM_BUDGET);
+#endif
+
+  public: //protected:
+    void accept(void); //a complete frame is in frame[]
+    void drop(uint8_t frames); //count frames as done without sending them; emptying the ring is up to the caller
+
+    uint8_t packets[DCC_STREAM_DEPTH][DCC_MAX_PACKET_SIZE];
+    uint8_t sizes[DCC_STREAM_DEPTH];
+    uint8_t head; //next to send
+    uint8_t count;
+    uint8_t expected; //sequence number of the next frame
+    uint8_t done;
+    uint8_t dropped;
+    uint8_t idles;
+
+    uint8_t frame[DCC_STREAM_FRAME_MAX]; //the frame being received, from SEQ on
+    uint8_t received; //bytes of the current frame received so far, counting SYNC
+    uint8_t status[DCC_STREAM_STATUS_SIZE];
+#if defined(ARDUINO)
+    unsigned long last_status;
+#endif
+};
+
+#endif //__DCCPACKETSTREAMER_H__
@@ -0,0 +1,112 @@
+#include "DCCPacketTrace.h"
+
+#if DCC_TRACE_DEPTH
+
+DCCPacketTrace::DCCPacketTrace(void) : next(0), count(0)
+{
+}
+
+void DCCPacketTrace::record(uint8_t source, uint8_t kind, const uint8_t *bytes, uint8_t size)
+{
+  DCCTraceEntry *e = &entries[next];
+  e->timestamp = millis();
+  e->source = source;
+  e->kind = kind;
+  e->size = size;
+  memcpy(e->bytes, bytes, size);
+  if(++next == DCC_TRACE_DEPTH)
+    next = 0;
+  if(count < DCC_TRACE_DEPTH)
+    ++count;
+}
+
+void DCCPacketTrace::clear(void)
+{
+  next = 0;
+  count = 0;
+}
+
+uint16_t DCCPacketTrace::dump(uint8_t *buffer, uint16_t length)
+{
+  uint16_t pos = 0;
+  uint16_t now = millis();
+  if(length < 6)
+    return 0;
+  buffer[pos++] = 'D';
+  buffer[pos++] = 'T';
+  buffer[pos++] = DCC_TRACE_VERSION;
+  buffer[pos++] = count;
+  buffer[pos++] = now & 0xFF;
+  buffer[pos++] = now >> 8;
+  uint8_t i = (next + DCC_TRACE_DEPTH - count) % DCC_TRACE_DEPTH; //oldest entry
+  for(uint8_t n = 0; n < count; ++n)
+  {
+    DCCTraceEntry *e = &entries[i];
+    if(pos + 5 + e->size > length)
+      return 0;
+    buffer[pos++] = e->timestamp & 0xFF;
+    buffer[pos++] = e->timestamp >> 8;
+    buffer[pos++] = e->source;
+    buffer[pos++] = e->kind;
+    buffer[pos++] = e->size;
+    memcpy(buffer+pos, e->bytes, e->size);
+    pos += e->size;
+    i = (i+1) % DCC_TRACE_DEPTH;
+  }
+  return pos;
+}
+
+#if defined(ARDUINO)
+void DCCPacketTrace::dump(Print &out)
+{
+  uint8_t entry[5+6];
+  uint16_t now = millis();
+  out.write('D');
+  out.write('T');
+  out.write(DCC_TRACE_VERSION);
+  out.write(count);
+  out.write(now & 0xFF);
+  out.write(now >> 8);
+  uint8_t i = (next + DCC_TRACE_DEPTH - count) % DCC_TRACE_DEPTH; //oldest entry
+  for(uint8_t n = 0; n < count; ++n)
+  {
+    DCCTraceEntry *e = &entries[i];
+    entry[0] = e->timestamp & 0xFF;
+    entry[1] = e->timestamp >> 8;
+    entry[2] = e->source;
+    entry[3] = e->kind;
+    entry[4] = e->size;
+    memcpy(entry+5, e->bytes, e->size);
+    out.write(entry, 5 + e->size);
+    i = (i+1) % DCC_TRACE_DEPTH;
+  }
+}
+#endif
+
+#endif //DCC_TRACE_DEPTH
+
+#if !defined(ARDUINO)
+bool DCCPacketTrace::decode(const uint8_t *buffer, uint16_t length, FILE *out)
+{
+  static const char *sources[] = {"e-stop", "high", "low", "repeat", "idle"};
+  if(length < 6 || buffer[0] != 'D' || buffer[1] != 'T' || buffer[2] != DCC_TRACE_VERSION)
+    return false;
+  uint8_t count = buffer[3];
+  uint16_t now = buffer[4] | (buffer[5] << 8);
+  uint16_t pos = 6;
+  fprintf(out, "%u packets, dumped at t=%u\n", count, now);
+  for(uint8_t n = 0; n < count; ++n)
+  {
+    if(pos + 5 > length || pos + 5 + buffer[pos+4] > length || buffer[pos+4] > 6)
+      return false;
+    uint16_t timestamp = buffer[pos] | (buffer[pos+1] << 8);
+    uint8_t source = buffer[pos+2];
+    fprintf(out, "t-%5ums %-6s kind 0x%02X:", (uint16_t)(now - timestamp), (source <= DCC_TRACE_IDLE) ? sources[source] : "?", buffer[pos+3]);
+    for(uint8_t j = 0; j < buffer[pos+4]; ++j)
+      fprintf(out, " %02X", buffer[pos+5+j]);
+    fprintf(out, "\n");
+    pos += 5 + buffer[pos+4];
+  }
+  return true;
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef __DCCPACKETTRACE_H__
+#define __DCCPACKETTRACE_H__
+
+#include "Arduino.h"
+#include "DCCConfig.h"
+#if !defined(ARDUINO)
+#include <stdio.h>
+#endif
+
+/**
+ * A circular record of the last DCC_TRACE_DEPTH packets put on the rails, so "the loco ignored me"
+ * can be answered after the fact. DCCPacketScheduler::update() records each packet as it hands it
+ * to the waveform generator; recording is a fixed-size copy, cheap enough to leave on.
+ *
+ * Compiled in only when DCC_TRACE_DEPTH (DCCConfig.h) is non-zero; each entry costs 11 bytes of RAM.
+ * extras/host/trace.cpp (dcc_trace) prints a dump saved off a board.
+ *
+ * Binary dump format, all multi-byte values little-endian:
+ *   'D' 'T' VERSION COUNT NOW(2)                   NOW = millis() & 0xFFFF at dump time
+ *   then COUNT entries, oldest first:
+ *   TIMESTAMP(2) SOURCE KIND SIZE BYTES[SIZE]     TIMESTAMP = millis() & 0xFFFF when sent
+**/
+
+#define DCC_TRACE_VERSION   1
+
+//which queue a traced packet came from
+#define DCC_TRACE_E_STOP    0
+#define DCC_TRACE_HIGH      1
+#define DCC_TRACE_LOW       2
+#define DCC_TRACE_REPEAT    3
+#define DCC_TRACE_IDLE      4
+
+struct DCCTraceEntry
+{
+  uint16_t timestamp;
+  uint8_t source;
+  uint8_t kind;
+  uint8_t size;
+  uint8_t bytes[6];
+};
+
+class DCCPacketTrace
+{
+  public:
+    DCCPacketTrace(void);
+    
+    void record(uint8_t source, uint8_t kind, const uint8_t *bytes, uint8_t size);
+    void clear(void);
+    inline uint8_t getCount(void) { return count; }
+    
+    //writes the binary dump into buffer; returns its size, or 0 if buffer is too small
+    uint16_t dump(uint8_t *buffer, uint16_t length);
+#if defined(ARDUINO)
+    void dump(Print &out);
+#else
+    //prints a binary dump as text, one packet per line; returns false if the dump is malformed
+    static bool decode(const uint8_t *buffer, uint16_t length, FILE *out);
+#endif
+
+  private:
+    DCCTraceEntry entries[DCC_TRACE_DEPTH ? DCC_TRACE_DEPTH : 1];
+    uint8_t next; //where the next entry goes
+    uint8_t count;
+};
+
+#endif //__DCCPACKETTRACE_H__
@@ -0,0 +1,175 @@
+#include "DCCRailCom.h"
+
+/// RCN-217 4-of-8 code for each 6-bit value; every code has exactly four bits set
+static const uint8_t railcom_codes[64] = {
+  0xAC, 0xAA, 0xA9, 0xA5, 0xA3, 0xA6, 0x9C, 0x9A, 0x99, 0x95, 0x93, 0x96, 0x8E, 0x8D, 0x8B, 0xB1,
+  0xB2, 0xB4, 0xB8, 0x74, 0x72, 0x6C, 0x6A, 0x69, 0x65, 0x63, 0x66, 0x5C, 0x5A, 0x59, 0x55, 0x53,
+  0x56, 0x4E, 0x4D, 0x4B, 0x47, 0x71, 0xE8, 0xE4, 0xE2, 0xD1, 0xC9, 0xC5, 0xD8, 0xD4, 0xD2, 0xCA,
+  0xC6, 0xCC, 0x78, 0x17, 0x1B, 0x1D, 0x1E, 0x2E, 0x36, 0x3A, 0x27, 0x2B, 0x2D, 0x35, 0x39, 0x33
+};
+#define RAILCOM_CODE_ACK  0x0F
+#define RAILCOM_CODE_ACK2 0xF0
+#define RAILCOM_CODE_NACK 0x3C
+#define RAILCOM_CODE_BUSY 0xE1
+
+DCCRailCom::DCCRailCom(DCC_railcom_source_t new_source) : datagrams(0), invalid(0), excess(0), acks(0), nacks(0), source(new_source),
+    cutouts_seen(0), adr_high(0), adr_low(0), pom_pending(false), pom_answered(false), pom_value(0)
+{
+}
+
+uint8_t DCCRailCom::decode(uint8_t code)
+{
+  //a linear search is plenty at 8 bytes per cutout, and keeps a 256-byte inverse table out of RAM
+  for(uint8_t i = 0; i < 64; ++i)
+  {
+    if(railcom_codes[i] == code)
+      return i;
+  }
+  switch(code)
+  {
+    case RAILCOM_CODE_ACK:
+    case RAILCOM_CODE_ACK2:
+      return DCC_RAILCOM_ACK;
+    case RAILCOM_CODE_NACK:
+      return DCC_RAILCOM_NACK;
+    case RAILCOM_CODE_BUSY:
+      return DCC_RAILCOM_BUSY;
+  }
+  return DCC_RAILCOM_INVALID;
+}
+
+uint8_t DCCRailCom::encode(uint8_t value)
+{
+  switch(value)
+  {
+    case DCC_RAILCOM_ACK:
+      return RAILCOM_CODE_ACK;
+    case DCC_RAILCOM_NACK:
+      return RAILCOM_CODE_NACK;
+    case DCC_RAILCOM_BUSY:
+      return RAILCOM_CODE_BUSY;
+  }
+  return railcom_codes[value & 0x3F];
+}
+
+void DCCRailCom::update(void)
+{
+  uint8_t cutouts = DCC_railcom_cutouts();
+  if(!source || (cutouts == cutouts_seen))
+    return;
+  cutouts_seen = cutouts;
+  
+  uint8_t bytes[8];
+  uint8_t count = 0;
+  int16_t b;
+  while((count < sizeof(bytes)) && ((b = source()) >= 0))
+    bytes[count++] = b;
+  while(source() >= 0) //more than one cutout can hold: drop the excess rather than misread it next time
+    ++excess;
+  
+  //channel 1, if the first two bytes are an app:adr datagram
+  uint8_t first = 0;
+  if(count >= 2)
+  {
+    uint8_t v0 = decode(bytes[0]);
+    uint8_t v1 = decode(bytes[1]);
+    if((v0 < 64) && (v1 < 64) && (((v0 >> 2) == DCC_RAILCOM_ID_ADR_HIGH) || ((v0 >> 2) == DCC_RAILCOM_ID_ADR_LOW)))
+    {
+      receive(DCC_RAILCOM_CHANNEL_1, bytes, 2);
+      first = 2;
+    }
+  }
+  if(count > first)
+    receive(DCC_RAILCOM_CHANNEL_2, bytes + first, count - first);
+}
+
+void DCCRailCom::receive(uint8_t channel, const uint8_t *bytes, uint8_t count)
+{
+  uint8_t i = 0;
+  while(i < count)
+  {
+    uint8_t v = decode(bytes[i]);
+    if(v == DCC_RAILCOM_INVALID)
+    {
+      ++invalid;
+      return; //the rest of the channel cannot be framed
+    }
+    if(v >= 64) //a lone ACK, NACK or BUSY
+    {
+      if(v == DCC_RAILCOM_NACK)
+        ++nacks;
+      else
+        ++acks;
+      ++i;
+      continue;
+    }
+    //a datagram: a 4-bit ID, then its data, 6 bits to a byte
+    uint8_t id = v >> 2;
+    uint8_t length = 2;
+    if(channel == DCC_RAILCOM_CHANNEL_2)
+    {
+      if((id == DCC_RAILCOM_ID_EXT) || (id == DCC_RAILCOM_ID_DYN))
+        length = 3;
+      else if(id == DCC_RAILCOM_ID_XPOM)
+        length = 6;
+      else if(id != DCC_RAILCOM_ID_POM)
+        return; //not one we know the length of
+    }
+    if(i + length > count)
+    {
+      ++invalid;
+      return;
+    }
+    uint8_t v1 = decode(bytes[i+1]);
+    if(v1 >= 64)
+    {
+      ++invalid;
+      return;
+    }
+    uint8_t data = ((v & 0x03) << 6) | v1; //the first 8 bits of data; all that app:adr and app:pom carry
+    ++datagrams;
+    if(channel == DCC_RAILCOM_CHANNEL_1)
+    {
+      if(id == DCC_RAILCOM_ID_ADR_HIGH)
+        adr_high = data;
+      else if(id == DCC_RAILCOM_ID_ADR_LOW)
+        adr_low = data;
+    }
+    else if((id == DCC_RAILCOM_ID_POM) && pom_pending)
+    {
+      pom_value = data;
+      pom_pending = false;
+      pom_answered = true;
+    }
+    i += length;
+  }
+}
+
+#if DCC_OPS_PROGRAMMING
+bool DCCRailCom::requestCV(DCCPacketScheduler &scheduler, uint16_t address, uint8_t address_kind, uint16_t CV)
+{
+  if(!scheduler.opsReadCV(address, address_kind, CV))
+    return false;
+  pom_pending = true;
+  pom_answered = false;
+  return true;
+}
+#endif
+
+bool DCCRailCom::getCV(uint8_t *value)
+{
+  if(!pom_answered)
+    return false;
+  *value = pom_value;
+  pom_answered = false;
+  return true;
+}
+
+uint16_t DCCRailCom::getAddress(uint8_t *address_kind)
+{
+  //app:adr_high is 0 for a short address; otherwise 0x80 | the top 6 bits of a long one
+  bool is_long = adr_high & 0x80;
+  if(address_kind)
+    *address_kind = is_long ? DCC_LONG_ADDRESS : DCC_SHORT_ADDRESS;
+  return is_long ? (((uint16_t)(adr_high & 0x3F) << 8) | adr_low) : adr_low;
+}
@@ -0,0 +1,87 @@
+#ifndef __DCCRAILCOM_H__
+#define __DCCRAILCOM_H__
+
+#include "Arduino.h"
+#include "DCCHardware.h"
+#include "DCCPacketScheduler.h"
+
+/**
+ * RailCom (RCN-217) feedback decoder. Decoders answer in the cutout the waveform generator leaves after
+ * each packet (DCC_railcom_enable()); a detector turns their replies into bytes on a UART at 250kbaud.
+ * DCCRailCom pulls those bytes from a pluggable source (the detector UART on the target, typically a thin
+ * wrapper around Serial1.read(); DCC_host_railcom_read() on host builds), once per completed cutout,
+ * undoes the 4-of-8 line code and decodes the datagrams:
+ *   *channel 1 (the first 2 bytes): app:adr_high/app:adr_low, the address of the loco in this section;
+ *   *channel 2 (the rest, up to 6 bytes): app:pom, the reply to an ops mode CV read, plus ACK/NACK/BUSY.
+ * A UART cannot tell the channels apart, so the first two bytes are taken as channel 1 when they form an
+ * app:adr datagram; detectors that can timestamp bytes may call receive() directly with the right channel.
+ *
+ * requestCV() sends an ops mode verify-byte packet (opsReadCV()); the addressed decoder answers with the
+ * CV's value in channel 2 of the cutouts that follow, and getCV() returns it. update() must be called at
+ * least once per packet (every trip through loop() does) or bytes from consecutive cutouts run together.
+**/
+
+typedef int16_t (*DCC_railcom_source_t)(void); //next byte received, or -1 if none
+
+#define DCC_RAILCOM_CHANNEL_1   1
+#define DCC_RAILCOM_CHANNEL_2   2
+
+//decode() results beyond the 64 data values
+#define DCC_RAILCOM_ACK         0x40
+#define DCC_RAILCOM_NACK        0x41
+#define DCC_RAILCOM_BUSY        0x42
+#define DCC_RAILCOM_INVALID     0xFF
+
+//datagram IDs
+#define DCC_RAILCOM_ID_POM      0
+#define DCC_RAILCOM_ID_ADR_HIGH 1
+#define DCC_RAILCOM_ID_ADR_LOW  2
+#define DCC_RAILCOM_ID_EXT      3
+#define DCC_RAILCOM_ID_DYN      7
+#define DCC_RAILCOM_ID_XPOM     12
+
+class DCCRailCom
+{
+  public:
+    DCCRailCom(DCC_railcom_source_t new_source = 0);
+    
+    inline void setSource(DCC_railcom_source_t new_source) { source = new_source; }
+    
+    //the 4-of-8 line code
+    static uint8_t decode(uint8_t code); //0-63, DCC_RAILCOM_ACK/NACK/BUSY, or DCC_RAILCOM_INVALID
+    static uint8_t encode(uint8_t value); //0-63 or DCC_RAILCOM_ACK/NACK/BUSY
+    
+    //to be called periodically within loop(): decodes whatever the source received in completed cutouts
+    void update(void);
+    //decode the bytes one channel of one cutout carried
+    void receive(uint8_t channel, const uint8_t *bytes, uint8_t count);
+    
+#if DCC_OPS_PROGRAMMING
+    //ask a decoder for a CV on the main; false if the packet could not be queued
+    bool requestCV(DCCPacketScheduler &scheduler, uint16_t address, uint8_t address_kind, uint16_t CV);
+#endif
+    //true once the decoder has answered the last requestCV(), with the value in *value
+    bool getCV(uint8_t *value);
+    inline bool cvPending(void) { return pom_pending; }
+    
+    //the loco last heard on channel 1 (short, or long if *address_kind is DCC_LONG_ADDRESS), or 0 if none yet
+    uint16_t getAddress(uint8_t *address_kind = 0);
+    
+    //counters
+    uint16_t datagrams;
+    uint16_t invalid; //bytes that were not valid 4-of-8 codes
+    uint16_t excess; //bytes beyond the 8 one cutout carries, dropped: update() missed a cutout
+    uint16_t acks;
+    uint16_t nacks;
+    
+  private:
+    DCC_railcom_source_t source;
+    uint8_t cutouts_seen;
+    uint8_t adr_high;
+    uint8_t adr_low;
+    bool pom_pending;
+    bool pom_answered;
+    uint8_t pom_value;
+};
+
+#endif //__DCCRAILCOM_H__
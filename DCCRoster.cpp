@@ -0,0 +1,286 @@
+#include "DCCRoster.h"
+#include "DCCPacket.h"
+#include "DCCHardware.h"
+
+#if DCC_ROSTER_SIZE
+
+DCCRoster::DCCRoster(void)
+#if DCC_ROSTER_PERSIST
+ : sequence(0), log_head(0), save_cursor(0), last_save(0), record_pos(DCC_ROSTER_RECORD_SIZE), record_slot(0)
+#endif
+{
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    entries[i].flags = 0;
+    entries[i].log_slot = DCC_ROSTER_NO_SLOT;
+  }
+}
+
+DCCRosterEntry *DCCRoster::find(uint16_t address, uint8_t address_kind, bool create)
+{
+  DCCRosterEntry *spare = 0;
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    DCCRosterEntry *e = &entries[i];
+    if(!(e->flags & DCC_ROSTER_IN_USE))
+    {
+      if(!spare || (spare->flags & DCC_ROSTER_IN_USE))
+        spare = e; //an empty entry beats everything
+    }
+    else if((e->address == address) && (e->address_kind == address_kind))
+    {
+      return e;
+    }
+    else if(!spare && (e->speed >= -1) && (e->speed <= 1)) //failing that, a stopped loco can make way
+    {
+      spare = e;
+    }
+  }
+  if(!create || !spare || !address) //address 0 is the broadcast address, not a loco
+    return 0;
+  spare->address = address;
+  spare->address_kind = address_kind;
+  spare->speed = 1;
+  spare->steps = 0;
+  spare->functions = 0;
+  spare->flags = DCC_ROSTER_IN_USE;
+  spare->log_slot = DCC_ROSTER_NO_SLOT;
+  return spare;
+}
+
+void DCCRoster::touch(DCCRosterEntry *entry)
+{
+  entry->flags |= DCC_ROSTER_DIRTY;
+  entry->flags &= ~DCC_ROSTER_RESTORED; //superseded by a live command
+}
+
+void DCCRoster::setSpeed(uint16_t address, uint8_t address_kind, int8_t speed, uint8_t steps)
+{
+  DCCRosterEntry *e = find(address, address_kind, true);
+  if(e && ((e->speed != speed) || (e->steps != steps) || (e->log_slot == DCC_ROSTER_NO_SLOT)))
+  {
+    e->speed = speed;
+    e->steps = steps;
+    touch(e);
+  }
+}
+
+void DCCRoster::setFunctions(uint16_t address, uint8_t address_kind, uint16_t functions, uint16_t mask)
+{
+  DCCRosterEntry *e = find(address, address_kind, true);
+  if(e)
+  {
+    uint16_t new_functions = (e->functions & ~mask) | (functions & mask);
+    if((new_functions != e->functions) || (e->log_slot == DCC_ROSTER_NO_SLOT))
+    {
+      e->functions = new_functions;
+      touch(e);
+    }
+  }
+}
+
+void DCCRoster::stop(DCCRosterEntry *entry)
+{
+  int8_t stopped = (entry->speed < 0) ? -1 : 1;
+  if(entry->speed != stopped)
+  {
+    entry->speed = stopped;
+    touch(entry);
+  }
+}
+
+void DCCRoster::stopAll(void)
+{
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    if(entries[i].flags & DCC_ROSTER_IN_USE)
+      stop(&entries[i]);
+  }
+}
+
+void DCCRoster::remove(DCCRosterEntry *entry)
+{
+  //its last record stays in EEPROM until the log comes round, so a restore() before then may bring it back
+  entry->flags = 0;
+  entry->log_slot = DCC_ROSTER_NO_SLOT;
+}
+
+bool DCCRoster::slotLive(uint8_t slot)
+{
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    if((entries[i].flags & DCC_ROSTER_IN_USE) && (entries[i].log_slot == slot))
+    {
+      entries[i].flags |= DCC_ROSTER_DIRTY; //to be migrated further along the log
+      return true;
+    }
+  }
+  return false;
+}
+
+#if DCC_ROSTER_PERSIST
+
+static uint8_t record_checksum(const uint8_t *record)
+{
+  uint8_t x = 0x5A;
+  for(uint8_t i = 0; i < DCC_ROSTER_RECORD_SIZE; ++i)
+  {
+    if(i != 5)
+      x ^= record[i];
+  }
+  return (x ^ (x >> 6)) & 0x3F;
+}
+
+static uint8_t steps_code(uint8_t steps)
+{
+  switch(steps)
+  {
+    case 14: return 1;
+    case 28: return 2;
+    case 128: return 3;
+  }
+  return 0;
+}
+
+static const uint8_t steps_from_code[] = {0, 14, 28, 128};
+
+void DCCRoster::save(void)
+{
+  if(record_pos < DCC_ROSTER_RECORD_SIZE) //a record is being written: one byte at a time, sequence number last
+  {
+    if(!DCC_eeprom_ready())
+      return;
+    uint8_t i = (record_pos + 2) % DCC_ROSTER_RECORD_SIZE;
+    DCC_eeprom_write(DCC_ROSTER_EEPROM_BASE + record_slot*DCC_ROSTER_RECORD_SIZE + i, record[i]);
+    ++record_pos;
+    return;
+  }
+  
+  if(millis() - last_save < DCC_ROSTER_SAVE_INTERVAL)
+    return;
+  
+  DCCRosterEntry *e = 0;
+  for(uint8_t n = 0; n < DCC_ROSTER_SIZE && !e; ++n)
+  {
+    save_cursor = (save_cursor + 1) % DCC_ROSTER_SIZE;
+    if((entries[save_cursor].flags & (DCC_ROSTER_IN_USE | DCC_ROSTER_DIRTY)) == (DCC_ROSTER_IN_USE | DCC_ROSTER_DIRTY))
+      e = &entries[save_cursor];
+  }
+  if(!e)
+    return;
+  
+  while(slotLive(log_head)) //never overwrite a loco's newest record
+    log_head = (log_head + 1) % DCC_ROSTER_EEPROM_RECORDS;
+  
+  uint16_t address = e->address | ((e->address_kind == DCC_LONG_ADDRESS) ? 0x8000 : 0);
+  record[0] = sequence & 0xFF;
+  record[1] = sequence >> 8;
+  record[2] = address & 0xFF;
+  record[3] = address >> 8;
+  record[4] = e->speed;
+  record[6] = e->functions & 0xFF;
+  record[7] = e->functions >> 8;
+  record[5] = steps_code(e->steps) | (record_checksum(record) << 2);
+  
+  record_slot = log_head;
+  record_pos = 0;
+  e->log_slot = log_head;
+  e->flags &= ~DCC_ROSTER_DIRTY;
+  log_head = (log_head + 1) % DCC_ROSTER_EEPROM_RECORDS;
+  if(++sequence == 0xFFFF) //0xFFFF is erased EEPROM
+    sequence = 0;
+  last_save = millis();
+}
+
+uint8_t DCCRoster::restore(void)
+{
+  uint16_t entry_sequence[DCC_ROSTER_SIZE]; //of each entry's record; only read for entries restore() has filled
+  uint16_t newest = 0;
+  bool any = false;
+  uint8_t restored = 0;
+  
+  //start from an empty roster, so that every entry in use below holds a record and its sequence number
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    entries[i].flags = 0;
+    entries[i].log_slot = DCC_ROSTER_NO_SLOT;
+    entry_sequence[i] = 0;
+  }
+  record_pos = DCC_ROSTER_RECORD_SIZE; //and no record half written
+  
+  for(uint8_t slot = 0; slot < DCC_ROSTER_EEPROM_RECORDS; ++slot)
+  {
+    uint8_t r[DCC_ROSTER_RECORD_SIZE];
+    for(uint8_t i = 0; i < DCC_ROSTER_RECORD_SIZE; ++i)
+      r[i] = DCC_eeprom_read(DCC_ROSTER_EEPROM_BASE + slot*DCC_ROSTER_RECORD_SIZE + i);
+    uint16_t seq = r[0] | (r[1] << 8);
+    if((seq == 0xFFFF) || ((r[5] >> 2) != record_checksum(r)))
+      continue;
+    
+    if(!any || ((int16_t)(seq - newest) > 0))
+    {
+      newest = seq;
+      log_head = (slot + 1) % DCC_ROSTER_EEPROM_RECORDS;
+      any = true;
+    }
+    
+    uint16_t address = r[2] | (r[3] << 8);
+    uint8_t address_kind = (address & 0x8000) ? DCC_LONG_ADDRESS : DCC_SHORT_ADDRESS;
+    address &= 0x7FFF;
+    DCCRosterEntry *e = find(address, address_kind);
+    if(e && ((int16_t)(seq - entry_sequence[e - entries]) <= 0))
+      continue; //already have a newer record for this loco
+    if(!e)
+    {
+      //take an empty entry, or else the one with the oldest record
+      for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+      {
+        if(!(entries[i].flags & DCC_ROSTER_IN_USE))
+        {
+          e = &entries[i];
+          break;
+        }
+        if(!e || ((int16_t)(entry_sequence[i] - entry_sequence[e - entries]) < 0))
+          e = &entries[i];
+      }
+      if((e->flags & DCC_ROSTER_IN_USE) && ((int16_t)(seq - entry_sequence[e - entries]) <= 0))
+        continue;
+    }
+    e->address = address;
+    e->address_kind = address_kind;
+    e->speed = r[4];
+    e->steps = steps_from_code[r[5] & 0x03];
+    e->functions = r[6] | (r[7] << 8);
+    e->flags = DCC_ROSTER_IN_USE | DCC_ROSTER_RESTORED;
+    e->log_slot = slot;
+    entry_sequence[e - entries] = seq;
+  }
+  
+  if(any)
+  {
+    sequence = newest + 1;
+    if(sequence == 0xFFFF)
+      sequence = 0;
+  }
+  for(uint8_t i = 0; i < DCC_ROSTER_SIZE; ++i)
+  {
+    if(entries[i].flags & DCC_ROSTER_RESTORED)
+      ++restored;
+  }
+  return restored;
+}
+
+#else
+
+void DCCRoster::save(void)
+{
+}
+
+uint8_t DCCRoster::restore(void)
+{
+  return 0;
+}
+
+#endif //DCC_ROSTER_PERSIST
+
+#endif //DCC_ROSTER_SIZE
@@ -0,0 +1,91 @@
+#ifndef __DCCROSTER_H__
+#define __DCCROSTER_H__
+
+#include "Arduino.h"
+#include "DCCConfig.h"
+
+/**
+ * The last known speed, direction and function state of each active loco, kept by DCCPacketScheduler
+ * as set*() calls go by, and optionally persisted to EEPROM so that after a brownout or watchdog reset
+ * the layout picks up where it left off instead of waiting for every throttle to resend.
+ *
+ * Persistence is a wear-levelled log of DCC_ROSTER_EEPROM_RECORDS fixed-size records, each a complete
+ * snapshot of one loco stamped with a 16-bit sequence number. A changed loco is appended at the log head
+ * at most once every DCC_ROSTER_SAVE_INTERVAL ms, one byte per save() call so update() never waits on
+ * the EEPROM. The head skips over slots still holding a loco's newest record, and that loco is queued to
+ * be rewritten further on, so every live record stays within the last lap of the log and every slot wears
+ * at the same rate. restore() keeps the newest valid record for each address; a record torn by a reset
+ * mid-write fails its checksum and the one before it is used instead.
+ *
+ * Record: SEQ(2) ADDRESS(2, bit 15 = long) SPEED STEPS|CHECKSUM<<2 FUNCTIONS(2), little-endian
+**/
+
+#ifndef DCC_ROSTER_SIZE
+#define DCC_ROSTER_SIZE 8
+#endif
+#ifndef DCC_ROSTER_PERSIST
+#define DCC_ROSTER_PERSIST 0 //off by default: the sketch may have its own use for the EEPROM
+#endif
+#define DCC_ROSTER_EEPROM_BASE      0
+#define DCC_ROSTER_EEPROM_RECORDS   32
+#define DCC_ROSTER_RECORD_SIZE      8
+#define DCC_ROSTER_SAVE_INTERVAL    1000
+
+#if DCC_ROSTER_PERSIST && (DCC_ROSTER_EEPROM_RECORDS < 2*DCC_ROSTER_SIZE)
+#error "the roster log needs at least two records per roster entry"
+#endif
+
+#define DCC_ROSTER_IN_USE   0x01
+#define DCC_ROSTER_DIRTY    0x02 //changed since last written to EEPROM
+#define DCC_ROSTER_RESTORED 0x04 //loaded by restore() and not yet resent to the rails
+#define DCC_ROSTER_NO_SLOT  0xFF
+
+struct DCCRosterEntry
+{
+  uint16_t address;
+  uint8_t address_kind;
+  int8_t speed; //as passed to setSpeed(): [-127,127], +/-1 = stop
+  uint8_t steps; //0 = scheduler default
+  uint16_t functions; //F0 = bit 0 ... F12 = bit 12
+  uint8_t flags;
+  uint8_t log_slot; //where this loco's newest record is, or DCC_ROSTER_NO_SLOT
+};
+
+class DCCRoster
+{
+  public:
+    DCCRoster(void);
+    
+    DCCRosterEntry *find(uint16_t address, uint8_t address_kind, bool create=false);
+    void setSpeed(uint16_t address, uint8_t address_kind, int8_t speed, uint8_t steps);
+    void setFunctions(uint16_t address, uint8_t address_kind, uint16_t functions, uint16_t mask);
+    void stop(DCCRosterEntry *entry); //regular stop, keeping direction
+    void stopAll(void);
+    void remove(DCCRosterEntry *entry); //forget a loco altogether, e.g. one that has left this district
+    
+    inline uint8_t getSize(void) { return DCC_ROSTER_SIZE; }
+    inline DCCRosterEntry *getEntry(uint8_t i) { return (entries[i].flags & DCC_ROSTER_IN_USE) ? &entries[i] : 0; }
+    
+    //to be called periodically: advances any EEPROM write in progress by at most one byte
+    void save(void);
+    //reload from EEPROM, replacing whatever the roster holds, so call it before any set*() (DCCPacketScheduler::setup()
+    //does); returns how many locos were restored, each flagged DCC_ROSTER_RESTORED
+    uint8_t restore(void);
+    
+  private:
+    void touch(DCCRosterEntry *entry);
+    bool slotLive(uint8_t slot);
+    
+    DCCRosterEntry entries[DCC_ROSTER_SIZE];
+#if DCC_ROSTER_PERSIST
+    uint16_t sequence; //of the next record
+    uint8_t log_head; //slot of the next record
+    uint8_t save_cursor; //round-robin over dirty entries
+    unsigned long last_save;
+    uint8_t record[DCC_ROSTER_RECORD_SIZE]; //being written
+    uint8_t record_pos; //next byte of record to write; DCC_ROSTER_RECORD_SIZE when idle
+    uint8_t record_slot;
+#endif
+};
+
+#endif //__DCCROSTER_H__
@@ -0,0 +1,507 @@
+#include "DCCSimulator.h"
+
+#if !defined(ARDUINO)
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "DCCHardwareHost.h"
+#include "DCCIsrProfile.h"
+#include "DCCOvercurrent.h"
+
+DCCSimHistogram::DCCSimHistogram(void) : count(0), total(0), max(0)
+{
+  memset(buckets, 0, sizeof(buckets));
+}
+
+void DCCSimHistogram::record(uint64_t value)
+{
+  uint8_t bucket = 0;
+  while((bucket < DCC_SIM_HISTOGRAM_BUCKETS-1) && (value >> (bucket+1)))
+    ++bucket;
+  ++buckets[bucket];
+  ++count;
+  total += value;
+  if(value > max)
+    max = value;
+  samples.push_back(value);
+}
+
+uint64_t DCCSimHistogram::percentile(uint8_t p)
+{
+  if(samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t i = (samples.size() * p) / 100;
+  if(i >= samples.size())
+    i = samples.size() - 1;
+  return samples[i];
+}
+
+void DCCSimHistogram::print(FILE *out, const char *name)
+{
+  fprintf(out, "%s: n=%u mean=%lluus p50=%lluus p90=%lluus p99=%lluus max=%lluus\n", name, count,
+    count ? (unsigned long long)(total/count) : 0ULL, (unsigned long long)percentile(50),
+    (unsigned long long)percentile(90), (unsigned long long)percentile(99), (unsigned long long)max);
+  for(uint8_t i = 0; i < DCC_SIM_HISTOGRAM_BUCKETS; ++i)
+  {
+    if(buckets[i])
+      fprintf(out, "  [%8lu, %8lu)us %u\n", 1UL << i, 2UL << i, buckets[i]);
+  }
+}
+
+/*****************************/
+
+DCCSimulator::DCCSimulator(DCCPacketScheduler &new_scheduler) : commands_issued(0), commands_rejected(0), commands_limited(0),
+    commands_malformed(0), packets_sent(0),
+    idle_packets_sent(0), update_ns(0), hook_ns(0), hook_max_ns(0), hook_calls(0), timing_violations(0), shortest_preamble(0xFF), sniffer_mismatches(0), scheduler(new_scheduler), parser(new_scheduler), next_event(0), unsorted(false), clock(0), loop_period(DCC_SIM_DEFAULT_LOOP_PERIOD_US), hook(0), hook_context(0),
+    isr_model(false), isr_base(0), isr_jitter(0), isr_duration(0), isr_random(1), sniffer(0), last_packet_end(0)
+{
+}
+
+void DCCSimulator::setIsrLatency(uint16_t base_ticks, uint16_t jitter_ticks, uint16_t duration_ticks)
+{
+  isr_model = true;
+  isr_base = base_ticks;
+  isr_jitter = jitter_ticks;
+  isr_duration = duration_ticks;
+  DCC_isr_profile_reset();
+}
+
+void DCCSimulator::profileIsr(void)
+{
+  for(uint16_t i = 0; i < DCC_host_timings_count; ++i)
+  {
+    uint16_t top = DCC_host_timings[i]*2 - 1; //Timer1 TOP for this half-period at /8 prescalar
+    uint16_t entry = isr_base;
+    if(isr_jitter)
+    {
+      isr_random = isr_random * 1103515245 + 12345; //reproducible from run to run
+      entry += (isr_random >> 16) % (isr_jitter + 1);
+    }
+    DCC_isr_profile_record(entry, entry + isr_duration, top);
+  }
+}
+
+void DCCSimulator::addCommand(uint64_t time_us, const char *command)
+{
+  DCCSimEvent e;
+  e.time = time_us;
+  strncpy(e.command, command, sizeof(e.command)-1);
+  e.command[sizeof(e.command)-1] = 0;
+  //append; run() sorts the not-yet-run part of the list once, if need be, with equal times in insertion order
+  if(events.size() > next_event && time_us < events.back().time)
+    unsorted = true;
+  events.push_back(e);
+}
+
+bool DCCSimulator::loadScript(const char *script)
+{
+  while(*script)
+  {
+    const char *end = strchr(script, '\n');
+    if(!end)
+      end = script + strlen(script);
+    char line[40];
+    size_t length = end - script;
+    if(length >= sizeof(line))
+      return false;
+    memcpy(line, script, length);
+    line[length] = 0;
+    script = *end ? end+1 : end;
+    
+    char *command;
+    if(!line[strspn(line, " \t\r")] || line[0] == '#') //blank or comment
+      continue;
+    unsigned long time_ms = strtoul(line, &command, 10);
+    if(command == line)
+      return false;
+    command += strspn(command, " \t");
+    addCommand((uint64_t)time_ms * 1000, command);
+  }
+  return true;
+}
+
+bool DCCSimulator::loadFile(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if(!f)
+    return false;
+  std::string script;
+  char buffer[256];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    script.append(buffer, n);
+  fclose(f);
+  return loadScript(script.c_str());
+}
+
+void DCCSimulator::throttleEvents(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us,
+                                  std::vector<DCCSimEvent> &out)
+{
+  //sweep the throttle back and forth across the speed range, one step per update
+  int8_t speed = 2, step = 1;
+  DCCSimEvent e;
+  for(uint64_t t = start_us; t < end_us; t += 1000000 / updates_per_second)
+  {
+    e.time = t;
+    snprintf(e.command, sizeof(e.command), "S %u %d", address, speed);
+    out.push_back(e);
+    if(speed == 127 || (speed == 2 && step < 0))
+      step = -step;
+    speed += step;
+  }
+}
+
+void DCCSimulator::addThrottle(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us)
+{
+  std::vector<DCCSimEvent> throttle;
+  throttleEvents(address, updates_per_second, start_us, end_us, throttle);
+  for(size_t i = 0; i < throttle.size(); ++i)
+    addCommand(throttle[i].time, throttle[i].command);
+}
+
+void DCCSimulator::addAccessoryBurst(uint64_t time_us, uint16_t first_address, uint8_t count)
+{
+  char command[24];
+  for(uint8_t i = 0; i < count; ++i)
+  {
+    snprintf(command, sizeof(command), "A %u %u", first_address + i, i & 0x03);
+    addCommand(time_us, command);
+  }
+}
+
+void DCCSimulator::addEStop(uint64_t time_us)
+{
+  addCommand(time_us, "E");
+}
+
+uint32_t DCCSimulator::commandKey(const char *command)
+{
+  char letter = command[0] & ~0x20;
+  const char *field = command + 1;
+  field += strspn(field, " ");
+  bool long_address = (*field == 'L' || *field == 'l');
+  if(long_address)
+    ++field;
+  char *next;
+  uint32_t address = strtoul(field, &next, 10);
+  if(address > 127 && letter != 'A')
+    long_address = true;
+  long argument = strtol(next, NULL, 10);
+  uint32_t packet_class;
+  switch(letter)
+  {
+    case 'S': packet_class = argument ? DCC_SIM_CLASS_SPEED : DCC_SIM_CLASS_E_STOP; break;
+    case 'F': packet_class = DCC_SIM_CLASS_FUNCTION_1; break; //the other two groups are tracked by the caller
+    case 'A': packet_class = DCC_SIM_CLASS_ACCESSORY; break;
+    case 'P': packet_class = DCC_SIM_CLASS_POM; break;
+    case 'E': packet_class = DCC_SIM_CLASS_E_STOP; break;
+    default: return 0;
+  }
+  return (packet_class << 16) | (long_address && address ? DCC_SIM_KEY_LONG : 0) | address;
+}
+
+void DCCSimulator::issue(const char *command, uint64_t time)
+{
+  uint32_t limited = parser.rate_limited, unsupported = parser.unsupported;
+  for(const char *c = command; *c; ++c)
+    parser.parse(*c);
+  char status = parser.parse('\n');
+  ++commands_issued;
+  if(status != DCC_COMMAND_OK)
+  {
+    if(status == DCC_COMMAND_MALFORMED || parser.unsupported != unsupported)
+      ++commands_malformed;
+    else if(parser.rate_limited != limited)
+      ++commands_limited;
+    else
+      ++commands_rejected;
+    return;
+  }
+  uint32_t key = commandKey(command);
+  if(!key)
+    return;
+  if((key >> 16) == DCC_SIM_CLASS_FUNCTION_1) //setFunctions() produces all three function groups
+  {
+    pending[(DCC_SIM_CLASS_FUNCTION_2 << 16) | (key & 0xFFFF)] = time;
+    pending[(DCC_SIM_CLASS_FUNCTION_3 << 16) | (key & 0xFFFF)] = time;
+  }
+  //a newer command for the same address and class supersedes an older one still waiting
+  pending[key] = time;
+}
+
+uint8_t DCCSimulator::classify(const uint8_t *packet, uint8_t size, uint16_t *address, uint8_t *address_kind)
+{
+  if(address_kind)
+    *address_kind = ((packet[0] & 0xC0) == 0xC0 && packet[0] != 0xFF) ? DCC_LONG_ADDRESS : DCC_SHORT_ADDRESS;
+  if(size < 3 || packet[0] == 0xFF) //idle
+  {
+    *address = 0xFF;
+    return DCC_SIM_CLASS_OTHER;
+  }
+  if((packet[0] & 0xC0) == 0x80) //10AAAAAA: basic accessory
+  {
+    *address = (packet[0] & 0x3F) | ((~packet[1] & 0x70) << 2);
+    return DCC_SIM_CLASS_ACCESSORY;
+  }
+  uint8_t instruction = 1;
+  if((packet[0] & 0xC0) == 0xC0) //long address
+  {
+    *address = ((packet[0] & 0x3F) << 8) | packet[1];
+    instruction = 2;
+  }
+  else
+  {
+    *address = packet[0];
+  }
+  uint8_t i = packet[instruction];
+  if(i == 0x3F)
+    return DCC_SIM_CLASS_SPEED;
+  if((i & 0xC0) == 0x40)
+    return ((i & 0x0F) == 0x01) ? DCC_SIM_CLASS_E_STOP : DCC_SIM_CLASS_SPEED;
+  if((i & 0xE0) == 0x80)
+    return DCC_SIM_CLASS_FUNCTION_1;
+  if((i & 0xF0) == 0xB0)
+    return DCC_SIM_CLASS_FUNCTION_2;
+  if((i & 0xF0) == 0xA0)
+    return DCC_SIM_CLASS_FUNCTION_3;
+  if((i & 0xF0) == 0xE0)
+    return DCC_SIM_CLASS_POM;
+  return DCC_SIM_CLASS_OTHER;
+}
+
+uint32_t DCCSimulator::packetKey(const uint8_t *packet, uint8_t size)
+{
+  uint16_t address;
+  uint8_t address_kind;
+  uint8_t packet_class = classify(packet, size, &address, &address_kind);
+  return ((uint32_t)packet_class << 16) | ((address_kind == DCC_LONG_ADDRESS) ? DCC_SIM_KEY_LONG : 0) | address;
+}
+
+void DCCSimulator::checkTiming(void)
+{
+  //each bit is a high and a low half; both halves of a '1' must be in the '1' window, and of a '0' in the '0' window
+  uint8_t preamble = 0;
+  bool in_preamble = true;
+  for(uint16_t i = 0; i + 1 < DCC_host_timings_count; i += 2)
+  {
+    uint16_t high = DCC_host_timings[i];
+    uint16_t low = DCC_host_timings[i+1];
+    bool one = (high >= DCC_ONE_HALF_PERIOD_MIN_US) && (high <= DCC_ONE_HALF_PERIOD_MAX_US) &&
+               (low >= DCC_ONE_HALF_PERIOD_MIN_US) && (low <= DCC_ONE_HALF_PERIOD_MAX_US);
+    bool zero = (high >= DCC_ZERO_HALF_PERIOD_MIN_US) && (high <= DCC_ZERO_HALF_PERIOD_MAX_US) &&
+                (low >= DCC_ZERO_HALF_PERIOD_MIN_US) && (low <= DCC_ZERO_HALF_PERIOD_MAX_US);
+    if(!one && !zero)
+      ++timing_violations;
+    if(in_preamble && one)
+      ++preamble;
+    else
+      in_preamble = false;
+  }
+  if(preamble < shortest_preamble)
+    shortest_preamble = preamble;
+  if(preamble < DCC_PREAMBLE_BITS)
+    ++timing_violations;
+}
+
+void DCCSimulator::sniff(void)
+{
+  //the generator filled the gap since the last packet with '1's; a preamble's worth is enough to decode
+  uint16_t ones[2 * DCC_MAX_PREAMBLE_BITS + 1];
+  uint16_t one_us = DCC_waveform_timing()->one_us;
+  uint64_t gap = clock - DCC_host_packet_duration() - last_packet_end;
+  uint16_t halves = 2 * std::min<uint64_t>(gap / (2 * one_us), DCC_MAX_PREAMBLE_BITS);
+  if(packets_sent == 1)
+    ++halves; //an edge for the first half-period to be timed from
+  for(uint16_t i = 0; i < halves; ++i)
+    ones[i] = one_us;
+  sniffer->decodeTimings(ones, halves);
+
+  uint32_t before = sniffer->packets;
+  sniffer->decodeTimings(DCC_host_timings, DCC_host_timings_count);
+  if(sniffer->packets != before + 1 || sniffer->getSize() != DCC_host_packet_size ||
+     memcmp(sniffer->getBytes(), DCC_host_packet, DCC_host_packet_size))
+    ++sniffer_mismatches;
+}
+
+void DCCSimulator::packetSent(void)
+{
+  uint16_t address;
+  uint8_t address_kind;
+  uint8_t packet_class = classify(DCC_host_packet, DCC_host_packet_size, &address, &address_kind);
+  uint16_t key = addressKey(address, address_kind);
+  ++packets_sent;
+  checkTiming();
+  if(isr_model)
+    profileIsr();
+  if(sniffer)
+    sniff();
+  last_packet_end = clock;
+  if(DCC_host_packet[0] == 0xFF)
+    ++idle_packets_sent;
+  if(packet_class == DCC_SIM_CLASS_OTHER)
+    return;
+  
+  DCCSimAddressStats &stats = per_address[key];
+  ++stats.packets;
+  
+  if(packet_class == DCC_SIM_CLASS_SPEED)
+  {
+    std::map<uint16_t, uint64_t>::iterator last = last_speed_packet.find(key);
+    if(last != last_speed_packet.end())
+      refresh_interval[key].record(clock - last->second);
+    last_speed_packet[key] = clock;
+  }
+  
+  std::map<uint32_t, uint64_t>::iterator p = pending.find(packetKey(DCC_host_packet, DCC_host_packet_size));
+  if(p != pending.end())
+  {
+    latency.record(clock - p->second);
+    stats.latency.record(clock - p->second);
+    pending.erase(p);
+  }
+}
+
+static __thread DCCSimulator *current_simulator = 0;
+
+DCCSimulator *DCCSimulator::current(void)
+{
+  return current_simulator;
+}
+
+void DCCSimulator::run(uint64_t end_us)
+{
+  current_simulator = this;
+  if(unsorted)
+  {
+    std::stable_sort(events.begin() + next_event, events.end());
+    unsorted = false;
+  }
+  while(clock < end_us)
+  {
+    while(next_event < events.size() && events[next_event].time <= clock)
+    {
+      //the call is made now, but its latency is measured from when the scenario asked for it
+      issue(events[next_event].command, events[next_event].time);
+      ++next_event;
+    }
+    
+    std::chrono::steady_clock::time_point start;
+    if(hook)
+    {
+      start = std::chrono::steady_clock::now();
+      hook(hook_context);
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      hook_ns += ns;
+      if(ns > hook_max_ns)
+        hook_max_ns = ns;
+      ++hook_calls;
+    }
+    start = std::chrono::steady_clock::now();
+    scheduler.update();
+    if(!DCC_waveform_ready()) //a packet went out
+    {
+      update_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      clock += DCC_host_packet_duration();
+      packetSent();
+      DCC_host_waveform_complete();
+      //the next update() happens on the next trip through loop(); '1's fill the gap
+      clock += loop_period - (clock % loop_period);
+    }
+    else
+    {
+      clock += loop_period;
+    }
+  }
+}
+
+void DCCSimulator::writeResults(FILE *out)
+{
+  fprintf(out, "{\"simulated_us\":%llu,\"packets\":%u,\"idle_packets\":%u,\"packets_per_second\":%.1f,\"idle_ratio\":%.4f,",
+    (unsigned long long)clock, packets_sent, idle_packets_sent, clock ? packets_sent * 1e6 / clock : 0.0,
+    packets_sent ? (double)idle_packets_sent / packets_sent : 0.0);
+  fprintf(out, "\"commands_issued\":%u,\"commands_rejected\":%u,\"commands_limited\":%u,\"commands_malformed\":%u,\"commands_lost\":%u,\"pool_high_water\":%u,\"timing_violations\":%u,\"update_ns_per_packet\":%.0f,",
+    commands_issued, commands_rejected, commands_limited, commands_malformed, (unsigned)pending.size(), scheduler.packet_pool.getHighWater(), timing_violations,
+    packets_sent ? (double)update_ns / packets_sent : 0.0);
+  fprintf(out, "\"latency_us\":{\"n\":%u,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}}",
+    latency.count, latency.count ? (unsigned long long)(latency.total / latency.count) : 0ULL,
+    (unsigned long long)latency.percentile(50), (unsigned long long)latency.percentile(90),
+    (unsigned long long)latency.percentile(99), (unsigned long long)latency.max);
+}
+
+void DCCSimulator::reportBuild(FILE *out)
+{
+  unsigned pool_ram = PACKET_POOL_SIZE * (sizeof(DCCPacket) + 1);
+  fprintf(out, "build profile %s: 14 steps %s, 28 steps %s, ops programming %s, accessories %s\n", DCC_PROFILE_NAME,
+          DCC_SPEED_14 ? "on" : "off", DCC_SPEED_28 ? "on" : "off", DCC_OPS_PROGRAMMING ? "on" : "off", DCC_ACCESSORIES ? "on" : "off");
+  fprintf(out, "  pool %u slots (reserves %u/%u/%u/%u), roster %u locos%s, %u group commands, %u accessory pulses, trace %u packets\n",
+          PACKET_POOL_SIZE, E_STOP_QUEUE_RESERVE, HIGH_PRIORITY_QUEUE_RESERVE, LOW_PRIORITY_QUEUE_RESERVE, REPEAT_QUEUE_RESERVE,
+          DCC_ROSTER_SIZE, DCC_ROSTER_PERSIST ? ", persisted" : "", DCC_GROUP_COMMANDS, DCC_PULSE_TIMERS, DCC_TRACE_DEPTH);
+  //host pointers are 4-8 bytes against AVR's 2, so the object size here is an upper bound for the target
+  fprintf(out, "  RAM: pool %uB + scheduler %uB (host) = %uB of %uB budget\n", pool_ram, (unsigned)sizeof(DCCPacketScheduler),
+          pool_ram + (unsigned)sizeof(DCCPacketScheduler), DCC_RAM_BUDGET);
+}
+
+void DCCSimulator::report(FILE *out)
+{
+  reportBuild(out);
+  fprintf(out, "simulated %.3fs: %u packets (%u idle, %.1f%%), %.1f packets/s\n", clock / 1e6, packets_sent, idle_packets_sent,
+    packets_sent ? 100.0 * idle_packets_sent / packets_sent : 0.0, clock ? packets_sent * 1e6 / clock : 0.0);
+  fprintf(out, "commands: %u issued, %u rejected with the queues full (%.2f%%), %u over the rate limit, %u malformed or not built,"
+    " %u never reached the rails\n", commands_issued, commands_rejected, commands_issued ? 100.0 * commands_rejected / commands_issued : 0.0,
+    commands_limited, commands_malformed, (unsigned)pending.size());
+  if(DCC_overcurrent_trips())
+    fprintf(out, "overcurrent: %u trips%s\n", DCC_overcurrent_trips(), DCC_overcurrent_tripped() ? ", still tripped" : "");
+  fprintf(out, "timing: %u bits outside the S 9.1 windows or short preambles, shortest preamble %u bits\n", timing_violations,
+    packets_sent ? shortest_preamble : 0);
+  fprintf(out, "packet pool: %u of %u slots in use at most\n", scheduler.packet_pool.getHighWater(), PACKET_POOL_SIZE);
+#if DCC_ROSTER_PERSIST
+  fprintf(out, "roster EEPROM: %u bytes written\n", DCC_host_eeprom_writes);
+#endif
+  fprintf(out, "host update() cost: %.0fns/packet\n", packets_sent ? (double)update_ns / packets_sent : 0.0);
+  if(hook_calls)
+    fprintf(out, "host loop hook cost: %.0fns/call, %lluns max\n", (double)hook_ns / hook_calls, (unsigned long long)hook_max_ns);
+  latency.print(out, "latency");
+  if(isr_model)
+  {
+    DCC_isr_profile_t profile;
+    DCC_isr_profile_read(&profile);
+    fprintf(out, "ISR: %u interrupts, max latency %.1fus, max duration %.1fus, min margin %.1fus, %u late reloads\n",
+      profile.samples, profile.max_latency / 2.0, profile.max_duration / 2.0, profile.min_margin / 2.0, profile.late_reloads);
+    for(uint8_t i = 0; i < DCC_ISR_PROFILE_BUCKETS; ++i)
+    {
+      if(profile.latency[i] || profile.duration[i])
+        fprintf(out, "  %2u-%2uus%s latency %u duration %u\n", i * DCC_ISR_PROFILE_BUCKET_TICKS / 2, (i+1) * DCC_ISR_PROFILE_BUCKET_TICKS / 2,
+          (i == DCC_ISR_PROFILE_BUCKETS-1) ? "+" : " ", profile.latency[i], profile.duration[i]);
+    }
+  }
+  if(sniffer)
+  {
+    fprintf(out, "sniffer: %u packets read back, %u mismatched; %u XOR errors, %u framing errors, %u half-periods out of spec\n",
+      sniffer->packets, sniffer_mismatches, sniffer->xor_errors, sniffer->framing_errors, sniffer->out_of_spec);
+    fprintf(out, "  %u idle, %u speed, %u e-stop, %u function, %u accessory, %u programming, %u reset, %u other; shortest preamble %u bits\n",
+      sniffer->idles, sniffer->speeds, sniffer->e_stops, sniffer->functions, sniffer->accessories, sniffer->programming,
+      sniffer->resets, sniffer->others, sniffer->packets ? sniffer->shortest_preamble : 0);
+  }
+  uint32_t addressed_packets = 0;
+  for(std::map<uint16_t, DCCSimAddressStats>::iterator i = per_address.begin(); i != per_address.end(); ++i)
+    addressed_packets += i->second.packets;
+  for(std::map<uint16_t, DCCSimAddressStats>::iterator i = per_address.begin(); i != per_address.end(); ++i)
+  {
+    DCCSimHistogram &l = i->second.latency;
+    fprintf(out, "address %s%u: %.1f%% of packets, latency n=%u mean=%lluus p99=%lluus max=%lluus\n",
+      (i->first & DCC_SIM_KEY_LONG) ? "L" : "", i->first & ~DCC_SIM_KEY_LONG,
+      addressed_packets ? 100.0 * i->second.packets / addressed_packets : 0.0, l.count,
+      l.count ? (unsigned long long)(l.total / l.count) : 0ULL, (unsigned long long)l.percentile(99), (unsigned long long)l.max);
+  }
+  for(std::map<uint16_t, DCCSimHistogram>::iterator i = refresh_interval.begin(); i != refresh_interval.end(); ++i)
+  {
+    fprintf(out, "loco %s%u refresh: mean=%lluus max=%lluus\n", (i->first & DCC_SIM_KEY_LONG) ? "L" : "", i->first & ~DCC_SIM_KEY_LONG,
+      i->second.count ? (unsigned long long)(i->second.total / i->second.count) : 0ULL, (unsigned long long)i->second.max);
+  }
+}
+
+#endif //!ARDUINO
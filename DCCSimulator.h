@@ -0,0 +1,187 @@
+#ifndef __DCCSIMULATOR_H__
+#define __DCCSIMULATOR_H__
+
+/**
+ * Discrete-event simulation of a whole command station, for host builds only.
+ * DCCSimulator runs a DCCPacketScheduler against the host waveform backend (DCCHardwareHost.c)
+ * in simulated time: every packet occupies the rails for exactly as long as its encoded bit
+ * timings say, and loop() is modelled as calling update() every loop_period microseconds, so
+ * any gap between the end of one packet and the next update() goes out as '1's, just as the
+ * AVR ISR does in dos_idle.
+ *
+ * A scenario is a list of timed commands in the DCCCommandParser syntax, one per line,
+ * prefixed with the time in milliseconds:
+ *     0 S 3 50
+ *     250 A 12 1
+ *     1000 E
+ * or built up with the add*() generators. run() replays it and collects
+ *   *latency from the API call to the last bit of the first packet carrying that command,
+ *    per command, as a histogram with power-of-two microsecond buckets;
+ *   *the interval between successive speed packets for each loco;
+ *   *each address's share of the packets on the rails, and its own command latency;
+ *   *how many commands the scheduler rejected (queue full), and apart from those, how many were over the
+ *    rate limit and how many were malformed or need what the build leaves out;
+ *   *every bit checked against the S 9.1 half-period windows, and every preamble against S 9.2's 14 bits,
+ *    whichever timing profile (DCC_waveform_set_timing()) is in use;
+ *   *the host CPU time spent in update() per packet, for comparing the cost of optional features
+ *    (e.g. DCC_TRACE_DEPTH) between builds;
+ *   *optionally, the Timer1 ISR profile (DCCIsrProfile.h) the AVR would see, given a model of how
+ *    late other interrupts (millis(), serial) make it start: setIsrLatency();
+ *   *optionally, every packet read back off the simulated rails by a DCCSniffer, edge by edge, '1's between
+ *    packets included, and checked against the bytes that were sent: setSniffer().
+ *
+ * If the code under test uses millis(), the host harness's millis() should return now()/1000, using
+ * current() to find the simulator running on the calling thread.
+**/
+
+#if !defined(ARDUINO)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include "DCCPacketScheduler.h"
+#include "DCCCommandParser.h"
+#include "DCCSniffer.h"
+
+#define DCC_SIM_DEFAULT_LOOP_PERIOD_US  100
+#define DCC_SIM_HISTOGRAM_BUCKETS       24 //bucket i counts latencies in [2^i, 2^(i+1)) us
+
+/// Packet classes used to pair a command with the packet that delivers it
+#define DCC_SIM_CLASS_SPEED       1
+#define DCC_SIM_CLASS_FUNCTION_1  2
+#define DCC_SIM_CLASS_FUNCTION_2  3
+#define DCC_SIM_CLASS_FUNCTION_3  4
+#define DCC_SIM_CLASS_ACCESSORY   5
+#define DCC_SIM_CLASS_POM         6
+#define DCC_SIM_CLASS_E_STOP      7
+#define DCC_SIM_CLASS_OTHER       0
+#define DCC_SIM_KEY_LONG          0x8000 //in a key, for a long address: short 3 and long 3 are different locos
+
+struct DCCSimEvent
+{
+  uint64_t time; //us
+  char command[24]; //DCCCommandParser syntax, without the newline
+  
+  inline bool operator<(const DCCSimEvent &other) const { return time < other.time; }
+};
+
+struct DCCSimHistogram
+{
+  uint32_t buckets[DCC_SIM_HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint64_t total;
+  uint64_t max;
+  std::vector<uint64_t> samples; //kept for exact percentiles
+  
+  DCCSimHistogram(void);
+  void record(uint64_t value);
+  uint64_t percentile(uint8_t p);
+  void print(FILE *out, const char *name);
+};
+
+struct DCCSimAddressStats
+{
+  uint32_t packets; //packets for this address put on the rails
+  DCCSimHistogram latency; //of commands for this address
+  
+  DCCSimAddressStats(void) : packets(0) {}
+};
+
+class DCCSimulator
+{
+  public:
+    DCCSimulator(DCCPacketScheduler &new_scheduler);
+    
+    //scenario construction
+    bool loadScript(const char *script); //returns false on a malformed line
+    bool loadFile(const char *path); //a recorded script; returns false if unreadable or malformed
+    void addCommand(uint64_t time_us, const char *command);
+    void addThrottle(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us);
+    void addAccessoryBurst(uint64_t time_us, uint16_t first_address, uint8_t count);
+    void addEStop(uint64_t time_us);
+    inline void setLoopPeriod(uint32_t period_us) { loop_period = period_us; }
+    //the rest of loop(), called before every update(), e.g. DCCAutomation::update(); its host time is measured
+    inline void setLoopHook(void (*new_hook)(void *), void *new_context) { hook = new_hook; hook_context = new_context; }
+    //every ISR starts base + [0, jitter] ticks late (uniformly) and runs for duration ticks
+    void setIsrLatency(uint16_t base_ticks, uint16_t jitter_ticks, uint16_t duration_ticks);
+    //decode the rail signal with new_sniffer (set up by the caller), or stop if NULL
+    inline void setSniffer(DCCSniffer *new_sniffer) { sniffer = new_sniffer; }
+    
+    //runs the scenario from the current simulated time until end_us
+    void run(uint64_t end_us);
+    void report(FILE *out);
+    //the headline results as one JSON object, for regression tracking (see DCCBenchmark.h)
+    void writeResults(FILE *out);
+    //the build profile (DCCConfig.h) this was compiled with: features, queue depths and RAM against the budget
+    static void reportBuild(FILE *out);
+    
+    inline uint64_t now(void) { return clock; }
+    //the simulator last run() on this thread, or NULL
+    static DCCSimulator *current(void);
+    
+    //the commands addThrottle() adds, for scenarios built elsewhere (see DCCLayoutSimulator.h)
+    static void throttleEvents(uint16_t address, uint32_t updates_per_second, uint64_t start_us, uint64_t end_us,
+                               std::vector<DCCSimEvent> &out);
+    
+    //packet classification, shared with anything else that inspects the rails
+    static uint8_t classify(const uint8_t *packet, uint8_t size, uint16_t *address, uint8_t *address_kind = 0);
+    //a packet's class, address and kind as one key: class << 16 | address, with DCC_SIM_KEY_LONG for a long address
+    static uint32_t packetKey(const uint8_t *packet, uint8_t size);
+    //the key of the packet a DCCCommandParser command will produce, so its latency can be measured;
+    //0 if it produces none. F produces DCC_SIM_CLASS_FUNCTION_1 through _3.
+    static uint32_t commandKey(const char *command);
+    //the key per_address, refresh_interval and the like keep a loco under: short 3 and long 3 are different locos
+    static inline uint16_t addressKey(uint16_t address, uint8_t address_kind)
+    {
+      return (address_kind == DCC_LONG_ADDRESS) ? (address | DCC_SIM_KEY_LONG) : address;
+    }
+
+    //results
+    DCCSimHistogram latency;
+    std::map<uint16_t, DCCSimHistogram> refresh_interval; //per loco, by addressKey()
+    std::map<uint16_t, DCCSimAddressStats> per_address; //by addressKey()
+    uint32_t commands_issued;
+    uint32_t commands_rejected; //by the scheduler: queue full
+    uint32_t commands_limited; //over the rate limit
+    uint32_t commands_malformed; //or needing a packet kind or speed step mode the build leaves out
+    uint32_t packets_sent;
+    uint32_t idle_packets_sent;
+    uint64_t update_ns; //host time spent in update() calls that sent a packet
+    uint64_t hook_ns; //host time spent in the loop hook
+    uint64_t hook_max_ns; //in any one call
+    uint32_t hook_calls;
+    uint32_t timing_violations; //out-of-window bits and short preambles
+    uint8_t shortest_preamble; //in bits
+    uint32_t sniffer_mismatches; //packets sent that the sniffer did not read back byte for byte
+
+  private:
+    void issue(const char *command, uint64_t time);
+    void packetSent(void); //called as the last bit of a packet leaves the rails
+    void profileIsr(void); //run the ISR latency model over the packet just sent
+    void checkTiming(void); //check the packet just sent against the spec
+    void sniff(void); //feed the packet just sent, and the '1's before it, to the sniffer
+    
+    DCCPacketScheduler &scheduler;
+    DCCCommandParser parser;
+    std::vector<DCCSimEvent> events; //sorted by time from next_event on, unless unsorted
+    size_t next_event;
+    bool unsorted; //an event was added out of order since run() last sorted them
+    uint64_t clock;
+    uint32_t loop_period;
+    void (*hook)(void *);
+    void *hook_context;
+    std::map<uint32_t, uint64_t> pending; //(class << 16 | address) -> time of the API call
+    std::map<uint16_t, uint64_t> last_speed_packet; //per loco, by addressKey()
+    bool isr_model;
+    uint16_t isr_base;
+    uint16_t isr_jitter;
+    uint16_t isr_duration;
+    uint32_t isr_random;
+    DCCSniffer *sniffer;
+    uint64_t last_packet_end; //us
+};
+
+#endif //!ARDUINO
+
+#endif //__DCCSIMULATOR_H__
@@ -0,0 +1,238 @@
+#include "DCCCapture.h"
+
+#if DCC_SNIFFER || !defined(ARDUINO) //DCCSniffer.h stops sketches that use the sniffer without it
+
+#include "DCCSniffer.h"
+
+/// The S 9.1 windows in capture ticks, worked out at compile time so classify() only compares
+#define ONE_RX_MIN    (DCC_ONE_HALF_PERIOD_RX_MIN_US * DCC_CAPTURE_TICKS_PER_US)
+#define ONE_RX_MAX    (DCC_ONE_HALF_PERIOD_RX_MAX_US * DCC_CAPTURE_TICKS_PER_US)
+#define ZERO_RX_MIN   (DCC_ZERO_HALF_PERIOD_RX_MIN_US * DCC_CAPTURE_TICKS_PER_US)
+#define ZERO_RX_MAX   (DCC_ZERO_HALF_PERIOD_RX_MAX_US * DCC_CAPTURE_TICKS_PER_US)
+#define ONE_TX_MIN    (DCC_ONE_HALF_PERIOD_MIN_US * DCC_CAPTURE_TICKS_PER_US)
+#define ONE_TX_MAX    (DCC_ONE_HALF_PERIOD_MAX_US * DCC_CAPTURE_TICKS_PER_US)
+#define ZERO_TX_MIN   (DCC_ZERO_HALF_PERIOD_MIN_US * DCC_CAPTURE_TICKS_PER_US)
+#define ZERO_TX_MAX   (DCC_ZERO_HALF_PERIOD_MAX_US * DCC_CAPTURE_TICKS_PER_US)
+
+DCCSniffer::DCCSniffer(DCC_sniffer_handler_t new_handler) : handler(new_handler), packet_size(0), size(0), current(0), bits(0),
+    first(0), state(DCC_SNIFF_PREAMBLE), ones(0), preamble(0), started(false), last_edge(0)
+{
+  resetStats();
+}
+
+void DCCSniffer::setup(void)
+{
+  DCC_capture_setup();
+  started = false;
+  state = DCC_SNIFF_PREAMBLE;
+  ones = 0;
+}
+
+void DCCSniffer::resetStats(void)
+{
+  packets = xor_errors = framing_errors = out_of_spec = 0;
+  overruns = 0;
+  shortest_preamble = 0xFF;
+  idles = speeds = e_stops = functions = accessories = programming = resets = others = 0;
+}
+
+void DCCSniffer::update(uint8_t budget)
+{
+  uint16_t edges[8];
+  while(budget)
+  {
+    uint8_t count = DCC_capture_read(edges, (budget < sizeof(edges)/sizeof(edges[0])) ? budget : sizeof(edges)/sizeof(edges[0]));
+    if(!count)
+      break;
+    for(uint8_t i = 0; i < count; ++i)
+      edge(edges[i]);
+    budget -= count;
+  }
+  overruns = DCC_capture_overruns();
+}
+
+#if !defined(ARDUINO)
+void DCCSniffer::decodeTimings(const uint16_t *timings, uint16_t count)
+{
+  while(count)
+  {
+    uint16_t taken = DCC_host_capture_timings(timings, count);
+    timings += taken;
+    count -= taken;
+    update(DCC_CAPTURE_RING);
+  }
+}
+#endif
+
+void DCCSniffer::edge(uint16_t ticks)
+{
+  if(!started)
+  {
+    started = true;
+    last_edge = ticks;
+    return;
+  }
+  uint16_t length = ticks - last_edge; //the timer wraps every 32ms, far longer than any half-period
+  last_edge = ticks;
+  half(classify(length));
+}
+
+uint8_t DCCSniffer::classify(uint16_t ticks)
+{
+  if(ticks >= ONE_RX_MIN && ticks <= ONE_RX_MAX)
+  {
+    if(ticks < ONE_TX_MIN || ticks > ONE_TX_MAX)
+      ++out_of_spec;
+    return DCC_SNIFF_ONE;
+  }
+  if(ticks >= ZERO_RX_MIN && ticks <= ZERO_RX_MAX)
+  {
+    if(ticks < ZERO_TX_MIN || ticks > ZERO_TX_MAX)
+      ++out_of_spec;
+    return DCC_SNIFF_ZERO;
+  }
+  return DCC_SNIFF_INVALID;
+}
+
+void DCCSniffer::half(uint8_t h)
+{
+  switch(state)
+  {
+    case DCC_SNIFF_PREAMBLE:
+      if(h == DCC_SNIFF_ONE)
+      {
+        if(ones < 255)
+          ++ones;
+      }
+      else if(h == DCC_SNIFF_ZERO && ones >= 2*DCC_RX_PREAMBLE_BITS)
+      {
+        //the first '0' after a preamble is the start bit, so this is the first half of a bit
+        preamble = ones / 2;
+        state = DCC_SNIFF_START;
+      }
+      else
+      {
+        ones = 0; //too few '1's to be a preamble; not an error, since no packet had begun
+      }
+      return;
+    case DCC_SNIFF_START:
+      if(h != DCC_SNIFF_ZERO)
+      {
+        restart(h);
+        return;
+      }
+      size = 0;
+      bits = 0;
+      current = 0;
+      state = DCC_SNIFF_FIRST;
+      return;
+    case DCC_SNIFF_FIRST:
+      if(h == DCC_SNIFF_INVALID)
+      {
+        restart(h);
+        return;
+      }
+      if(bits == 8 && h == DCC_SNIFF_ONE)
+      {
+        //the packet end bit; it may be cut short by a RailCom cutout, so don't wait for its second half
+        finish();
+        state = DCC_SNIFF_PREAMBLE;
+        ones = 0; //the end bit's second half rounds away in the next preamble
+        return;
+      }
+      first = h;
+      state = DCC_SNIFF_SECOND;
+      return;
+    case DCC_SNIFF_SECOND:
+      if(h != first)
+      {
+        restart(h);
+        return;
+      }
+      state = DCC_SNIFF_FIRST;
+      if(bits == 8) //a '0' separator: another byte follows
+      {
+        bits = 0;
+        current = 0;
+        return;
+      }
+      current = (current << 1) | h;
+      if(++bits == 8)
+      {
+        if(size == DCC_MAX_PACKET_SIZE)
+        {
+          restart(DCC_SNIFF_INVALID); //too long to be a packet
+          return;
+        }
+        received[size++] = current;
+      }
+      return;
+  }
+}
+
+void DCCSniffer::restart(uint8_t h)
+{
+  ++framing_errors;
+  state = DCC_SNIFF_PREAMBLE;
+  ones = (h == DCC_SNIFF_ONE) ? 1 : 0;
+}
+
+void DCCSniffer::finish(void)
+{
+  if(size < 3)
+  {
+    ++framing_errors;
+    return;
+  }
+  uint8_t XOR = 0;
+  for(uint8_t i = 0; i < size; ++i)
+    XOR ^= received[i];
+  if(XOR)
+  {
+    ++xor_errors;
+    return;
+  }
+
+  ++packets;
+  if(preamble < shortest_preamble)
+    shortest_preamble = preamble;
+  memcpy(bytes, received, size);
+  packet_size = size;
+  if(!packet.setBitstream(bytes, packet_size))
+  {
+    ++others;
+  }
+  else
+  {
+    switch(packet.getKind())
+    {
+      case idle_packet_kind:
+        ++idles;
+        break;
+      case speed_packet_kind:
+        ++speeds;
+        break;
+      case e_stop_packet_kind:
+        ++e_stops;
+        break;
+      case function_packet_1_kind:
+      case function_packet_2_kind:
+      case function_packet_3_kind:
+        ++functions;
+        break;
+      case basic_accessory_packet_kind:
+        ++accessories;
+        break;
+      case ops_mode_programming_kind:
+        ++programming;
+        break;
+      case reset_packet_kind:
+        ++resets;
+        break;
+    }
+  }
+  if(handler)
+    handler(packet, bytes, packet_size);
+}
+
+#endif //DCC_SNIFFER || !ARDUINO
@@ -0,0 +1,113 @@
+#ifndef __DCCSNIFFER_H__
+#define __DCCSNIFFER_H__
+
+#include "Arduino.h"
+#include "DCCPacket.h"
+#include "DCCCapture.h"
+
+/**
+ * Track sniffer: reads the packets on a layout's rails, whoever put them there, for debugging a layout with
+ * other vendors' boosters or a second command station on it. The rail signal goes, through an optocoupler
+ * or the like, to the capture input (DCCCapture.h), whose ISR timestamps every edge onto a lock-free ring;
+ * update() takes the edges off the ring and decodes them:
+ *   *each half-period is classed as a '1' or a '0' by the windows S 9.1 asks a decoder to accept
+ *    (52-64us and 90-10000us), and anything else is invalid;
+ *   *a preamble of at least DCC_RX_PREAMBLE_BITS '1's followed by a '0' starts a packet, the '0' settling
+ *    which half-period is the first of each bit;
+ *   *the two halves of a bit must agree, and bytes follow each other with a '0' separator up to the '1' end bit,
+ *    at most DCC_MAX_PACKET_SIZE of them;
+ *   *the bytes must XOR to zero, and are then read back into a DCCPacket (DCCPacket::setBitstream()).
+ * Every good packet goes to the handler, if one is set, both as a DCCPacket and as the bytes on the rails.
+ * Decoding costs a few comparisons per edge, far less than the 58us between edges of the densest signal,
+ * so update() keeps up at full bit rate as long as loop() comes round before the ring fills: DCC_CAPTURE_RING
+ * edges, about 3.7ms of '1's at the default 64.
+ *
+ * The sniffer takes over the capture timer (DCCCapture.h): Timer1, the waveform generator's, except on a Mega.
+ * It is only built on AVR with DCC_SNIFFER non-zero, in the build flags. On host builds, decodeTimings() feeds it half-period timing arrays through the same ring, and
+ * DCCSimulator::setSniffer() checks that every packet the simulated command station sends reads back the same.
+**/
+
+#if !DCC_SNIFFER && defined(ARDUINO)
+#error "the track sniffer needs DCC_SNIFFER=1 in the build flags (see DCCCapture.h)"
+#endif
+
+#define DCC_SNIFFER_BUDGET    32 //edges decoded per update() call, at most
+
+typedef void (*DCC_sniffer_handler_t)(DCCPacket &packet, const uint8_t *bytes, uint8_t size);
+
+//half-period classes
+#define DCC_SNIFF_ONE         1
+#define DCC_SNIFF_ZERO        0
+#define DCC_SNIFF_INVALID     2
+
+//decoder states
+#define DCC_SNIFF_PREAMBLE    0 //counting '1' half-periods
+#define DCC_SNIFF_START       1 //had the first half of the start bit
+#define DCC_SNIFF_FIRST       2 //waiting for the first half of a bit
+#define DCC_SNIFF_SECOND      3 //waiting for its second half
+
+class DCCSniffer
+{
+  public:
+    DCCSniffer(DCC_sniffer_handler_t new_handler = 0);
+
+    void setup(void); //takes the timer over and starts capturing
+    inline void setHandler(DCC_sniffer_handler_t new_handler) { handler = new_handler; }
+
+    //to be called periodically within loop(): decodes at most budget edges from the capture ring
+    void update(uint8_t budget = DCC_SNIFFER_BUDGET);
+    //decode one edge, timestamped in capture ticks
+    void edge(uint16_t ticks);
+#if !defined(ARDUINO)
+    //decode count half-periods, in microseconds, through the capture ring: DCC_host_timings[], say
+    void decodeTimings(const uint16_t *timings, uint16_t count);
+#endif
+
+    //the last good packet, and its bytes on the rails
+    inline DCCPacket &getLast(void) { return packet; }
+    inline const uint8_t *getBytes(void) { return bytes; }
+    inline uint8_t getSize(void) { return packet_size; }
+
+    //zero every counter below
+    void resetStats(void);
+
+    //statistics
+    uint32_t packets; //good packets
+    uint32_t xor_errors; //framed properly, but the bytes did not XOR to zero
+    uint32_t framing_errors; //a bit whose halves disagreed, an invalid half-period, or a packet too short or too long
+    uint32_t out_of_spec; //half-periods a decoder accepts but a command station may not send (S 9.1)
+    uint16_t overruns; //edges the capture ring had no room for
+    uint8_t shortest_preamble; //in bits, of a good packet
+    //good packets by kind (DCCPacket.h)
+    uint32_t idles;
+    uint32_t speeds;
+    uint32_t e_stops;
+    uint32_t functions;
+    uint32_t accessories;
+    uint32_t programming;
+    uint32_t resets;
+    uint32_t others; //valid, but not a kind DCCPacket builds
+
+  public: //protected:
+    uint8_t classify(uint16_t ticks);
+    void half(uint8_t h);
+    void restart(uint8_t h); //abandon the packet; h may begin a preamble
+    void finish(void); //the end bit has begun
+
+    DCC_sniffer_handler_t handler;
+    DCCPacket packet;
+    uint8_t bytes[DCC_MAX_PACKET_SIZE]; //of the last good packet
+    uint8_t packet_size;
+    uint8_t received[DCC_MAX_PACKET_SIZE]; //of the packet being decoded
+    uint8_t size;
+    uint8_t current; //byte being shifted in
+    uint8_t bits; //of current
+    uint8_t first; //class of the first half of the bit
+    uint8_t state;
+    uint8_t ones; //'1' half-periods in the preamble so far, at most 255
+    uint8_t preamble; //bits, of the packet being decoded
+    bool started; //an edge has been seen, so last_edge is valid
+    uint16_t last_edge;
+};
+
+#endif //__DCCSNIFFER_H__
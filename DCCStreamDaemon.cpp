@@ -0,0 +1,413 @@
+#include "DCCStreamDaemon.h"
+
+#if !defined(ARDUINO)
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <chrono>
+#include "DCCHardwareHost.h"
+
+static uint64_t now_us(void)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Raw 8N1 at baud, or as it is if baud isn't a standard rate
+static void make_raw(int fd, uint32_t baud)
+{
+  struct termios tio;
+  if(tcgetattr(fd, &tio))
+    return;
+  cfmakeraw(&tio);
+  speed_t speed;
+  switch(baud)
+  {
+    case 9600: speed = B9600; break;
+    case 19200: speed = B19200; break;
+    case 38400: speed = B38400; break;
+    case 57600: speed = B57600; break;
+    case 115200: speed = B115200; break;
+    case 230400: speed = B230400; break;
+    case 460800: speed = B460800; break;
+    case 500000: speed = B500000; break;
+    case 1000000: speed = B1000000; break;
+    default: speed = 0;
+  }
+  if(speed)
+  {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+  tcsetattr(fd, TCSANOW, &tio);
+}
+
+DCCStreamDaemon::DCCStreamDaemon(DCCPacketScheduler &new_scheduler) : bytes_out(0), bytes_in(0), frames_sent(0), frames_urgent(0),
+    frames_dropped(0), board_idles(0), commands_issued(0), commands_rejected(0), board_depth(0), scheduler(new_scheduler),
+    parser(new_scheduler), link(-1), input(-1), output(-1), own_link(false), baud(115200), window(DCC_DAEMON_DEFAULT_WINDOW),
+    synced(false), sync_time(0), seq(0), board_done(0), board_dropped(0), board_idle_count(0), last_urgent(false),
+    status_received(0), start(now_us())
+{
+}
+
+DCCStreamDaemon::~DCCStreamDaemon(void)
+{
+  if(own_link)
+    close(link);
+}
+
+bool DCCStreamDaemon::open(const char *device, uint32_t new_baud)
+{
+  int fd = ::open(device, O_RDWR | O_NOCTTY);
+  if(fd < 0)
+    return false;
+  make_raw(fd, new_baud);
+  attach(fd, new_baud);
+  own_link = true;
+  return true;
+}
+
+void DCCStreamDaemon::attach(int fd, uint32_t new_baud)
+{
+  if(own_link)
+    close(link);
+  own_link = false;
+  link = fd;
+  baud = new_baud;
+  synced = false;
+  status_received = 0;
+  in_flight.clear();
+  start = now_us();
+  sendSync();
+}
+
+void DCCStreamDaemon::setInput(int in_fd, int out_fd)
+{
+  input = in_fd;
+  output = out_fd;
+}
+
+char DCCStreamDaemon::issue(const char *command)
+{
+  for(const char *c = command; *c; ++c)
+    parser.parse(*c);
+  char result = parser.parse('\n');
+  ++commands_issued;
+  if(result != DCC_COMMAND_OK)
+  {
+    ++commands_rejected;
+    return result;
+  }
+  uint64_t time = now_us();
+  uint32_t key = DCCSimulator::commandKey(command);
+  if(!key)
+    return result;
+  if((key >> 16) == DCC_SIM_CLASS_FUNCTION_1) //setFunctions() produces all three function groups
+  {
+    pending[(DCC_SIM_CLASS_FUNCTION_2 << 16) | (key & 0xFFFF)] = time;
+    pending[(DCC_SIM_CLASS_FUNCTION_3 << 16) | (key & 0xFFFF)] = time;
+  }
+  pending[key] = time;
+  return result;
+}
+
+void DCCStreamDaemon::write(const uint8_t *bytes, uint8_t size)
+{
+  while(size)
+  {
+    ssize_t n = ::write(link, bytes, size);
+    if(n <= 0)
+      return; //the link is gone; poll() will find out
+    bytes += n;
+    size -= n;
+    bytes_out += n;
+  }
+}
+
+void DCCStreamDaemon::sendSync(void)
+{
+  //far from anything the board has reported, so a status from before the sync can't be taken for one after
+  seq = board_done + 128;
+  uint8_t frame[4] = {DCC_STREAM_SYNC, seq, 0, seq};
+  write(frame, 4);
+  sync_time = now_us();
+  in_flight.clear();
+}
+
+void DCCStreamDaemon::pump(void)
+{
+  if(!synced)
+    return;
+  uint8_t limit = (board_depth && board_depth < window) ? board_depth : window;
+  while((uint8_t)(seq - board_done) < limit)
+  {
+    //the first e-stop packet goes ahead of whatever the board has buffered
+    bool urgent = scheduler.e_stop_queue.notEmpty() && !last_urgent;
+    scheduler.update();
+    if(DCC_waveform_ready()) //nothing went out: the track is tripped
+      return;
+    last_urgent = scheduler.e_stop_queue.notEmpty() || urgent;
+    bool queued = scheduler.e_stop_queue.notEmpty() || scheduler.high_priority_queue.notEmpty() ||
+                  scheduler.low_priority_queue.notEmpty() || scheduler.repeat_queue.notEmpty();
+    if(DCC_host_packet[0] == 0xFF && !queued) //nothing to send; the board's own idles will do
+    {
+      DCC_host_waveform_complete();
+      return;
+    }
+    Frame f;
+    f.sent = now_us();
+    f.duration = DCC_host_packet_duration();
+    f.size = DCC_host_packet_size;
+    memcpy(f.packet, DCC_host_packet, f.size);
+    DCC_host_waveform_complete();
+
+    uint8_t frame[DCC_STREAM_FRAME_MAX];
+    frame[0] = DCC_STREAM_SYNC;
+    frame[1] = seq;
+    frame[2] = f.size | (urgent ? DCC_STREAM_URGENT : 0);
+    uint8_t sum = frame[1] + frame[2];
+    for(uint8_t i = 0; i < f.size; ++i)
+    {
+      frame[3 + i] = f.packet[i];
+      sum += f.packet[i];
+    }
+    frame[3 + f.size] = sum;
+    write(frame, 4 + f.size);
+    if(urgent) //the board drops everything before this one, and says so in its next status
+      ++frames_urgent;
+    in_flight.push_back(f);
+    ++seq;
+    ++frames_sent;
+  }
+}
+
+void DCCStreamDaemon::receive(uint8_t b)
+{
+  if(!status_received)
+  {
+    if(b == DCC_STREAM_STATUS)
+      status_received = 1;
+    return;
+  }
+  status_frame[status_received++] = b;
+  if(status_received < DCC_STREAM_STATUS_SIZE)
+    return;
+  status_received = 0;
+  if((uint8_t)(status_frame[1] + status_frame[2] + status_frame[3] + status_frame[4]) == status_frame[5])
+    status(status_frame + 1);
+}
+
+void DCCStreamDaemon::status(const uint8_t *bytes)
+{
+  uint64_t time = now_us();
+  board_depth = bytes[3];
+  if(!synced)
+  {
+    if(bytes[0] != seq) //from before the sync
+    {
+      board_done = bytes[0];
+      return;
+    }
+    synced = true;
+    board_done = bytes[0];
+    board_dropped = bytes[1];
+    board_idle_count = bytes[2];
+    return;
+  }
+  uint8_t finished = bytes[0] - board_done;
+  uint8_t dropped = bytes[1] - board_dropped;
+  board_idles += (uint8_t)(bytes[2] - board_idle_count);
+  board_done = bytes[0];
+  board_dropped = bytes[1];
+  board_idle_count = bytes[2];
+  frames_dropped += dropped;
+  //the board can't say which frames it dropped; those lost or flushed come before those it sent, as a rule
+  for(uint8_t i = 0; i < finished && !in_flight.empty(); ++i)
+  {
+    if(i >= dropped)
+      packetStarted(in_flight.front(), time);
+    in_flight.pop_front();
+  }
+}
+
+void DCCStreamDaemon::packetStarted(const Frame &frame, uint64_t time)
+{
+  residence.record(time - frame.sent);
+  std::map<uint32_t, uint64_t>::iterator p = pending.find(DCCSimulator::packetKey(frame.packet, frame.size));
+  if(p != pending.end())
+  {
+    latency.record(time + frame.duration - p->second);
+    pending.erase(p);
+  }
+}
+
+bool DCCStreamDaemon::poll(int timeout_ms)
+{
+  if(link < 0)
+    return false;
+  if(!synced && (now_us() - sync_time >= DCC_DAEMON_SYNC_RETRY_MS*1000ULL))
+    sendSync();
+  pump();
+
+  struct pollfd fds[2];
+  fds[0].fd = link;
+  fds[0].events = POLLIN;
+  fds[1].fd = input;
+  fds[1].events = POLLIN;
+  if(::poll(fds, (input >= 0) ? 2 : 1, timeout_ms) > 0)
+  {
+    uint8_t buffer[256];
+    if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+      ssize_t n = read(link, buffer, sizeof(buffer));
+      if(n <= 0)
+        return false;
+      bytes_in += n;
+      for(ssize_t i = 0; i < n; ++i)
+        receive(buffer[i]);
+    }
+    if((input >= 0) && (fds[1].revents & (POLLIN | POLLHUP)))
+    {
+      ssize_t n = read(input, buffer, sizeof(buffer));
+      if(n <= 0)
+        input = -1; //end of input; keep the layout running
+      for(ssize_t i = 0; i < n; ++i)
+      {
+        if(buffer[i] != '\n' && buffer[i] != '\r')
+        {
+          line += (char)buffer[i];
+          continue;
+        }
+        if(line.empty())
+          continue;
+        char reply[2] = {issue(line.c_str()), '\n'};
+        if(output >= 0 && ::write(output, reply, 2) < 0)
+          output = -1;
+        line.clear();
+      }
+    }
+  }
+  pump();
+  return true;
+}
+
+void DCCStreamDaemon::run(uint32_t duration_ms)
+{
+  uint64_t end = now_us() + duration_ms*1000ULL;
+  while(now_us() < end && poll(1))
+    ;
+}
+
+void DCCStreamDaemon::report(FILE *out)
+{
+  double seconds = (now_us() - start)/1e6;
+  double capacity = seconds*baud/10; //bytes each way, 8N1
+  fprintf(out, "link: %u baud, %.1fs, out %llu bytes (%.1f%%), in %llu bytes (%.1f%%)\n", baud, seconds,
+          (unsigned long long)bytes_out, capacity ? 100*bytes_out/capacity : 0.0,
+          (unsigned long long)bytes_in, capacity ? 100*bytes_in/capacity : 0.0);
+  fprintf(out, "board: %s, depth %u, window %u; frames sent %u (%u urgent), dropped %u; idles with the ring empty %u\n",
+          synced ? "synced" : "not synced", board_depth, window, frames_sent, frames_urgent, frames_dropped, board_idles);
+  fprintf(out, "commands: %u issued, %u rejected, %u awaiting their first packet\n", commands_issued, commands_rejected,
+          (unsigned)pending.size());
+  latency.print(out, "latency");
+  residence.print(out, "frame residence");
+}
+
+/*****************************/
+
+DCCStreamBoard::DCCStreamBoard(void) : master(-1), running(false)
+{
+  name[0] = 0;
+}
+
+DCCStreamBoard::~DCCStreamBoard(void)
+{
+  stop();
+}
+
+bool DCCStreamBoard::start(void)
+{
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master < 0)
+    return false;
+  if(grantpt(master) || unlockpt(master) || ptsname_r(master, name, sizeof(name)))
+  {
+    close(master);
+    master = -1;
+    return false;
+  }
+  make_raw(master, 115200);
+  rails.clear();
+  running = true;
+  worker = std::thread(&DCCStreamBoard::work, this);
+  return true;
+}
+
+void DCCStreamBoard::stop(void)
+{
+  if(!running)
+    return;
+  running = false;
+  worker.join();
+  close(master);
+  master = -1;
+}
+
+void DCCStreamBoard::work(void)
+{
+  streamer.setup(); //this thread's own host backend
+  uint64_t packet_end = 0;
+  uint64_t last_status = 0;
+  while(running)
+  {
+    uint64_t time = now_us();
+    bool due = false;
+    if(time >= packet_end)
+    {
+      DCC_host_waveform_complete(); //the last bit of the packet has left
+      if(streamer.feed())
+      {
+        DCCStreamRailPacket p;
+        p.time = time;
+        p.size = DCC_host_packet_size;
+        memcpy(p.packet, DCC_host_packet, p.size);
+        rails.push_back(p);
+        packet_end = time + DCC_host_packet_duration();
+        due = true;
+      }
+    }
+    if(due || time - last_status >= DCC_STREAM_STATUS_INTERVAL*1000ULL)
+    {
+      //nobody may have the other end open yet; the status just goes again next time
+      if(::write(master, streamer.getStatus(), DCC_STREAM_STATUS_SIZE) == DCC_STREAM_STATUS_SIZE)
+        last_status = time;
+    }
+
+    struct pollfd fd;
+    fd.fd = master;
+    fd.events = POLLIN;
+    uint64_t wait = packet_end > now_us() ? packet_end - now_us() : 0;
+    struct timespec timeout = {(time_t)(wait/1000000), (long)(wait%1000000)*1000};
+    if(ppoll(&fd, 1, &timeout, NULL) <= 0)
+      continue;
+    if(!(fd.revents & POLLIN)) //hung up: nobody has the device open
+    {
+      nanosleep(&timeout, NULL);
+      continue;
+    }
+    {
+      uint8_t buffer[256];
+      ssize_t n = read(master, buffer, sizeof(buffer));
+      for(ssize_t i = 0; i < n; ++i)
+      {
+        if(streamer.receive(buffer[i]) && ::write(master, streamer.getStatus(), DCC_STREAM_STATUS_SIZE) > 0)
+          last_status = now_us();
+      }
+    }
+  }
+}
+
+#endif //!ARDUINO
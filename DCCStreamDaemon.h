@@ -0,0 +1,165 @@
+#ifndef __DCCSTREAMDAEMON_H__
+#define __DCCSTREAMDAEMON_H__
+
+/**
+ * The host half of a split command station, for Linux builds only (see DCCPacketStreamer.h for the board).
+ * DCCStreamDaemon runs a full DCCPacketScheduler, built with DCC_BUILD_PROFILE=DCC_BUILD_HOST for queues and
+ * a roster far beyond the board's RAM, against the host waveform backend: every packet the scheduler puts
+ * out is framed and written to the serial link instead of a timer, keeping no more than the window of
+ * frames outstanding on the board. Text commands (DCCCommandParser syntax, one per line) are read from
+ * an input descriptor, stdin say, and answered on an output one, exactly as the serial sketch would.
+ *
+ * The window trades latency for slack: a new command waits behind every frame outstanding, at 5-8ms each,
+ * while the board keeps the rails busy for as long as the host is held up. Idle packets are only streamed
+ * when the scheduler puts one out between packets for the same address; with nothing queued at all, the
+ * board's own idles fill in. The first e-stop packet goes as an urgent frame, replacing what the board
+ * has buffered.
+ *
+ * report() gives
+ *   *link utilization each way, against the baud rate;
+ *   *latency from a command reaching the daemon to the last bit of the first packet carrying it, as the
+ *    board reports the packet going to the waveform, plus the packet's own length;
+ *   *how long frames sat between the daemon and the waveform;
+ *   *frames the board dropped (lost on the link or flushed), and idles it put out with its ring empty.
+ *
+ * DCCStreamBoard stands in for the board, for testing end to end: DCCPacketStreamer on a thread of its
+ * own, with its own host waveform backend playing each packet out in real time, behind a pseudo-terminal
+ * the daemon opens as it would the real serial device.
+ *
+ * The program's millis() should return the time since start-up from CLOCK_MONOTONIC.
+**/
+
+#if !defined(ARDUINO)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "DCCPacketScheduler.h"
+#include "DCCCommandParser.h"
+#include "DCCPacketStreamer.h"
+#include "DCCSimulator.h"
+
+#define DCC_DAEMON_DEFAULT_WINDOW   8 //frames
+#define DCC_DAEMON_SYNC_RETRY_MS    250
+
+class DCCStreamDaemon
+{
+  public:
+    DCCStreamDaemon(DCCPacketScheduler &new_scheduler);
+    ~DCCStreamDaemon(void);
+
+    //open a serial device raw at baud (one of the standard rates); false if it can't be
+    bool open(const char *device, uint32_t baud);
+    //use a descriptor already open; baud is only used to work out the link utilization
+    void attach(int fd, uint32_t baud);
+    //where text commands come from and replies go; -1 for neither
+    void setInput(int in_fd, int out_fd);
+    //frames to keep outstanding on the board; never more than the depth it reports
+    inline void setWindow(uint8_t packets) { window = packets; }
+
+    //a command, as if it had arrived on the input; returns the parser's status
+    char issue(const char *command);
+    //wait up to timeout_ms for the link or the input, then keep the board's window full.
+    //Returns false once the link is closed.
+    bool poll(int timeout_ms);
+    //poll() until duration_ms have passed, or the link closes
+    void run(uint32_t duration_ms);
+    void report(FILE *out);
+
+    inline bool isSynced(void) { return synced; }
+
+    //results
+    DCCSimHistogram latency; //command to the last bit of its first packet
+    DCCSimHistogram residence; //frame written to frame sent to the waveform
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    uint32_t frames_sent;
+    uint32_t frames_urgent;
+    uint32_t frames_dropped; //by the board
+    uint32_t board_idles; //put out by the board with its ring empty
+    uint32_t commands_issued;
+    uint32_t commands_rejected;
+    uint8_t board_depth; //0 until the board has reported it
+
+  private:
+    struct Frame
+    {
+      uint64_t sent; //us
+      uint32_t duration; //us on the rails
+      uint8_t size;
+      uint8_t packet[DCC_MAX_PACKET_SIZE];
+    };
+
+    void sendSync(void);
+    void pump(void); //stream packets until the window is full, or the scheduler has nothing
+    void write(const uint8_t *bytes, uint8_t size);
+    void receive(uint8_t b); //a byte from the board
+    void status(const uint8_t *bytes); //a valid status frame, from DONE on
+    void packetStarted(const Frame &frame, uint64_t time);
+
+    DCCPacketScheduler &scheduler;
+    DCCCommandParser parser;
+    int link;
+    int input;
+    int output;
+    bool own_link;
+    uint32_t baud;
+    uint8_t window;
+
+    bool synced;
+    uint64_t sync_time; //us, when the last sync frame went
+    uint8_t seq; //of the next frame
+    uint8_t board_done;
+    uint8_t board_dropped;
+    uint8_t board_idle_count;
+    bool last_urgent;
+    std::deque<Frame> in_flight;
+
+    uint8_t status_frame[DCC_STREAM_STATUS_SIZE];
+    uint8_t status_received;
+    std::string line;
+    std::map<uint32_t, uint64_t> pending; //(class << 16 | address) -> time the command arrived
+    uint64_t start; //us
+};
+
+struct DCCStreamRailPacket
+{
+  uint64_t time; //us, as the packet went to the waveform
+  uint8_t size;
+  uint8_t packet[DCC_MAX_PACKET_SIZE];
+};
+
+class DCCStreamBoard
+{
+  public:
+    DCCStreamBoard(void);
+    ~DCCStreamBoard(void);
+
+    //open a pseudo-terminal and start the board behind it; false if there is none to be had
+    bool start(void);
+    //the device for DCCStreamDaemon::open()
+    inline const char *path(void) { return name; }
+    void stop(void);
+
+    //everything the board put on the rails, its own idles included; only once stopped
+    std::vector<DCCStreamRailPacket> rails;
+
+  private:
+    void work(void); //board thread body
+
+    DCCPacketStreamer streamer;
+    int master;
+    char name[64];
+    std::thread worker;
+    std::atomic<bool> running;
+};
+
+#endif //!ARDUINO
+
+#endif //__DCCSTREAMDAEMON_H__
@@ -0,0 +1,220 @@
+#include "DCCTimerWheel.h"
+#include "DCCPacketScheduler.h"
+
+#if DCC_PULSE_TIMERS
+
+DCCTimerWheel::DCCTimerWheel(void) : free_head(0), current(0)
+{
+  for(uint8_t i = 0; i < DCC_PULSE_TIMERS; ++i)
+    next[i] = (i + 1 < DCC_PULSE_TIMERS) ? i + 1 : DCC_WHEEL_NONE;
+  memset(near_slots, DCC_WHEEL_NONE, sizeof(near_slots));
+  memset(far_slots, DCC_WHEEL_NONE, sizeof(far_slots));
+}
+
+uint8_t DCCTimerWheel::allocate(void)
+{
+  uint8_t timer = free_head;
+  if(timer != DCC_WHEEL_NONE)
+  {
+    free_head = next[timer];
+    next[timer] = DCC_WHEEL_NONE;
+  }
+  return timer;
+}
+
+void DCCTimerWheel::release(uint8_t timer)
+{
+  next[timer] = free_head;
+  free_head = timer;
+}
+
+void DCCTimerWheel::start(uint8_t timer, uint16_t ticks)
+{
+  if(!ticks)
+    ticks = 1; //this tick's slot has already been emptied
+  if(ticks > DCC_WHEEL_MAX_TICKS)
+    ticks = DCC_WHEEL_MAX_TICKS;
+  expiry[timer] = current + ticks;
+  insert(timer);
+}
+
+void DCCTimerWheel::insert(uint8_t timer)
+{
+  uint16_t delta = expiry[timer] - current;
+  uint8_t *slot;
+  if(delta < DCC_WHEEL_NEAR_SLOTS)
+    slot = &near_slots[expiry[timer] & (DCC_WHEEL_NEAR_SLOTS-1)];
+  else if(delta < DCC_WHEEL_NEAR_SLOTS * DCC_WHEEL_FAR_SLOTS)
+    slot = &far_slots[(expiry[timer] >> DCC_WHEEL_NEAR_BITS) & (DCC_WHEEL_FAR_SLOTS-1)];
+  else //beyond the far wheel: park in the slot that comes round last, and place it again then
+    slot = &far_slots[((current >> DCC_WHEEL_NEAR_BITS) + DCC_WHEEL_FAR_SLOTS - 1) & (DCC_WHEEL_FAR_SLOTS-1)];
+  next[timer] = *slot;
+  *slot = timer;
+}
+
+uint8_t DCCTimerWheel::tick(void)
+{
+  ++current;
+  if(!(current & (DCC_WHEEL_NEAR_SLOTS-1)))
+  {
+    //the near wheel has gone round: the far slot for the next 32 ticks moves down into it
+    uint8_t *slot = &far_slots[(current >> DCC_WHEEL_NEAR_BITS) & (DCC_WHEEL_FAR_SLOTS-1)];
+    uint8_t timer = *slot;
+    *slot = DCC_WHEEL_NONE;
+    while(timer != DCC_WHEEL_NONE)
+    {
+      uint8_t following = next[timer];
+      insert(timer);
+      timer = following;
+    }
+  }
+  //every timer in this slot is due now
+  uint8_t *slot = &near_slots[current & (DCC_WHEEL_NEAR_SLOTS-1)];
+  uint8_t expired = *slot;
+  *slot = DCC_WHEEL_NONE;
+  return expired;
+}
+
+/*****************************/
+
+DCCAccessoryPulser::DCCAccessoryPulser(void) : waiting_head(DCC_WHEEL_NONE), waiting_tail(DCC_WHEEL_NONE), flight_head(DCC_WHEEL_NONE),
+    active(0), max_active(0), last_tick(0)
+{
+}
+
+void DCCAccessoryPulser::setCurrentBudget(uint16_t budget_ma, uint16_t pulse_ma)
+{
+  if(!budget_ma || !pulse_ma)
+  {
+    max_active = 0;
+    return;
+  }
+  uint16_t coils = budget_ma / pulse_ma;
+  max_active = (coils < 1) ? 1 : ((coils > 255) ? 255 : coils);
+}
+
+bool DCCAccessoryPulser::pulse(uint16_t address, uint8_t function, uint16_t duration_ms)
+{
+  uint8_t timer = wheel.allocate();
+  if(timer == DCC_WHEEL_NONE)
+    return false;
+  pulses[timer].address = address;
+  pulses[timer].function = function & 0x03;
+  pulses[timer].ticks = (duration_ms + DCC_PULSE_TICK_MS - 1) / DCC_PULSE_TICK_MS;
+  //to the back of the line
+  if(waiting_tail == DCC_WHEEL_NONE)
+    waiting_head = timer;
+  else
+    wheel.next[waiting_tail] = timer;
+  waiting_tail = timer;
+  return true;
+}
+
+uint8_t DCCAccessoryPulser::getWaiting(void)
+{
+  uint8_t count = 0;
+  for(uint8_t timer = waiting_head; timer != DCC_WHEEL_NONE; timer = wheel.next[timer])
+    ++count;
+  return count;
+}
+
+bool DCCAccessoryPulser::inFlight(uint16_t address)
+{
+  for(uint8_t timer = flight_head; timer != DCC_WHEEL_NONE; timer = wheel.next[timer])
+  {
+    if(pulses[timer].address == address)
+      return true;
+  }
+  return false;
+}
+
+bool DCCAccessoryPulser::command(DCCPacketScheduler &scheduler, uint8_t timer)
+{
+  DCCPulse *p = &pulses[timer];
+  if(p->function & DCC_PULSE_OFF)
+    return scheduler.unsetBasicAccessory(p->address, p->function & 0x03);
+  return scheduler.setBasicAccessory(p->address, p->function);
+}
+
+void DCCAccessoryPulser::fly(uint8_t timer)
+{
+  wheel.expiry[timer] = wheel.current + DCC_PULSE_RESEND_TICKS;
+  wheel.next[timer] = flight_head;
+  flight_head = timer;
+}
+
+void DCCAccessoryPulser::resend(DCCPacketScheduler &scheduler)
+{
+  for(uint8_t timer = flight_head; timer != DCC_WHEEL_NONE; timer = wheel.next[timer])
+  {
+    if((int16_t)(wheel.current - wheel.expiry[timer]) >= 0)
+    {
+      command(scheduler, timer); //coalesces with the old one if it is still queued after all
+      wheel.expiry[timer] = wheel.current + DCC_PULSE_RESEND_TICKS;
+    }
+  }
+}
+
+void DCCAccessoryPulser::sent(uint16_t address, uint8_t bits)
+{
+  uint8_t prev = DCC_WHEEL_NONE;
+  for(uint8_t timer = flight_head; timer != DCC_WHEEL_NONE; prev = timer, timer = wheel.next[timer])
+  {
+    DCCPulse *p = &pulses[timer];
+    bool off = p->function & DCC_PULSE_OFF;
+    if((p->address != address) || ((p->function & 0x03) != ((bits >> 1) & 0x03)) || (off == (bits & 0x01)))
+      continue;
+    if(prev == DCC_WHEEL_NONE)
+      flight_head = wheel.next[timer];
+    else
+      wheel.next[prev] = wheel.next[timer];
+    if(off) //the coil is off: its current is free for the next one
+    {
+      --active;
+      wheel.release(timer);
+    }
+    else //the coil is on: time the pulse from here
+    {
+      wheel.start(timer, p->ticks);
+    }
+    return;
+  }
+}
+
+void DCCAccessoryPulser::update(DCCPacketScheduler &scheduler, unsigned long now_ms)
+{
+  if(!active)
+    last_tick = now_ms; //nothing running: no ticks to catch up on
+  
+  while(now_ms - last_tick >= DCC_PULSE_TICK_MS)
+  {
+    last_tick += DCC_PULSE_TICK_MS;
+    uint8_t timer = wheel.tick();
+    while(timer != DCC_WHEEL_NONE) //these pulses are up
+    {
+      uint8_t following = wheel.next[timer];
+      pulses[timer].function |= DCC_PULSE_OFF;
+      if(command(scheduler, timer))
+        fly(timer);
+      else //the queue is full: try again next tick, rather than leave the coil on
+        wheel.start(timer, 1);
+      timer = following;
+    }
+    if(!(wheel.current & (DCC_WHEEL_NEAR_SLOTS-1)))
+      resend(scheduler);
+  }
+  
+  while((waiting_head != DCC_WHEEL_NONE) && (!max_active || (active < max_active)))
+  {
+    uint8_t timer = waiting_head;
+    if(!command(scheduler, timer))
+      break; //the queue is full; the line waits for the next update()
+    waiting_head = wheel.next[timer];
+    if(waiting_head == DCC_WHEEL_NONE)
+      waiting_tail = DCC_WHEEL_NONE;
+    ++active;
+    fly(timer);
+  }
+}
+
+#endif //DCC_PULSE_TIMERS
@@ -0,0 +1,107 @@
+#ifndef __DCCTIMERWHEEL_H__
+#define __DCCTIMERWHEEL_H__
+
+#include "Arduino.h"
+#include "DCCConfig.h"
+
+/**
+ * Timed accessory pulses without delay().
+ *
+ * DCCTimerWheel is a two-level hierarchical timer wheel over a fixed array of DCC_PULSE_TIMERS timers,
+ * linked into its slots by index as DCCPacketPool links packets, so there is no heap and no search.
+ * The near wheel has one slot per tick for the next 32 ticks; the far wheel one slot per 32 ticks for
+ * the 512 after that. Each tick empties one near slot, whose timers have all expired, and every 32nd
+ * tick also moves one far slot down into the near wheel, so expiring any number of timers costs O(1)
+ * per tick and O(1) per timer. A timer further off than the far wheel reaches is parked in its last
+ * slot and placed again each time round.
+ *
+ * DCCAccessoryPulser, owned by DCCPacketScheduler (pulseAccessory()), uses it for solenoid turnouts.
+ * It queues the "on" command, starts the pulse timer when the scheduler reports that command on the rails
+ * (sent()), and queues the "off" command when the timer expires, so the pulse the decoder sees does not
+ * depend on how long the "on" waited in the queue. A coil counts against the current budget from its
+ * "on" being queued until its "off" is on the rails; at most budget/pulse current coils are on at once
+ * (setCurrentBudget()), and the rest of a large batch waits its turn in order. A command that has not
+ * reached the rails after DCC_PULSE_RESEND_TICKS (say, an e-stop cleared the queues) is queued again.
+**/
+
+#define DCC_WHEEL_NONE        0xFF
+#define DCC_WHEEL_NEAR_BITS   5
+#define DCC_WHEEL_NEAR_SLOTS  (1 << DCC_WHEEL_NEAR_BITS)
+#define DCC_WHEEL_FAR_SLOTS   16
+#define DCC_WHEEL_MAX_TICKS   0x7FFF //serial arithmetic on 16-bit ticks
+
+#define DCC_PULSE_TICK_MS     4 //wheel resolution
+#define DCC_PULSE_RESEND_TICKS 64
+#define DCC_PULSE_OFF         0x80 //in DCCPulse::function: the pulse is over, and "off" is the command due
+
+#if DCC_PULSE_TIMERS
+
+class DCCTimerWheel
+{
+  public: //protected:
+    uint16_t expiry[DCC_PULSE_TIMERS]; //tick each timer is due
+    uint8_t next[DCC_PULSE_TIMERS]; //links each timer into a wheel slot, the free list, or the caller's own list
+    uint8_t near_slots[DCC_WHEEL_NEAR_SLOTS];
+    uint8_t far_slots[DCC_WHEEL_FAR_SLOTS];
+    uint8_t free_head;
+    uint16_t current; //ticks so far
+  public:
+    DCCTimerWheel(void);
+    
+    uint8_t allocate(void); //returns DCC_WHEEL_NONE if none are free
+    void release(uint8_t timer);
+    //run an allocated timer that is not already running; it expires in ticks (at least 1) from now
+    void start(uint8_t timer, uint16_t ticks);
+    //advance one tick; returns the timers that expired, linked through next[] and no longer running
+    uint8_t tick(void);
+    
+  private:
+    void insert(uint8_t timer);
+};
+
+struct DCCPulse
+{
+  uint16_t address;
+  uint8_t function; //and DCC_PULSE_OFF
+  uint16_t ticks; //pulse length
+};
+
+class DCCPacketScheduler;
+
+class DCCAccessoryPulser
+{
+  public:
+    DCCAccessoryPulser(void);
+    
+    //at most budget_ma / pulse_ma coils on at once (at least one); a budget of 0 means no limit
+    void setCurrentBudget(uint16_t budget_ma, uint16_t pulse_ma);
+    //turn function of accessory address on for duration_ms, then off; false if every timer is in use
+    bool pulse(uint16_t address, uint8_t function, uint16_t duration_ms);
+    //start waiting pulses the budget allows, and end those whose time is up
+    void update(DCCPacketScheduler &scheduler, unsigned long now_ms);
+    //a basic accessory packet with data bits DDD (see DCCPacket.cpp) has just been put on the rails
+    void sent(uint16_t address, uint8_t bits);
+    
+    inline uint8_t getActive(void) { return active; }
+    uint8_t getWaiting(void);
+    //is a command for accessory address queued on a pulse's behalf? It is resent if it doesn't reach the rails
+    bool inFlight(uint16_t address);
+    
+  private:
+    bool command(DCCPacketScheduler &scheduler, uint8_t timer); //queue the pulse's "on" or "off"
+    void fly(uint8_t timer); //its command is queued: watch for it on the rails
+    void resend(DCCPacketScheduler &scheduler);
+    
+    DCCTimerWheel wheel;
+    DCCPulse pulses[DCC_PULSE_TIMERS];
+    uint8_t waiting_head; //pulses yet to start, oldest first, linked through wheel.next[]
+    uint8_t waiting_tail;
+    uint8_t flight_head; //pulses whose command is queued but not yet on the rails; wheel.expiry[] is when to resend
+    uint8_t active; //coils on, or about to be: from "on" queued to "off" on the rails
+    uint8_t max_active; //0: no limit
+    unsigned long last_tick;
+};
+
+#endif //DCC_PULSE_TIMERS
+
+#endif //__DCCTIMERWHEEL_H__
@@ -0,0 +1,37 @@
+#include "DCCWaveformBuffer.h"
+
+const DCC_timing_profile_t DCC_timing_standard = {DCC_ONE_HALF_PERIOD_US, DCC_ZERO_HALF_PERIOD_US, DCC_ZERO_HALF_PERIOD_US, DCC_PREAMBLE_BITS};
+const DCC_timing_profile_t DCC_timing_throughput = {DCC_ONE_HALF_PERIOD_MIN_US + DCC_TIMING_MARGIN_US, DCC_ZERO_HALF_PERIOD_MIN_US + DCC_TIMING_MARGIN_US,
+                                                    DCC_ZERO_HALF_PERIOD_MIN_US + DCC_TIMING_MARGIN_US, DCC_PREAMBLE_BITS};
+const DCC_timing_profile_t DCC_timing_service = {DCC_ONE_HALF_PERIOD_US, DCC_ZERO_HALF_PERIOD_US, DCC_ZERO_HALF_PERIOD_US, DCC_SERVICE_PREAMBLE_BITS};
+
+uint8_t DCC_timing_valid(const DCC_timing_profile_t *profile)
+{
+  return (profile->one_us >= DCC_ONE_HALF_PERIOD_MIN_US) && (profile->one_us <= DCC_ONE_HALF_PERIOD_MAX_US) &&
+         (profile->zero_high_us >= DCC_ZERO_HALF_PERIOD_MIN_US) && (profile->zero_high_us <= DCC_ZERO_HALF_PERIOD_MAX_US) &&
+         (profile->zero_low_us >= DCC_ZERO_HALF_PERIOD_MIN_US) && (profile->zero_low_us <= DCC_ZERO_HALF_PERIOD_MAX_US) &&
+         (profile->preamble_bits >= DCC_PREAMBLE_BITS) && (profile->preamble_bits <= DCC_MAX_PREAMBLE_BITS);
+}
+
+static uint16_t put_bit(uint16_t *timings, uint16_t count, uint8_t bit, const DCC_timing_profile_t *profile)
+{
+  timings[count++] = bit ? profile->one_us : profile->zero_high_us; //high half
+  timings[count++] = bit ? profile->one_us : profile->zero_low_us; //low half
+  return count;
+}
+
+uint16_t DCC_waveform_encode_timings(const uint8_t *packet, uint8_t size, uint16_t *timings, const DCC_timing_profile_t *profile)
+{
+  uint16_t count = 0;
+  uint8_t i, j;
+
+  for(i = 0; i < profile->preamble_bits; ++i)
+    count = put_bit(timings, count, 1, profile);
+  for(i = 0; i < size; ++i)
+  {
+    count = put_bit(timings, count, 0, profile); //each data byte is preceded by a '0'
+    for(j = 8; j; --j)
+      count = put_bit(timings, count, (packet[i] >> (j-1)) & 1, profile);
+  }
+  return put_bit(timings, count, 1, profile); //packet end bit
+}
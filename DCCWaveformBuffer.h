@@ -0,0 +1,77 @@
+#ifndef __DCCWAVEFORMBUFFER_H__
+#define __DCCWAVEFORMBUFFER_H__
+
+#include <stdint.h>
+
+/// Edge-list encoding of a whole DCC packet
+/** Peripherals that play out a timing array (DMA into a PWM/timer, ESP32 RMT, etc.) want the entire
+    packet up front rather than one bit per interrupt. DCC_waveform_encode_timings() produces that array:
+    one entry per half-period, in microseconds, alternating high and low and starting with high.
+    The bit sequence is the same one the AVR ISR produces: preamble, then a '0' and eight data bits
+    per byte, then the packet end '1'.
+*/
+
+/// S 9.1: '1' half-period 58us (55-61us), '0' half-period >= 100us (95-9900us)
+#define DCC_ONE_HALF_PERIOD_US    58
+#define DCC_ZERO_HALF_PERIOD_US   100
+#define DCC_PREAMBLE_BITS         14
+#define DCC_MAX_PACKET_SIZE       6
+
+/// The windows S 9.1 allows a command station to transmit in, and the preamble lengths S 9.2 asks for
+#define DCC_ONE_HALF_PERIOD_MIN_US    55
+#define DCC_ONE_HALF_PERIOD_MAX_US    61
+#define DCC_ZERO_HALF_PERIOD_MIN_US   95
+#define DCC_ZERO_HALF_PERIOD_MAX_US   9900
+#define DCC_SERVICE_PREAMBLE_BITS     20 //S 9.2.3: the long preamble of service mode packets
+#define DCC_MAX_PREAMBLE_BITS         24
+
+/// How far inside the minimums above DCC_timing_throughput stays: a 16MHz resonator is good to 0.5%, 0.3us of 58us,
+/// and a booster or long feeder rounds the edges further
+#define DCC_TIMING_MARGIN_US          2
+
+/// The wider windows S 9.1 asks a decoder to accept, and the shortest preamble it must take (S 9.2)
+#define DCC_ONE_HALF_PERIOD_RX_MIN_US   52
+#define DCC_ONE_HALF_PERIOD_RX_MAX_US   64
+#define DCC_ZERO_HALF_PERIOD_RX_MIN_US  90
+#define DCC_ZERO_HALF_PERIOD_RX_MAX_US  10000
+#define DCC_RX_PREAMBLE_BITS            10
+
+/// Largest array DCC_waveform_encode_timings() can produce
+#define DCC_WAVEFORM_MAX_HALF_PERIODS (2*(DCC_MAX_PREAMBLE_BITS + 9*DCC_MAX_PACKET_SIZE + 1))
+
+/// Waveform timing profiles: the half-periods to send each bit with, and the preamble length
+/** Selected at run time with DCC_waveform_set_timing() (DCCHardware.h), which every backend applies from the
+    start of the next packet, so no packet ever mixes two profiles.
+      *DCC_timing_standard: 58us/100us, 14-bit preamble; what the generator has always sent.
+      *DCC_timing_throughput: 57us/97us, DCC_TIMING_MARGIN_US above the shortest half-periods S 9.1 lets a command
+       station send, and the shortest preamble, for the most packets per second in ops mode.
+      *DCC_timing_service: standard half-periods with the long preamble service mode programming needs.
+*/
+typedef struct
+{
+  uint16_t one_us;
+  uint16_t zero_high_us;
+  uint16_t zero_low_us; //may be longer than zero_high_us, to stretch zeros
+  uint8_t preamble_bits;
+} DCC_timing_profile_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+extern const DCC_timing_profile_t DCC_timing_standard;
+extern const DCC_timing_profile_t DCC_timing_throughput;
+extern const DCC_timing_profile_t DCC_timing_service;
+
+/// Non-zero if every half-period and the preamble length of profile are within the S 9.1/S 9.2 limits above.
+uint8_t DCC_timing_valid(const DCC_timing_profile_t *profile);
+
+/// Encode size bytes of packet into timings[] with the given profile; returns the number of entries written.
+uint16_t DCC_waveform_encode_timings(const uint8_t *packet, uint8_t size, uint16_t *timings, const DCC_timing_profile_t *profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__DCCWAVEFORMBUFFER_H__
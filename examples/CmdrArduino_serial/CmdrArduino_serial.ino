@@ -0,0 +1,29 @@
+/********************
+* Creates a DCC command station driven by text commands over the serial port, e.g.
+*   S 3 64       (loco 3, speed 64 forward)
+*   F 3 1        (loco 3, headlight on)
+*   A 5 2        (accessory 5, output 2 on)
+*   E            (stop everything)
+* See DCCCommandParser.h for the full command set. Each command is answered with "+", "-" or "?".
+* The DCC waveform is output on Pin 9, and is suitable for connection to an LMD18200-based booster directly,
+* or to a single-ended-to-differential driver, to connect with most other kinds of boosters.
+********************/
+
+#include <DCCPacket.h>
+#include <DCCPacketQueue.h>
+#include <DCCPacketScheduler.h>
+#include <DCCCommandParser.h>
+
+
+DCCPacketScheduler dps;
+DCCCommandParser parser(dps);
+
+void setup() {
+  Serial.begin(115200);
+  dps.setup();
+}
+
+void loop() {
+  parser.update(Serial); //never blocks waiting for input
+  dps.update();
+}
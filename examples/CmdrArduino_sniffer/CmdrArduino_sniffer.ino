@@ -0,0 +1,57 @@
+/********************
+* A track sniffer: prints every packet on the rails, whichever command station or booster put it there,
+* and a line of statistics every five seconds. Idle packets are counted but not printed.
+* Connect the rails to Pin 8 (Pin 49 on a Mega) through an optocoupler, a 6N137 say, with a resistor and a
+* reverse diode on its input; either polarity will do. This board only listens: it does not generate DCC.
+* Build with DCC_SNIFFER=1 in the build flags (e.g. -DDCC_SNIFFER=1), or set it in DCCCapture.h: without it the
+* library leaves the capture ISR out. See DCCSniffer.h.
+********************/
+
+#include <DCCSniffer.h>
+
+
+void printPacket(DCCPacket &packet, const uint8_t *bytes, uint8_t size)
+{
+  if(packet.getKind() == idle_packet_kind)
+    return;
+  Serial.print(millis());
+  Serial.print(" ");
+  Serial.print(packet.getAddress());
+  Serial.print(packet.getAddressKind() == DCC_LONG_ADDRESS ? "L kind " : "S kind ");
+  Serial.print(packet.getKind(), HEX);
+  Serial.print(":");
+  for(uint8_t i = 0; i < size; ++i)
+  {
+    Serial.print(" ");
+    Serial.print(bytes[i], HEX);
+  }
+  Serial.println();
+}
+
+DCCSniffer sniffer(printPacket);
+unsigned long last_stats = 0;
+
+void setup() {
+  Serial.begin(115200);
+  sniffer.setup();
+}
+
+void loop() {
+  sniffer.update(); //never blocks; keep loop() short enough to drain the capture ring
+  if(millis() - last_stats >= 5000)
+  {
+    last_stats = millis();
+    Serial.print("packets ");
+    Serial.print(sniffer.packets);
+    Serial.print(" (idle ");
+    Serial.print(sniffer.idles);
+    Serial.print(") XOR errors ");
+    Serial.print(sniffer.xor_errors);
+    Serial.print(" framing errors ");
+    Serial.print(sniffer.framing_errors);
+    Serial.print(" out of spec ");
+    Serial.print(sniffer.out_of_spec);
+    Serial.print(" overruns ");
+    Serial.println(sniffer.overruns);
+  }
+}
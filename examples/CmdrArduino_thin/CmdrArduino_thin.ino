@@ -0,0 +1,22 @@
+/********************
+* The board half of a split command station: no scheduler, no queues, no roster, just the waveform and a deep
+* buffer of packets streamed, already encoded, from DCCStreamDaemon on a Linux host over the serial port.
+* The host runs the full DCCPacketScheduler, so the layout is limited by the host's memory, not this board's.
+* See DCCPacketStreamer.h for the link protocol.
+* The DCC waveform is output on Pin 9, and is suitable for connection to an LMD18200-based booster directly,
+* or to a single-ended-to-differential driver, to connect with most other kinds of boosters.
+********************/
+
+#include <DCCPacketStreamer.h>
+
+
+DCCPacketStreamer streamer;
+
+void setup() {
+  Serial.begin(115200);
+  streamer.setup();
+}
+
+void loop() {
+  streamer.update(Serial); //never blocks waiting for input
+}
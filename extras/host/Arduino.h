@@ -0,0 +1,35 @@
+#ifndef __ARDUINO_HOST_SHIM_H__
+#define __ARDUINO_HOST_SHIM_H__
+
+/**
+ * Just enough of the Arduino core for the library's host builds (see the Makefile alongside): the types,
+ * map(), and millis()/micros(), which host_clock.cpp provides. ARDUINO stays undefined, so the library
+ * compiles its host backends and host-only classes.
+**/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+unsigned long millis(void);
+unsigned long micros(void);
+
+#ifdef __cplusplus
+}
+
+static inline long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+#endif
+
+#endif //__ARDUINO_HOST_SHIM_H__
@@ -0,0 +1,31 @@
+#ifndef __ARDUINO_AVR_SIZE_SHIM_H__
+#define __ARDUINO_AVR_SIZE_SHIM_H__
+
+/// The Arduino core as far as the library needs it for avr_size.cpp and sizes.sh: types and declarations only, no libc
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t byte;
+
+#ifdef __cplusplus
+typedef bool boolean;
+class Print;
+class Stream;
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+extern "C"
+{
+#endif
+
+void *malloc(size_t size);
+void free(void *pointer);
+void *memcpy(void *to, const void *from, size_t size);
+void *memset(void *to, int value, size_t size);
+int memcmp(const void *a, const void *b, size_t size);
+unsigned long millis(void);
+unsigned long micros(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__ARDUINO_AVR_SIZE_SHIM_H__
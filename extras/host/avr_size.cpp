@@ -0,0 +1,23 @@
+/**
+ * The scheduler's size as avr-gcc would lay it out, for checking a profile's RAM budget without an AVR toolchain
+ * (avr_size.sh). AVR has no alignment padding, 2-byte pointers and 4-byte longs. This file is compiled, never run:
+ *   *with -m32 and every struct packed, which is the AVR layout but for 4-byte pointers;
+ *   *with -m64, packed, and long made an int, so only the pointers differ between the two: 4 bytes each.
+ * Each size is the size of an array below, read from the object file.
+**/
+
+#include <stdint.h>
+#include <stddef.h>
+#if defined(AVR_SIZE_LONG_AS_INT)
+#define long int
+#endif
+
+#pragma pack(push, 1)
+#include "DCCPacketScheduler.h"
+#pragma pack(pop)
+
+#define DCC_POOL_RAM (PACKET_POOL_SIZE * (sizeof(DCCPacket) + 1))
+
+char avr_size_scheduler[sizeof(DCCPacketScheduler)];
+char avr_size_pool[DCC_POOL_RAM];
+char avr_size_budget[DCC_RAM_BUDGET];
@@ -0,0 +1,27 @@
+#!/bin/sh
+# AVR-equivalent RAM of the scheduler and its packet pool for one build profile, checked against its budget;
+# see avr_size.cpp. Usage: avr_size.sh PROFILE BUILD_DIR. Exits non-zero if the profile is over budget.
+set -e
+profile=$1
+build=$2
+root=$(dirname "$0")/../..
+cxx=${CXX:-g++}
+flags="-std=gnu++11 -ffreestanding -fsyntax-only -DARDUINO=100 -DDCC_BUILD_PROFILE=$profile -I$(dirname "$0")/avr -I$root"
+mkdir -p "$build"
+size() {
+  nm -S -t d "$1" | awk -v name="$2" '$4 == name { print $2 + 0 }'
+}
+$cxx $flags -fno-syntax-only -c -m32 "$(dirname "$0")/avr_size.cpp" -o "$build/avr_size32.o"
+$cxx $flags -fno-syntax-only -c -m64 -DAVR_SIZE_LONG_AS_INT "$(dirname "$0")/avr_size.cpp" -o "$build/avr_size64.o"
+s32=$(size "$build/avr_size32.o" avr_size_scheduler)
+s64=$(size "$build/avr_size64.o" avr_size_scheduler)
+pool=$(size "$build/avr_size32.o" avr_size_pool)
+budget=$(size "$build/avr_size32.o" avr_size_budget)
+pointers=$(( (s64 - s32) / 4 ))
+scheduler=$(( s32 - 2 * pointers ))
+total=$(( scheduler + pool ))
+echo "profile $profile: scheduler ${scheduler}B ($pointers pointers) + pool ${pool}B = ${total}B of ${budget}B budget on AVR"
+if [ $total -gt $budget ]; then
+  echo "profile $profile: over its RAM budget by $(( total - budget ))B" >&2
+  exit 1
+fi
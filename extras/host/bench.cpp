@@ -0,0 +1,70 @@
+/**
+ * dcc_bench: the microbenchmarks and a simulator load run, written as one JSON document (DCCBenchmark.h).
+ *   dcc_bench [-o results.json] [-s script] [-t seconds] [-n iterations]
+ * Without -s the load is synthetic: 8 throttles at 10 updates/s each, and a burst of 16 accessories every second.
+ * The human-readable reports go to stderr; the JSON to the -o file, or stdout.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "DCCBenchmark.h"
+#include "DCCSimulator.h"
+
+int main(int argc, char **argv)
+{
+  const char *output = 0;
+  const char *script = 0;
+  uint32_t seconds = 30;
+  uint32_t iterations = DCC_BENCH_DEFAULT_ITERATIONS;
+  int option;
+  while((option = getopt(argc, argv, "o:s:t:n:")) != -1)
+  {
+    switch(option)
+    {
+      case 'o': output = optarg; break;
+      case 's': script = optarg; break;
+      case 't': seconds = atoi(optarg); break;
+      case 'n': iterations = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-o results.json] [-s script] [-t seconds] [-n iterations]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  DCCBenchmark bench(iterations);
+  bench.run();
+  bench.report(stderr);
+
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  DCCSimulator simulator(scheduler);
+  if(script)
+  {
+    if(!simulator.loadFile(script))
+    {
+      fprintf(stderr, "%s: can't read script %s\n", argv[0], script);
+      return 1;
+    }
+  }
+  else
+  {
+    for(uint16_t loco = 3; loco < 11; ++loco)
+      simulator.addThrottle(loco, 10, 0, seconds * 1000000ULL);
+    for(uint32_t s = 0; s < seconds; ++s)
+      simulator.addAccessoryBurst(s * 1000000ULL + 500000, 100, 16);
+  }
+  simulator.run(seconds * 1000000ULL);
+  simulator.report(stderr);
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if(!out)
+  {
+    fprintf(stderr, "%s: can't write %s\n", argv[0], output);
+    return 1;
+  }
+  bench.writeResults(out, &simulator);
+  if(output)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "Arduino.h"
+#include "host_clock.h"
+#include "DCCSimulator.h"
+#include <time.h>
+
+static __thread bool manual = false;
+static __thread uint64_t manual_us = 0;
+
+void host_clock_set(uint64_t us)
+{
+  manual = true;
+  manual_us = us;
+}
+
+void host_clock_advance(uint64_t us)
+{
+  manual = true;
+  manual_us += us;
+}
+
+void host_clock_release(void)
+{
+  manual = false;
+}
+
+static uint64_t host_now(void)
+{
+  if(manual)
+    return manual_us;
+  DCCSimulator *simulator = DCCSimulator::current();
+  if(simulator)
+    return simulator->now();
+  static uint64_t start = 0;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  if(!start)
+    start = us;
+  return us - start;
+}
+
+unsigned long millis(void)
+{
+  return host_now() / 1000;
+}
+
+unsigned long micros(void)
+{
+  return host_now();
+}
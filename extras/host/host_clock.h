@@ -0,0 +1,17 @@
+#ifndef __HOST_CLOCK_H__
+#define __HOST_CLOCK_H__
+
+#include <stdint.h>
+
+/**
+ * The clock behind the shim's millis() and micros(), in order of precedence:
+ *   *a time the test set with host_clock_set(), until host_clock_release();
+ *   *the simulated time of the DCCSimulator last run on the calling thread (DCCSimulator::current());
+ *   *otherwise CLOCK_MONOTONIC, from the first call, as DCCStreamDaemon expects.
+**/
+
+void host_clock_set(uint64_t us);
+void host_clock_advance(uint64_t us);
+void host_clock_release(void);
+
+#endif //__HOST_CLOCK_H__
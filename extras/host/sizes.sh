@@ -0,0 +1,41 @@
+#!/bin/sh
+# Code size and RAM of the scheduler and the classes it owns, for every build profile (DCCConfig.h).
+# Usage: sizes.sh BUILD_DIR. With avr-g++ on the PATH the code is built for $MCU (default atmega328p), which is
+# the flash a sketch pays; without it, for 32-bit x86 at the same -Os, which compares the profiles but is not
+# the board's figure. RAM is avr_size.sh's AVR layout either way. The HAL (DCCHardware.c and the other .c files)
+# needs the AVR headers and is the same in every profile, so it is left out.
+set -e
+build=$1
+root=$(dirname "$0")/../..
+sources="DCCPacket DCCPacketQueue DCCPacketScheduler DCCPacketTrace DCCRoster DCCTimerWheel DCCFairShare"
+if command -v avr-g++ > /dev/null; then
+  cxx="avr-g++ -mmcu=${MCU:-atmega328p}"
+  sizer=avr-size
+  target=${MCU:-atmega328p}
+else
+  cxx="${CXX:-g++} -m32"
+  sizer=size
+  target="x86 -m32, for comparison only"
+fi
+flags="-std=gnu++11 -ffreestanding -Os -ffunction-sections -fdata-sections -DARDUINO=100 -I$(dirname "$0")/avr -I$root"
+echo "code: text+data at -Os ($target)"
+for profile in 0 1 2 3; do
+  case $profile in
+    0) name=full ;;
+    1) name=compact ;;
+    2) name=tiny ;;
+    3) name=host ;;
+  esac
+  mkdir -p "$build/profile$profile"
+  total=0
+  files=""
+  for source in $sources; do
+    object="$build/profile$profile/$source.o"
+    $cxx $flags -DDCC_BUILD_PROFILE=$profile -c "$root/$source.cpp" -o "$object"
+    bytes=$($sizer "$object" | awk 'NR == 2 { print $1 + $2 }')
+    total=$(( total + bytes ))
+    files="$files $source=$bytes"
+  done
+  echo "profile $profile ($name): ${total}B code:$files"
+  "$(dirname "$0")/avr_size.sh" $profile "$build/profile$profile"
+done
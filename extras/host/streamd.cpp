@@ -0,0 +1,103 @@
+/**
+ * dcc_streamd: the host half of a split command station (DCCStreamDaemon.h), streaming to a board running
+ * DCCPacketStreamer (examples/CmdrArduino_thin) on a serial device.
+ *   dcc_streamd [-b baud] [-w window] [-t seconds] device
+ *   dcc_streamd -p [-w window] [-t seconds]
+ * Text commands (DCCCommandParser syntax) are read from stdin and answered on stdout, one status per line.
+ * The layout keeps running at the end of stdin; the daemon stops after -t seconds, on SIGINT or SIGTERM, or when
+ * the link closes, and writes its report to stderr. -p streams to a stand-in board on a pseudo-terminal
+ * (DCCStreamBoard) instead of a device, and lists what it put on the rails.
+ * Build it with the host profile for its queues and roster: make PROFILE=3.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include "DCCStreamDaemon.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signal)
+{
+  stopping = 1;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t baud = 115200;
+  uint32_t seconds = 0;
+  int window = DCC_DAEMON_DEFAULT_WINDOW;
+  bool pty = false;
+  int option;
+  while((option = getopt(argc, argv, "b:w:t:p")) != -1)
+  {
+    switch(option)
+    {
+      case 'b': baud = atoi(optarg); break;
+      case 'w': window = atoi(optarg); break;
+      case 't': seconds = atoi(optarg); break;
+      case 'p': pty = true; break;
+      default:
+        optind = argc + 1;
+    }
+  }
+  if(optind != argc - (pty ? 0 : 1) || window < 1 || window > 255)
+  {
+    fprintf(stderr, "usage: %s [-b baud] [-w window] [-t seconds] device\n       %s -p [-w window] [-t seconds]\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  DCCStreamBoard board;
+  const char *device = pty ? 0 : argv[optind];
+  if(pty)
+  {
+    if(!board.start())
+    {
+      fprintf(stderr, "%s: no pseudo-terminal to be had\n", argv[0]);
+      return 1;
+    }
+    device = board.path();
+  }
+
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  DCCStreamDaemon daemon(scheduler);
+  if(!daemon.open(device, baud))
+  {
+    fprintf(stderr, "%s: can't open %s\n", argv[0], device);
+    return 1;
+  }
+  daemon.setWindow(window);
+  daemon.setInput(STDIN_FILENO, STDOUT_FILENO);
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN); //a reader of stdout going away only stops the replies
+  unsigned long end = millis() + seconds * 1000UL;
+  while(!stopping && (!seconds || (long)(millis() - end) < 0))
+  {
+    if(!daemon.poll(10))
+    {
+      fprintf(stderr, "%s: %s closed\n", argv[0], device);
+      break;
+    }
+  }
+
+  daemon.report(stderr);
+  if(pty)
+  {
+    board.stop();
+    for(size_t i = 0; i < board.rails.size(); ++i)
+    {
+      const DCCStreamRailPacket &p = board.rails[i];
+      if(p.packet[0] == 0xFF) //idle
+        continue;
+      fprintf(stderr, "%10.3fms", (p.time - board.rails[0].time) / 1000.0);
+      for(uint8_t b = 0; b < p.size; ++b)
+        fprintf(stderr, " %02X", p.packet[b]);
+      fprintf(stderr, "\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+
+/**
+ * The host tests' whole framework: CHECK() reports a failure and carries on, and TEST_RESULT() is main()'s
+ * return value, non-zero if anything failed, so that make test stops there.
+**/
+
+static int test_failures = 0;
+static int test_checks = 0;
+
+#define CHECK(condition) do { ++test_checks; if(!(condition)) { ++test_failures; \
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); } } while(0)
+#define CHECK_EQ(actual, expected) do { ++test_checks; long long a_ = (long long)(actual), e_ = (long long)(expected); \
+    if(a_ != e_) { ++test_failures; fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); } } while(0)
+#define TEST_RESULT() (printf("%s: %d checks, %d failed\n", __FILE__, test_checks, test_failures), test_failures ? 1 : 0)
+
+#endif //__HOST_TEST_H__
@@ -0,0 +1,47 @@
+#ifndef __HOST_TEST_RAILS_H__
+#define __HOST_TEST_RAILS_H__
+
+#include <vector>
+#include <string.h>
+#include "DCCPacketScheduler.h"
+#include "DCCHardwareHost.h"
+#include "DCCCommandParser.h"
+
+/// A packet as it went onto the simulated rails
+struct RailPacket
+{
+  uint8_t size;
+  uint8_t bytes[DCC_MAX_PACKET_SIZE];
+};
+
+/// Call update() count times, completing each packet at once, and keep every packet sent in *out (if given)
+static inline void runRails(DCCPacketScheduler &scheduler, uint32_t count, std::vector<RailPacket> *out = 0)
+{
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    scheduler.update();
+    if(DCC_waveform_ready())
+      continue;
+    if(out)
+    {
+      RailPacket p;
+      p.size = DCC_host_packet_size;
+      memcpy(p.bytes, DCC_host_packet, p.size);
+      out->push_back(p);
+    }
+    DCC_host_waveform_complete();
+  }
+}
+
+/// Feed line and a newline to parser; returns the status of the command
+static inline char command(DCCCommandParser &parser, const char *line)
+{
+  char status = DCC_COMMAND_PENDING;
+  for(; *line; ++line)
+    status = parser.parse(*line);
+  if(status == DCC_COMMAND_PENDING)
+    status = parser.parse('\n');
+  return status;
+}
+
+#endif //__HOST_TEST_RAILS_H__
@@ -0,0 +1,132 @@
+//automation: steps out of range stop their sequence, and 64 sequences sharing 8 locks all keep running
+#include <vector>
+#include "test.h"
+#include "rails.h"
+#include "DCCAutomation.h"
+#include "DCCSimulator.h"
+
+#define SEQUENCES 64
+#define RUN_US    60000000ULL
+
+static const DCCAutomationStep shuttle[] = {
+  DCC_AUTO_SPEED(0, 40, 0),
+  DCC_AUTO_WAIT_MS(5000),
+  DCC_AUTO_FUNCTIONS(0, 1),
+  DCC_AUTO_WAIT_MS(1000),
+  DCC_AUTO_SPEED(0, -40, 0),
+  DCC_AUTO_WAIT_MS(5000),
+  DCC_AUTO_JUMP(0),
+  DCC_AUTO_END()
+};
+
+//two blocks out of eight, taken one after the other, so every lock is fought over by 16 sequences
+#define BLOCKS(a, b) { \
+  DCC_AUTO_LOCK(a), DCC_AUTO_SPEED(0, 60, 0), DCC_AUTO_WAIT_MS(100), DCC_AUTO_LOCK(b), DCC_AUTO_UNLOCK(a), \
+  DCC_AUTO_WAIT_MS(100), DCC_AUTO_SPEED(0, 1, 0), DCC_AUTO_UNLOCK(b), DCC_AUTO_WAIT_MS(8000), DCC_AUTO_JUMP(0), \
+  DCC_AUTO_END() }
+static const DCCAutomationStep blocks[4][11] = { BLOCKS(0, 1), BLOCKS(2, 3), BLOCKS(4, 5), BLOCKS(6, 7) };
+
+struct Progress
+{
+  DCCAutomation *automation;
+  uint8_t last_step[SEQUENCES];
+  uint64_t last_change[SEQUENCES]; //us
+  uint64_t longest_stall[SEQUENCES]; //us
+  uint32_t rounds[SEQUENCES]; //times round its program
+};
+
+static void loopHook(void *context)
+{
+  Progress *progress = (Progress *)context;
+  progress->automation->update();
+  uint64_t now = DCCSimulator::current()->now();
+  for(uint8_t i = 0; i < SEQUENCES; ++i)
+  {
+    uint8_t step = progress->automation->getStep(i);
+    if(step == progress->last_step[i])
+      continue;
+    if(step < progress->last_step[i])
+      ++progress->rounds[i];
+    if(now - progress->last_change[i] > progress->longest_stall[i])
+      progress->longest_stall[i] = now - progress->last_change[i];
+    progress->last_step[i] = step;
+    progress->last_change[i] = now;
+  }
+}
+
+int main(void)
+{
+  //steps out of range stop the sequence rather than reading or writing past an array
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCAutomation automation(scheduler);
+    const DCCAutomationStep bad_lock[] = { DCC_AUTO_LOCK(DCC_AUTOMATION_LOCKS), DCC_AUTO_END() };
+    const DCCAutomationStep bad_unlock[] = { DCC_AUTO_UNLOCK(200), DCC_AUTO_END() };
+    const DCCAutomationStep bad_jump[] = { DCC_AUTO_SPEED(0, 10, 0), DCC_AUTO_JUMP(3), DCC_AUTO_END() };
+    const DCCAutomationStep bad_op[] = { { 0x55, 0, 0, 0 }, DCC_AUTO_END() };
+    const DCCAutomationStep jump_to_end[] = { DCC_AUTO_JUMP(1), DCC_AUTO_END() };
+    uint8_t slots[5];
+    slots[0] = automation.start(bad_lock, 3);
+    slots[1] = automation.start(bad_unlock, 3);
+    slots[2] = automation.start(bad_jump, 3);
+    slots[3] = automation.start(bad_op, 3);
+    slots[4] = automation.start(jump_to_end, 3);
+    for(uint8_t i = 0; i < 5; ++i)
+      CHECK(slots[i] != DCC_AUTOMATION_NONE);
+    for(uint8_t i = 0; i < 10; ++i)
+    {
+      automation.update(DCC_AUTOMATION_SLOTS);
+      runRails(scheduler, 1);
+    }
+    CHECK_EQ(automation.getRunning(), 0);
+    CHECK_EQ(automation.bad_steps, 4);
+    CHECK_EQ(automation.getStep(slots[2]), 1); //the speed ran, the jump did not
+    for(uint8_t i = 0; i < DCC_AUTOMATION_LOCKS; ++i)
+      CHECK_EQ(automation.lock_owner[i], DCC_AUTOMATION_NONE);
+
+    //a program with no END is refused outright
+    std::vector<DCCAutomationStep> endless(DCC_AUTOMATION_MAX_STEPS + 1);
+    for(size_t i = 0; i < endless.size(); ++i)
+      endless[i] = (DCCAutomationStep)DCC_AUTO_WAIT_MS(1);
+    CHECK_EQ(automation.start(&endless[0], 3), DCC_AUTOMATION_NONE);
+  }
+
+  //64 sequences at once, half of them contending for locks: none may starve
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCAutomation automation(scheduler);
+    DCCSimulator simulator(scheduler);
+    Progress progress;
+    memset(&progress, 0, sizeof(progress));
+    progress.automation = &automation;
+    for(uint8_t i = 0; i < SEQUENCES; ++i)
+      CHECK_EQ(automation.start((i & 1) ? blocks[(i / 2) % 4] : shuttle, i + 1), i);
+    simulator.setLoopHook(loopHook, &progress);
+    simulator.run(RUN_US);
+
+    CHECK_EQ(automation.getRunning(), SEQUENCES);
+    CHECK_EQ(automation.bad_steps, 0);
+    uint32_t fewest = 0xFFFFFFFF, most = 0;
+    uint64_t stall = 0;
+    for(uint8_t i = 0; i < SEQUENCES; ++i)
+    {
+      uint64_t since = RUN_US - progress.last_change[i];
+      if(since > progress.longest_stall[i])
+        progress.longest_stall[i] = since;
+      if(progress.longest_stall[i] > stall)
+        stall = progress.longest_stall[i];
+      if(progress.rounds[i] < fewest)
+        fewest = progress.rounds[i];
+      if(progress.rounds[i] > most)
+        most = progress.rounds[i];
+      CHECK(simulator.per_address[i + 1].packets > 0);
+    }
+    CHECK(fewest >= 4); //a shuttle's round is 11s of waits, so 60s allows 5
+    CHECK(stall < 9000000); //the longest wait in either program is 8s: no sequence is held up for long beyond it
+    printf("%u sequences: %u to %u rounds each, longest stall %.1fms, %u steps, %u retries\n", SEQUENCES, fewest, most,
+      stall / 1000.0, automation.steps_run, automation.retries);
+  }
+  return TEST_RESULT();
+}
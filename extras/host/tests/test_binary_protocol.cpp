@@ -0,0 +1,97 @@
+//binary protocol: fields out of range refuse the frame with a MALFORMED reply, rather than being masked onto
+//some other loco, accessory or speed
+#include "test.h"
+#include "rails.h"
+#include "DCCBinaryProtocol.h"
+
+#define NAK       -1
+#define MALFORMED -2
+
+/// Send count commands in a frame; returns how many the reply says were accepted, NAK or MALFORMED
+static int frame(DCCBinaryProtocol &protocol, const uint8_t *commands, uint8_t count = 1)
+{
+  uint8_t checksum = count;
+  protocol.receive(DCC_BINARY_SYNC);
+  protocol.receive(count);
+  for(uint8_t i = 0; i < count * DCC_BINARY_COMMAND_SIZE; ++i)
+  {
+    protocol.receive(commands[i]);
+    checksum ^= commands[i];
+  }
+  CHECK(protocol.receive(checksum));
+  if(protocol.getReply()[0] == DCC_BINARY_NAK)
+    return NAK;
+  if(protocol.getReply()[0] == DCC_BINARY_MALFORMED)
+    return MALFORMED;
+  CHECK_EQ(protocol.getReply()[0], DCC_BINARY_ACK);
+  return protocol.getReply()[1];
+}
+
+int main(void)
+{
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  DCCBinaryProtocol protocol(scheduler);
+  const uint8_t L = DCC_BINARY_LONG_ADDRESS;
+
+  //speed
+  const uint8_t speed_min[] = { DCC_BINARY_OP_SPEED, 0, 3, 0x81, 0 }; //-127
+  const uint8_t speed_bad[] = { DCC_BINARY_OP_SPEED, 0, 3, 0x80, 0 }; //-128
+  const uint8_t speed_all_bad[] = { DCC_BINARY_OP_SPEED, 0, 0, 0x80, 0 };
+  const uint8_t steps_bad[] = { DCC_BINARY_OP_SPEED, 0, 3, 10, 27 };
+  CHECK_EQ(frame(protocol, speed_min), 1);
+  CHECK_EQ(frame(protocol, speed_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, speed_all_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, steps_bad), MALFORMED);
+
+  //addresses: a short one above 127 would be masked onto another loco, a long one above 10239 makes a reserved byte
+  const uint8_t short_max[] = { DCC_BINARY_OP_SPEED, 0, 127, 10, 0 };
+  const uint8_t short_bad[] = { DCC_BINARY_OP_SPEED, 0, 131, 10, 0 };
+  const uint8_t long_max[] = { DCC_BINARY_OP_SPEED | L, 10239 >> 8, 10239 & 0xFF, 10, 0 };
+  const uint8_t long_bad[] = { DCC_BINARY_OP_SPEED | L, 10240 >> 8, 10240 & 0xFF, 10, 0 };
+  const uint8_t functions_bad[] = { DCC_BINARY_OP_FUNCTIONS, 0, 200, 0, 1 };
+  const uint8_t e_stop_bad[] = { DCC_BINARY_OP_E_STOP, 0, 128, 0, 0 };
+  const uint8_t pom_bad[] = { DCC_BINARY_OP_POM | L, 0xFF, 0xFF, 28, 0 };
+  CHECK_EQ(frame(protocol, short_max), 1);
+  CHECK_EQ(frame(protocol, short_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, long_max), 1);
+  CHECK_EQ(frame(protocol, long_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, functions_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, e_stop_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, pom_bad), MALFORMED);
+
+  //accessories: a 9-bit address, one of 4 outputs, on or off
+  const uint8_t accessory_max[] = { DCC_BINARY_OP_ACCESSORY, 511 >> 8, 511 & 0xFF, 3, 1 };
+  const uint8_t accessory_address_bad[] = { DCC_BINARY_OP_ACCESSORY, 512 >> 8, 512 & 0xFF, 0, 1 };
+  const uint8_t accessory_function_bad[] = { DCC_BINARY_OP_ACCESSORY, 0, 12, 4, 1 };
+  const uint8_t accessory_state_bad[] = { DCC_BINARY_OP_ACCESSORY, 0, 12, 0, 2 };
+  CHECK_EQ(frame(protocol, accessory_max), DCC_ACCESSORIES ? 1 : 0);
+  CHECK_EQ(frame(protocol, accessory_address_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, accessory_function_bad), MALFORMED);
+  CHECK_EQ(frame(protocol, accessory_state_bad), MALFORMED);
+
+  //POM: every 10-bit CV-1 is a CV in 1-1024
+  const uint8_t pom_max[] = { DCC_BINARY_OP_POM | 0x03, 0, 3, 0xFF, 255 };
+  CHECK_EQ(frame(protocol, pom_max), DCC_OPS_PROGRAMMING ? 1 : 0);
+
+  //unknown opcodes
+  const uint8_t op_bad[] = { 0x70, 0, 3, 0, 0 };
+  CHECK_EQ(frame(protocol, op_bad), MALFORMED);
+
+  //one bad command refuses the whole frame, and the reply says which
+  runRails(scheduler, 200);
+  uint8_t mixed[3 * DCC_BINARY_COMMAND_SIZE];
+  memcpy(mixed, short_max, DCC_BINARY_COMMAND_SIZE);
+  memcpy(mixed + DCC_BINARY_COMMAND_SIZE, long_max, DCC_BINARY_COMMAND_SIZE);
+  memcpy(mixed + 2 * DCC_BINARY_COMMAND_SIZE, short_bad, DCC_BINARY_COMMAND_SIZE);
+  CHECK_EQ(frame(protocol, mixed, 3), MALFORMED);
+  CHECK_EQ(protocol.getReply()[1], 2);
+  CHECK_EQ(protocol.getReplySize(), 2);
+  std::vector<RailPacket> rails;
+  runRails(scheduler, 50, &rails);
+  CHECK_EQ(rails.size(), 50);
+  for(size_t i = 0; i < rails.size(); ++i)
+    CHECK_EQ(rails[i].bytes[0], 0xFF); //idle: nothing from the refused frame
+  CHECK_EQ(protocol.malformed, 13);
+  return TEST_RESULT();
+}
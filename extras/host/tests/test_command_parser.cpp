@@ -0,0 +1,186 @@
+//text command parser: field validation, and the parser fed from a file and a pipe at full speed, a budget
+//of bytes at a time between update() calls, the way update(Stream &) feeds it on a board
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <thread>
+#include <string>
+#include "test.h"
+#include "rails.h"
+#include "host_clock.h"
+
+struct FeedResult
+{
+  uint32_t lines; //status frames
+  uint32_t ok;
+  uint32_t rejected;
+  uint32_t malformed;
+  uint32_t updates; //update() calls while feeding
+};
+
+/// Read fd to its end, at most DCC_COMMAND_BUDGET bytes between update() calls
+static FeedResult feed(DCCPacketScheduler &scheduler, DCCCommandParser &parser, int fd)
+{
+  FeedResult result = {0, 0, 0, 0, 0};
+  char buffer[DCC_COMMAND_BUDGET];
+  ssize_t n;
+  while((n = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    for(ssize_t i = 0; i < n; ++i)
+    {
+      char status = parser.parse(buffer[i]);
+      if(!status)
+        continue;
+      ++result.lines;
+      if(status == DCC_COMMAND_OK)
+        ++result.ok;
+      else if(status == DCC_COMMAND_REJECTED)
+        ++result.rejected;
+      else
+        ++result.malformed;
+    }
+    runRails(scheduler, 1);
+    ++result.updates;
+  }
+  return result;
+}
+
+/// count commands, to locos 1-8 and an accessory now and then, as one text stream
+static std::string commands(uint32_t count)
+{
+  std::string text;
+  char line[32];
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    if(i % 16 == 15)
+      snprintf(line, sizeof(line), "F %u %u\n", i % 8 + 1, i & 0x1F);
+    else
+      snprintf(line, sizeof(line), "S %u %d\n", i % 8 + 1, (int)(i % 255) - 127);
+    text += line;
+  }
+  return text;
+}
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  DCCCommandParser parser(scheduler);
+
+  //fields out of range are malformed, not wrapped into some other command
+  CHECK_EQ(command(parser, "S -3 50"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "S 3 50 -28"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "F -3 1"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "F 3 -1"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "E -3"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "A 512 0"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "A 3 4"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "A -1 0"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "P 3 29 256"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "P 3 29 -1"), DCC_COMMAND_MALFORMED);
+  //a sign or an 'L' with no digits after it is malformed, not a 0: "S 3 -" is no stop
+  CHECK_EQ(command(parser, "S 3 -"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "S 3 - 50"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "S - 50"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "S L 50"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "E -"), DCC_COMMAND_MALFORMED);
+  CHECK_EQ(command(parser, "S L3 -0"), DCC_COMMAND_OK);
+  CHECK_EQ(command(parser, "S 3 -50"), DCC_COMMAND_OK);
+  CHECK_EQ(command(parser, "F 3 1"), DCC_COMMAND_OK);
+#if DCC_ACCESSORIES
+  CHECK_EQ(command(parser, "A 511 3"), DCC_COMMAND_OK);
+#endif
+#if DCC_OPS_PROGRAMMING
+  CHECK_EQ(command(parser, "P 3 29 255"), DCC_COMMAND_OK);
+#endif
+  runRails(scheduler, 200);
+
+  //only a command that passes validation takes a rate limit token, just before it reaches the scheduler; E and H
+  //take none
+  {
+    host_clock_set(10000000);
+    DCCCommandParser limited(scheduler);
+    limited.setRateLimit(1, 2);
+    CHECK_EQ(command(limited, "S 3 200"), DCC_COMMAND_MALFORMED);
+    CHECK_EQ(command(limited, "S 3 -"), DCC_COMMAND_MALFORMED);
+    CHECK_EQ(command(limited, "A 3 4"), DCC_COMMAND_MALFORMED);
+    CHECK_EQ(command(limited, "Q 1"), DCC_COMMAND_MALFORMED);
+#if !DCC_SPEED_14
+    CHECK_EQ(command(limited, "S 3 10 14"), DCC_COMMAND_REJECTED);
+    CHECK_EQ(limited.unsupported, 1);
+#endif
+    CHECK_EQ(command(limited, "S 3 10"), DCC_COMMAND_OK);
+    CHECK_EQ(command(limited, "F 3 1"), DCC_COMMAND_OK);
+    CHECK_EQ(command(limited, "S 3 20"), DCC_COMMAND_REJECTED);
+    CHECK_EQ(limited.rate_limited, 1);
+    CHECK_EQ(command(limited, "S 3 200"), DCC_COMMAND_MALFORMED); //still malformed when out of tokens
+    CHECK_EQ(limited.rate_limited, 1);
+    CHECK_EQ(command(limited, "E 3"), DCC_COMMAND_OK);
+    host_clock_advance(1000000);
+    CHECK_EQ(command(limited, "S 3 20"), DCC_COMMAND_OK);
+    host_clock_release();
+    runRails(scheduler, 200);
+  }
+
+  const uint32_t count = 100000;
+  std::string text = commands(count);
+
+  //from a file
+  {
+    char path[] = "/tmp/dcc_commands_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK_EQ(write(fd, text.data(), text.size()), (ssize_t)text.size());
+    lseek(fd, 0, SEEK_SET);
+    double start = seconds();
+    FeedResult result = feed(scheduler, parser, fd);
+    double elapsed = seconds() - start;
+    close(fd);
+    unlink(path);
+    CHECK_EQ(result.lines, count);
+    CHECK_EQ(result.malformed, 0);
+    CHECK(result.ok > 0);
+    CHECK_EQ(result.ok + result.rejected, count);
+    CHECK_EQ(result.updates, (text.size() + DCC_COMMAND_BUDGET - 1) / DCC_COMMAND_BUDGET); //update() was never starved
+    printf("file: %u commands in %.3fs, %.0f commands/s, %u accepted, %u rejected (queue full)\n",
+      count, elapsed, count / elapsed, result.ok, result.rejected);
+  }
+
+  //from a pipe, written as fast as another thread can
+  {
+    runRails(scheduler, 1000);
+    int fds[2];
+    CHECK(!pipe(fds));
+    std::thread writer([&]()
+    {
+      size_t done = 0;
+      while(done < text.size())
+      {
+        ssize_t n = write(fds[1], text.data() + done, text.size() - done);
+        if(n <= 0)
+          break;
+        done += n;
+      }
+      close(fds[1]);
+    });
+    double start = seconds();
+    FeedResult result = feed(scheduler, parser, fds[0]);
+    double elapsed = seconds() - start;
+    writer.join();
+    close(fds[0]);
+    CHECK_EQ(result.lines, count);
+    CHECK_EQ(result.malformed, 0);
+    CHECK(result.ok > 0);
+    CHECK_EQ(result.ok + result.rejected, count);
+    printf("pipe: %u commands in %.3fs, %.0f commands/s, %u accepted, %u rejected (queue full)\n",
+      count, elapsed, count / elapsed, result.ok, result.rejected);
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,68 @@
+//fair share: the age table on its own, then one loco's throttle flooding the scheduler while 12 others send a
+//command now and then; every one of theirs reaches the rails, within a bound set by the number of active locos
+#include <stdio.h>
+#include "test.h"
+#include "DCCSimulator.h"
+
+#define OTHERS    12
+#define RUN_US    20000000ULL
+#define UPDATES   2 //a second, for each of the others
+
+int main(void)
+{
+#if DCC_FAIR_ADDRESSES
+  //ages count packets since an address was served; short and long forms are different locos
+  {
+    DCCFairShare share;
+    CHECK_EQ(share.age(3, DCC_SHORT_ADDRESS), 0xFFFF);
+    share.served(3, DCC_SHORT_ADDRESS);
+    CHECK_EQ(share.age(3, DCC_SHORT_ADDRESS), 0);
+    CHECK_EQ(share.age(3, DCC_LONG_ADDRESS), 0xFFFF);
+    share.served(3, DCC_LONG_ADDRESS);
+    share.served(4, DCC_SHORT_ADDRESS);
+    CHECK_EQ(share.age(3, DCC_SHORT_ADDRESS), 2);
+    CHECK_EQ(share.age(3, DCC_LONG_ADDRESS), 1);
+    //a full table forgets the address served longest ago
+    for(uint16_t address = 100; address < 100 + DCC_FAIR_ADDRESSES - 3; ++address) //fills the table
+      share.served(address, DCC_SHORT_ADDRESS);
+    CHECK(share.age(3, DCC_SHORT_ADDRESS) != 0xFFFF);
+    share.served(99, DCC_SHORT_ADDRESS);
+    CHECK_EQ(share.age(3, DCC_SHORT_ADDRESS), 0xFFFF);
+    CHECK_EQ(share.age(3, DCC_LONG_ADDRESS), DCC_FAIR_ADDRESSES - 1);
+  }
+
+  //loco 3 at 100 speed and 50 function updates a second, the others at UPDATES
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCSimulator simulator(scheduler);
+    simulator.addThrottle(3, 100, 0, RUN_US);
+    for(uint64_t t = 0; t < RUN_US; t += 20000)
+      simulator.addCommand(t, ((t / 20000) & 1) ? "F 3 1" : "F 3 0");
+    for(uint16_t loco = 4; loco < 4 + OTHERS; ++loco)
+      simulator.addThrottle(loco, UPDATES, 250000 + loco * 1000, RUN_US); //after the reset sequence
+    simulator.run(RUN_US + 1000000);
+
+    //the bound: loco 3 and every other loco ahead of it once, each with its speed packet and a repeat, and
+    //the low priority turn that comes round meanwhile; at most 6ms a packet
+    const uint64_t bound = (uint64_t)(OTHERS + 1) * 2 * 6000 * LOW_PRIORITY_INTERVAL / (LOW_PRIORITY_INTERVAL - 1);
+    uint32_t loco_3 = simulator.per_address[3].packets, all = 0;
+    uint64_t worst = 0;
+    for(uint16_t loco = 4; loco < 4 + OTHERS; ++loco)
+    {
+      DCCSimAddressStats &stats = simulator.per_address[loco];
+      CHECK_EQ(stats.latency.count, (RUN_US - 250000 - loco * 1000 + 1000000 / UPDATES - 1) / (1000000 / UPDATES));
+      CHECK(stats.latency.max <= bound);
+      if(stats.latency.max > worst)
+        worst = stats.latency.max;
+    }
+    for(std::map<uint16_t, DCCSimAddressStats>::iterator i = simulator.per_address.begin(); i != simulator.per_address.end(); ++i)
+      all += i->second.packets;
+    CHECK(loco_3 * 2 < all); //not the lion's share
+    printf("loco 3: %.0f%% of the packets; the others' worst latency %lluus, against a bound of %lluus; "
+      "host update() cost %.0fns/packet\n", 100.0 * loco_3 / all, (unsigned long long)worst, (unsigned long long)bound,
+      simulator.packets_sent ? (double)simulator.update_ns / simulator.packets_sent : 0.0);
+  }
+#endif
+  return TEST_RESULT();
+}
@@ -0,0 +1,63 @@
+//group commands: broadcasts only where every decoder ends up in the state the command asks for
+#include "test.h"
+#include "rails.h"
+
+static bool broadcastsFunctions(const std::vector<RailPacket> &rails)
+{
+  for(size_t i = 0; i < rails.size(); ++i)
+  {
+    if(!rails[i].bytes[0] && ((rails[i].bytes[1] & 0xE0) == 0x80 || (rails[i].bytes[1] & 0xE0) == 0xA0))
+      return true;
+  }
+  return false;
+}
+
+int main(void)
+{
+  //a partial function group to every loco must not be broadcast: it would clear F1-F4 on every decoder
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCCommandParser parser(scheduler);
+    runRails(scheduler, 100);
+    std::vector<RailPacket> rails;
+    char status = command(parser, "F 0 1 1");
+    runRails(scheduler, 100, &rails);
+    CHECK(!broadcastsFunctions(rails));
+#if !DCC_ROSTER_SIZE || !DCC_GROUP_COMMANDS
+    CHECK(status != DCC_COMMAND_OK); //nothing to expand over
+#else
+    CHECK_EQ(status, DCC_COMMAND_OK);
+#endif
+  }
+
+  //a whole function group is broadcast
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 100);
+    std::vector<RailPacket> rails;
+    CHECK(scheduler.setFunctionsGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, 0x001F, 0x001F));
+    runRails(scheduler, 100, &rails);
+    CHECK(broadcastsFunctions(rails));
+  }
+
+#if DCC_ROSTER_SIZE && DCC_GROUP_COMMANDS
+  //a partial group goes to each loco the roster knows, keeping the functions it leaves alone
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    CHECK(scheduler.setFunctions(3, DCC_SHORT_ADDRESS, (uint16_t)0x0002)); //F1
+    runRails(scheduler, 100);
+    std::vector<RailPacket> rails;
+    CHECK(scheduler.setFunctionsGroup(DCC_GROUP_ALL, 0, DCC_SHORT_ADDRESS, 0x0001, 0x0001)); //F0 on
+    runRails(scheduler, 100, &rails);
+    CHECK(!broadcastsFunctions(rails));
+    bool seen = false;
+    for(size_t i = 0; i < rails.size(); ++i)
+      seen |= (rails[i].bytes[0] == 3) && (rails[i].bytes[1] == 0x91); //100 FL=1 F4-F1=0001
+    CHECK(seen);
+  }
+#endif
+  return TEST_RESULT();
+}
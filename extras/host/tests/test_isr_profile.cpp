@@ -0,0 +1,29 @@
+//ISR profile: counts must not wrap over a long run (70,000 interrupts is a few seconds of ISR on a board)
+#include "test.h"
+#include "DCCIsrProfile.h"
+
+int main(void)
+{
+  const uint32_t runs = 70000;
+  DCC_isr_profile_reset();
+  for(uint32_t i = 0; i < runs; ++i)
+    DCC_isr_profile_record(1, 5, 100); //2us late, 2us long, well in time
+  for(uint32_t i = 0; i < runs; ++i)
+    DCC_isr_profile_record(1, 120, 100); //reloaded after TCNT1 passed the new TOP
+
+  DCC_isr_profile_t profile;
+  DCC_isr_profile_read(&profile);
+  CHECK_EQ(profile.samples, 2*runs);
+  CHECK_EQ(profile.latency[0], 2*runs);
+  CHECK_EQ(profile.duration[1], runs);
+  CHECK_EQ(profile.duration[DCC_ISR_PROFILE_BUCKETS-1], runs);
+  CHECK_EQ(profile.late_reloads, runs);
+  CHECK_EQ(profile.min_margin, 0);
+
+  DCC_isr_profile_reset();
+  DCC_isr_profile_read(&profile);
+  CHECK_EQ(profile.samples, 0);
+  CHECK_EQ(profile.late_reloads, 0);
+  CHECK_EQ(profile.min_margin, 0xFFFF);
+  return TEST_RESULT();
+}
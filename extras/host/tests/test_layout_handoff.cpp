@@ -0,0 +1,81 @@
+//district handoff: a loco moving between districts keeps its speed and functions, the new district takes it up
+//within an epoch, the old one lets it go, and later commands follow it
+#include "test.h"
+#include "DCCLayoutSimulator.h"
+#include "DCCHardwareHost.h"
+
+#define HANDOFF_US 2000000ULL
+
+#if DCC_ROSTER_SIZE
+/// What one district has put on the rails for loco 3, watched from its worker thread before every update()
+struct Watch
+{
+  uint64_t first; //us, 0 for never
+  uint64_t last;
+  uint8_t first_speed; //the first speed byte
+  uint8_t speed; //the last
+  uint8_t functions; //the last F0-F4 byte
+  uint8_t last_packet[DCC_MAX_PACKET_SIZE];
+};
+
+static void watch(void *context)
+{
+  Watch *w = (Watch *)context;
+  if(!memcmp(w->last_packet, DCC_host_packet, sizeof(w->last_packet))) //each packet is seen many times while it is sent
+    return;
+  memcpy(w->last_packet, DCC_host_packet, sizeof(w->last_packet));
+  if(DCC_host_packet[0] != 3)
+    return;
+  uint64_t now = DCCSimulator::current()->now();
+  if(!w->first)
+    w->first = now;
+  w->last = now;
+  if(DCC_host_packet[1] == 0x3F)
+  {
+    if(!w->first_speed)
+      w->first_speed = DCC_host_packet[2];
+    w->speed = DCC_host_packet[2];
+  }
+  else if((DCC_host_packet[1] & 0xE0) == 0x80)
+    w->functions = DCC_host_packet[1];
+}
+#endif
+
+int main(void)
+{
+#if DCC_ROSTER_SIZE
+  DCCLayoutSimulator layout(3);
+  Watch watches[3];
+  memset(watches, 0, sizeof(watches));
+  for(uint8_t i = 0; i < 3; ++i)
+    layout.district(i).setLoopHook(watch, &watches[i]);
+  layout.place(3, 0);
+  layout.place(4, 2);
+  layout.addCommand(500000, "S 3 40");
+  layout.addCommand(500000, "F 3 1");
+  layout.addCommand(500000, "S 4 20");
+  layout.addHandoff(HANDOFF_US, 3, 1);
+  layout.addCommand(3000000, "S 3 60");
+  layout.run(5000000);
+
+  CHECK_EQ(layout.handoffs, 1);
+  //district 0 ran loco 3 until the handoff, and not beyond the packets already on their way
+  CHECK(watches[0].first >= 500000 && watches[0].first < HANDOFF_US);
+  CHECK(watches[0].last < HANDOFF_US + DCC_LAYOUT_DEFAULT_EPOCH_US + 100000);
+  //district 1 took it up at the first epoch boundary, at the speed and with the functions it had
+  CHECK(watches[1].first >= HANDOFF_US);
+  CHECK(watches[1].first < HANDOFF_US + DCC_LAYOUT_DEFAULT_EPOCH_US + 100000);
+  CHECK_EQ(watches[1].first_speed, 0x80 | 40);
+  CHECK_EQ(watches[1].functions, 0x80 | 0x10);
+  //the command after the handoff followed the loco
+  CHECK(watches[1].last >= 3000000);
+  CHECK_EQ(watches[1].speed, 0x80 | 60);
+  CHECK_EQ(layout.district(0).commands_issued, 2);
+  CHECK_EQ(layout.district(1).commands_issued, 3); //the handoff's speed and functions, then the new speed
+  //district 2 never saw loco 3, but ran its own
+  CHECK_EQ(watches[2].first, 0);
+  CHECK(layout.district(2).per_address[4].packets > 0);
+  layout.report(stdout);
+#endif
+  return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+//overcurrent trip, driven by a mock current source: debounce, the outputs cut within the packet, the queues
+//left alone while tripped and coalescing, and the auto-retry policy
+#include "test.h"
+#include "rails.h"
+#include "host_clock.h"
+#include "DCCOvercurrent.h"
+
+static uint16_t current = 0; //what the mock sense resistor reads
+static uint32_t readings = 0;
+
+static uint16_t mockCurrent(void)
+{
+  ++readings;
+  return current;
+}
+
+/// Send one packet, with the mock reading fault for its whole length
+static void sendWith(DCCPacketScheduler &scheduler, uint16_t fault, std::vector<RailPacket> *out = 0)
+{
+  current = fault;
+  runRails(scheduler, 1, out);
+}
+
+int main(void)
+{
+  host_clock_set(0);
+
+  //debounce: only debounce readings in a row above the threshold trip
+  {
+    DCC_overcurrent_setup(mockCurrent, 500, 3);
+    current = 600;
+    CHECK(!DCC_overcurrent_sample());
+    CHECK(!DCC_overcurrent_sample());
+    current = 400; //a spike, not a short
+    CHECK(!DCC_overcurrent_sample());
+    current = 600;
+    CHECK(!DCC_overcurrent_sample());
+    CHECK(!DCC_overcurrent_sample());
+    CHECK(DCC_overcurrent_sample());
+    CHECK(DCC_overcurrent_tripped());
+    CHECK_EQ(DCC_overcurrent_trips(), 1);
+    CHECK_EQ(DCC_host_output_enabled, 0);
+    readings = 0;
+    CHECK(DCC_overcurrent_sample()); //stays tripped without reading the source again
+    CHECK_EQ(readings, 0);
+    DCC_overcurrent_clear();
+    CHECK(!DCC_overcurrent_tripped());
+    CHECK_EQ(DCC_host_output_enabled, 1);
+  }
+
+  //a short trips within the packet, and nothing more goes out until it is cleared; commands given meanwhile
+  //coalesce, so each loco gets its latest state once rather than a backlog
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCC_overcurrent_setup(mockCurrent, 500, 4);
+    current = 0;
+    runRails(scheduler, 100);
+    readings = 0;
+    sendWith(scheduler, 1000);
+    CHECK(DCC_overcurrent_tripped());
+    CHECK_EQ(readings, 4); //sampled every half-period, and not once more after the trip
+    CHECK_EQ(DCC_host_output_enabled, 0);
+
+    uint32_t sent = DCC_host_packets_sent;
+    for(int8_t speed = 2; speed < 40; ++speed)
+    {
+      scheduler.setSpeed(3, DCC_SHORT_ADDRESS, speed);
+      sendWith(scheduler, 0);
+    }
+    CHECK_EQ(DCC_host_packets_sent, sent); //the queues are paused, not churning
+
+    DCC_overcurrent_clear();
+    std::vector<RailPacket> rails;
+    runRails(scheduler, 20, &rails);
+    uint32_t speeds = 0;
+    for(size_t i = 0; i < rails.size(); ++i)
+    {
+      if(rails[i].bytes[0] == 3 && rails[i].bytes[1] == 0x3F)
+      {
+        ++speeds;
+        CHECK_EQ(rails[i].bytes[2], 0x80 | 39); //only the latest
+      }
+    }
+    CHECK(speeds >= 1);
+  }
+
+  //auto-retry: power comes back every interval, up to max_retries times in a row, then stays off
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    scheduler.setOvercurrentRetry(100, 3);
+    DCC_overcurrent_setup(mockCurrent, 500, 2);
+    runRails(scheduler, 100);
+    host_clock_set(1000000);
+    sendWith(scheduler, 1000);
+    CHECK(DCC_overcurrent_tripped());
+    for(uint8_t retry = 1; retry <= 3; ++retry)
+    {
+      sendWith(scheduler, 1000); //the scheduler notes the trip
+      host_clock_advance(99000);
+      sendWith(scheduler, 1000);
+      CHECK(DCC_overcurrent_tripped()); //not yet
+      host_clock_advance(1000);
+      sendWith(scheduler, 1000); //retries: power comes back, but nothing is sent in the same update()
+      CHECK(!DCC_overcurrent_tripped());
+      CHECK_EQ(DCC_host_output_enabled, 1);
+      sendWith(scheduler, 1000); //and the next packet finds the short still there
+      CHECK(DCC_overcurrent_tripped());
+      CHECK_EQ(DCC_overcurrent_trips(), 1 + retry);
+    }
+    host_clock_advance(10000000);
+    for(uint8_t i = 0; i < 10; ++i)
+      sendWith(scheduler, 0);
+    CHECK(DCC_overcurrent_tripped()); //out of retries: the sketch must clear it
+    CHECK_EQ(DCC_overcurrent_trips(), 4);
+  }
+
+  //a fault that clears: power stays on after a retry, and after OVERCURRENT_RECOVERY_TIME the retry count starts over
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    scheduler.setOvercurrentRetry(100, 1);
+    DCC_overcurrent_setup(mockCurrent, 500, 2);
+    runRails(scheduler, 100);
+    host_clock_set(1000000);
+    sendWith(scheduler, 1000);
+    sendWith(scheduler, 0);
+    host_clock_advance(100000);
+    sendWith(scheduler, 0);
+    CHECK(!DCC_overcurrent_tripped());
+    CHECK_EQ(DCC_host_output_enabled, 1);
+    host_clock_advance(OVERCURRENT_RECOVERY_TIME * 1000ULL + 1000);
+    sendWith(scheduler, 0);
+    sendWith(scheduler, 1000); //a second short, long after: it gets its retry too
+    sendWith(scheduler, 0);
+    host_clock_advance(100000);
+    sendWith(scheduler, 0);
+    CHECK(!DCC_overcurrent_tripped());
+    CHECK_EQ(DCC_overcurrent_trips(), 2);
+  }
+  host_clock_release();
+  return TEST_RESULT();
+}
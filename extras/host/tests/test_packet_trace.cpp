@@ -0,0 +1,120 @@
+//packet trace: what record() took in comes back out of dump() and decode(), oldest first, and the trace the scheduler
+//keeps matches what went onto the rails
+#include <string>
+#include "test.h"
+#include "rails.h"
+#include "host_clock.h"
+#include "DCCPacketTrace.h"
+
+#if DCC_TRACE_DEPTH
+/// decode() into a string
+static bool decoded(const uint8_t *buffer, uint16_t length, std::string &text)
+{
+  char *data = 0;
+  size_t size = 0;
+  FILE *out = open_memstream(&data, &size);
+  bool ok = DCCPacketTrace::decode(buffer, length, out);
+  fclose(out);
+  text.assign(data, size);
+  free(data);
+  return ok;
+}
+#endif
+
+int main(void)
+{
+#if DCC_TRACE_DEPTH
+  static uint8_t buffer[6 + DCC_TRACE_DEPTH * 11];
+
+  //record, dump, decode
+  {
+    DCCPacketTrace trace;
+    const uint8_t speed[] = {0x03, 0x3F, 0x80 | 40, 0x03 ^ 0x3F ^ (0x80 | 40)};
+    const uint8_t idle[] = {0xFF, 0x00, 0xFF};
+    host_clock_set(1000000); //t=1000ms
+    trace.record(DCC_TRACE_HIGH, speed_packet_kind, speed, sizeof(speed));
+    host_clock_advance(25000);
+    trace.record(DCC_TRACE_IDLE, idle_packet_kind, idle, sizeof(idle));
+    host_clock_advance(5000);
+    uint16_t length = trace.dump(buffer, sizeof(buffer));
+    CHECK_EQ(length, 6 + 5 + sizeof(speed) + 5 + sizeof(idle));
+    CHECK_EQ(buffer[0], 'D');
+    CHECK_EQ(buffer[1], 'T');
+    CHECK_EQ(buffer[2], DCC_TRACE_VERSION);
+    CHECK_EQ(buffer[3], 2);
+    CHECK_EQ(buffer[4] | (buffer[5] << 8), 1030);
+    CHECK_EQ(buffer[6] | (buffer[7] << 8), 1000);
+    CHECK_EQ(buffer[8], DCC_TRACE_HIGH);
+    CHECK_EQ(buffer[9], speed_packet_kind);
+    CHECK_EQ(buffer[10], sizeof(speed));
+    CHECK(!memcmp(buffer + 11, speed, sizeof(speed)));
+    std::string text;
+    CHECK(decoded(buffer, length, text));
+    char expect[200];
+    snprintf(expect, sizeof(expect), "2 packets, dumped at t=1030\nt-   30ms high   kind 0x%02X: 03 3F A8 94\n"
+      "t-    5ms idle   kind 0x%02X: FF 00 FF\n", speed_packet_kind, idle_packet_kind);
+    CHECK(text == expect);
+    if(text != expect)
+      printf("%s", text.c_str());
+
+    //too small a buffer, and dumps that are cut short or not dumps at all
+    CHECK_EQ(trace.dump(buffer, length - 1), 0);
+    CHECK(!decoded(buffer, length - 1, text));
+    CHECK(!decoded(buffer, 5, text));
+    buffer[2] = DCC_TRACE_VERSION + 1;
+    CHECK(!decoded(buffer, length, text));
+  }
+
+  //once full, the oldest entries give way, and the dump still starts with the oldest left
+  {
+    DCCPacketTrace trace;
+    for(uint16_t i = 0; i < DCC_TRACE_DEPTH + 5; ++i)
+    {
+      uint8_t bytes[] = {(uint8_t)i, 0x3F, 0x80, (uint8_t)(i ^ 0x3F ^ 0x80)};
+      host_clock_set(i * 1000ULL);
+      trace.record(DCC_TRACE_LOW, speed_packet_kind, bytes, sizeof(bytes));
+    }
+    CHECK_EQ(trace.getCount(), DCC_TRACE_DEPTH);
+    uint16_t length = trace.dump(buffer, sizeof(buffer));
+    CHECK_EQ(length, 6 + DCC_TRACE_DEPTH * 9);
+    CHECK_EQ(buffer[3], DCC_TRACE_DEPTH);
+    for(uint16_t n = 0; n < DCC_TRACE_DEPTH; ++n)
+    {
+      const uint8_t *e = buffer + 6 + n * 9;
+      CHECK_EQ(e[0] | (e[1] << 8), (5 + n) % 65536);
+      CHECK_EQ(e[5], (uint8_t)(5 + n));
+    }
+    std::string text;
+    CHECK(decoded(buffer, length, text));
+    trace.clear();
+    CHECK_EQ(trace.getCount(), 0);
+    CHECK_EQ(trace.dump(buffer, sizeof(buffer)), 6);
+  }
+
+  //the scheduler's trace holds the last packets on the rails, in the order they went
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    host_clock_set(0);
+    runRails(scheduler, 30);
+    scheduler.setSpeed(3, DCC_SHORT_ADDRESS, 40, 128);
+    scheduler.setFunctions0to4(3, DCC_SHORT_ADDRESS, 0x01);
+    std::vector<RailPacket> rails;
+    runRails(scheduler, DCC_TRACE_DEPTH, &rails);
+    uint16_t length = scheduler.trace.dump(buffer, sizeof(buffer));
+    CHECK(length > 0);
+    CHECK_EQ(buffer[3], DCC_TRACE_DEPTH);
+    uint16_t pos = 6;
+    for(size_t i = 0; i < rails.size() && pos < length; ++i)
+    {
+      CHECK_EQ(buffer[pos + 4], rails[i].size);
+      CHECK(!memcmp(buffer + pos + 5, rails[i].bytes, rails[i].size));
+      pos += 5 + buffer[pos + 4];
+    }
+    CHECK_EQ(pos, length);
+    CHECK_EQ(buffer[6 + 2], DCC_TRACE_HIGH); //the speed packet first
+  }
+  host_clock_release();
+#endif
+  return TEST_RESULT();
+}
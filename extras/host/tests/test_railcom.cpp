@@ -0,0 +1,143 @@
+//RailCom: the 4-of-8 line code both ways, app:adr for a short and a long loco, a CV read on the main answered
+//through the detector mock, and bytes from a missed cutout counted apart from invalid ones
+#include "test.h"
+#include "DCCRailCom.h"
+#include "DCCHardwareHost.h"
+
+static uint8_t bitsSet(uint8_t code)
+{
+  uint8_t n = 0;
+  for(; code; code >>= 1)
+    n += code & 1;
+  return n;
+}
+
+/// The two bytes of a datagram carrying id and 8 bits of data
+static void datagram(uint8_t *bytes, uint8_t id, uint8_t data)
+{
+  bytes[0] = DCCRailCom::encode((id << 2) | (data >> 6));
+  bytes[1] = DCCRailCom::encode(data & 0x3F);
+}
+
+#if DCC_OPS_PROGRAMMING
+/// One packet onto the rails; if it is a POM verify for loco 3, the decoder answers in its cutout with its address
+/// and value. Returns true if it was.
+static bool sendPacket(DCCPacketScheduler &scheduler, DCCRailCom &railcom, uint8_t value)
+{
+  bool verify = false;
+  scheduler.update();
+  if(!DCC_waveform_ready())
+  {
+    verify = (DCC_host_packet[0] == 3) && ((DCC_host_packet[1] & 0xFC) == 0xE4);
+    if(verify)
+    {
+      uint8_t reply[4];
+      datagram(reply, DCC_RAILCOM_ID_ADR_LOW, 3);
+      datagram(reply + 2, DCC_RAILCOM_ID_POM, value);
+      DCC_host_railcom_reply(reply, sizeof(reply));
+    }
+    DCC_host_waveform_complete();
+  }
+  railcom.update();
+  return verify;
+}
+#endif
+
+int main(void)
+{
+  //the line code: every value has its own code with exactly four bits set, and decodes back
+  {
+    bool used[256];
+    memset(used, 0, sizeof(used));
+    for(uint8_t value = 0; value < 64; ++value)
+    {
+      uint8_t code = DCCRailCom::encode(value);
+      CHECK_EQ(bitsSet(code), 4);
+      CHECK(!used[code]);
+      used[code] = true;
+      CHECK_EQ(DCCRailCom::decode(code), value);
+    }
+    const uint8_t replies[] = {DCC_RAILCOM_ACK, DCC_RAILCOM_NACK, DCC_RAILCOM_BUSY};
+    for(uint8_t i = 0; i < sizeof(replies); ++i)
+    {
+      uint8_t code = DCCRailCom::encode(replies[i]);
+      CHECK_EQ(bitsSet(code), 4);
+      CHECK(!used[code]);
+      used[code] = true;
+      CHECK_EQ(DCCRailCom::decode(code), replies[i]);
+    }
+    CHECK_EQ(DCCRailCom::decode(0xF0), DCC_RAILCOM_ACK); //the second ACK code
+    uint32_t invalid = 0;
+    for(uint16_t code = 0; code < 256; ++code)
+      invalid += (DCCRailCom::decode(code) == DCC_RAILCOM_INVALID) ? 1 : 0;
+    CHECK_EQ(invalid, 256 - 64 - 3 - 1);
+  }
+
+  //app:adr: the high and low halves come in alternate cutouts
+  {
+    DCCRailCom railcom;
+    CHECK_EQ(railcom.getAddress(), 0);
+    uint8_t bytes[2];
+    uint8_t kind = 0xFF;
+    datagram(bytes, DCC_RAILCOM_ID_ADR_HIGH, 0);
+    railcom.receive(DCC_RAILCOM_CHANNEL_1, bytes, 2);
+    datagram(bytes, DCC_RAILCOM_ID_ADR_LOW, 3);
+    railcom.receive(DCC_RAILCOM_CHANNEL_1, bytes, 2);
+    CHECK_EQ(railcom.getAddress(&kind), 3);
+    CHECK_EQ(kind, DCC_SHORT_ADDRESS);
+    datagram(bytes, DCC_RAILCOM_ID_ADR_HIGH, 0x80 | (1000 >> 8));
+    railcom.receive(DCC_RAILCOM_CHANNEL_1, bytes, 2);
+    datagram(bytes, DCC_RAILCOM_ID_ADR_LOW, 1000 & 0xFF);
+    railcom.receive(DCC_RAILCOM_CHANNEL_1, bytes, 2);
+    CHECK_EQ(railcom.getAddress(&kind), 1000);
+    CHECK_EQ(kind, DCC_LONG_ADDRESS);
+    CHECK_EQ(railcom.datagrams, 4);
+    CHECK_EQ(railcom.invalid, 0);
+  }
+
+#if DCC_OPS_PROGRAMMING
+  //requestCV() to getCV(), through the scheduler, the cutout and the detector's UART
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCRailCom railcom(DCC_host_railcom_read);
+    DCC_railcom_enable(1);
+    for(uint8_t i = 0; i < 30; ++i) //the reset sequence
+      sendPacket(scheduler, railcom, 0);
+    CHECK(railcom.requestCV(scheduler, 3, DCC_SHORT_ADDRESS, 29));
+    CHECK(railcom.cvPending());
+    uint8_t value = 0;
+    CHECK(!railcom.getCV(&value));
+    uint32_t packets = 0, verifies = 0;
+    while(!railcom.getCV(&value) && packets < 200)
+    {
+      verifies += sendPacket(scheduler, railcom, 0xA6);
+      ++packets;
+    }
+    CHECK_EQ(verifies, 1);
+    CHECK_EQ(value, 0xA6);
+    CHECK(!railcom.cvPending());
+    CHECK(!railcom.getCV(&value)); //answered once
+    uint8_t kind = 0xFF;
+    CHECK_EQ(railcom.getAddress(&kind), 3);
+    CHECK_EQ(kind, DCC_SHORT_ADDRESS);
+    CHECK_EQ(railcom.invalid, 0);
+    CHECK_EQ(railcom.excess, 0);
+
+    //two cutouts' bytes with no update() in between: the first 8 are read, the rest dropped and counted as excess
+    uint8_t acks[6];
+    memset(acks, DCCRailCom::encode(DCC_RAILCOM_ACK), sizeof(acks));
+    DCC_host_railcom_reply(acks, sizeof(acks));
+    DCC_host_waveform_complete();
+    DCC_host_railcom_reply(acks, sizeof(acks));
+    DCC_host_waveform_complete();
+    uint16_t acks_before = railcom.acks;
+    railcom.update();
+    CHECK_EQ(railcom.acks - acks_before, 8);
+    CHECK_EQ(railcom.excess, 4);
+    CHECK_EQ(railcom.invalid, 0);
+    DCC_railcom_enable(0);
+  }
+#endif
+  return TEST_RESULT();
+}
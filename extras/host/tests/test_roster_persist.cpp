@@ -0,0 +1,154 @@
+//roster snapshot in the emulated EEPROM: bytes written against commands given, even wear over the log, how soon
+//after a reset the locos are back on the rails, and a record torn by a reset mid-write
+#include <time.h>
+#include "test.h"
+#include "rails.h"
+#include "host_clock.h"
+
+#define LOCOS ((DCC_ROSTER_SIZE < 8) ? DCC_ROSTER_SIZE : 8)
+#define RUN_S 600
+//20 resets and 10 idles, then at worst each loco waits on the one before it for room for its three function groups,
+//which go out one packet in five
+#define RESTORE_PACKETS (30 + 15 * LOCOS)
+
+#if DCC_ROSTER_SIZE && DCC_ROSTER_PERSIST
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#endif
+
+int main(void)
+{
+#if DCC_ROSTER_SIZE && DCC_ROSTER_PERSIST
+  DCC_host_eeprom_erase();
+  host_clock_set(0);
+  int8_t speed[LOCOS];
+
+  //write amplification: a throttle turned all the time writes a record a second, not a record a command
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    uint32_t commands = 0;
+    for(uint32_t ms = 0; ms < RUN_S * 1000UL; ms += 10)
+    {
+      uint8_t loco = commands % LOCOS;
+      speed[loco] = 2 + (commands * 7) % 100;
+      scheduler.setSpeed(3 + loco, DCC_SHORT_ADDRESS, speed[loco], 128);
+      ++commands;
+      runRails(scheduler, 1);
+      host_clock_advance(10000);
+    }
+    uint32_t writes = DCC_host_eeprom_writes;
+    CHECK(writes > 0);
+    CHECK(writes <= (RUN_S + 1) * DCC_ROSTER_RECORD_SIZE);
+    printf("%u commands in %us: %u EEPROM bytes written, %.3f a command\n", commands, RUN_S, writes,
+      (double)writes / commands);
+
+    //every slot of the log wears alike; a record's sequence number changes on every write, so its low byte counts them
+    uint32_t least = 0xFFFFFFFF, most = 0;
+    for(uint8_t slot = 0; slot < DCC_ROSTER_EEPROM_RECORDS; ++slot)
+    {
+      uint32_t wear = DCC_host_eeprom_wear[DCC_ROSTER_EEPROM_BASE + slot * DCC_ROSTER_RECORD_SIZE];
+      if(wear < least)
+        least = wear;
+      if(wear > most)
+        most = wear;
+    }
+    CHECK(least > 0);
+    CHECK(most - least <= 1);
+    printf("log wear: %u to %u writes a slot\n", least, most);
+
+    //once the last changes are saved, a layout at rest writes nothing
+    for(uint32_t ms = 0; ms < (LOCOS + 1) * DCC_ROSTER_SAVE_INTERVAL; ms += 10)
+    {
+      runRails(scheduler, 1);
+      host_clock_advance(10000);
+    }
+    writes = DCC_host_eeprom_writes;
+    for(uint32_t ms = 0; ms < 60000; ms += 10)
+    {
+      runRails(scheduler, 1);
+      host_clock_advance(10000);
+    }
+    CHECK_EQ(DCC_host_eeprom_writes, writes);
+  }
+
+  //restore time: after the reset sequence, each loco is back on the rails at its last speed within RESTORE_PACKETS
+  {
+    DCCPacketScheduler scheduler;
+    double start = seconds();
+    scheduler.setup();
+    double elapsed = seconds() - start;
+    bool seen[LOCOS];
+    memset(seen, 0, sizeof(seen));
+    uint8_t remaining = LOCOS;
+    uint32_t packets = 0;
+    std::vector<RailPacket> rails;
+    while(remaining && packets < 10 * RESTORE_PACKETS)
+    {
+      rails.clear();
+      runRails(scheduler, 1, &rails);
+      packets += rails.size();
+      for(size_t i = 0; i < rails.size(); ++i)
+      {
+        uint8_t loco = rails[i].bytes[0] - 3;
+        if(loco < LOCOS && rails[i].bytes[1] == 0x3F && !seen[loco])
+        {
+          CHECK_EQ(rails[i].bytes[2], 0x80 | speed[loco]);
+          seen[loco] = true;
+          --remaining;
+        }
+      }
+    }
+    CHECK_EQ(remaining, 0);
+    CHECK(packets <= RESTORE_PACKETS);
+    printf("restore: %u locos in %.1fus, all back on the rails %u packets after the reset\n", LOCOS, elapsed * 1e6, packets);
+  }
+
+  //a reset partway through writing a record: restore() falls back to that loco's record before it
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 100);
+    host_clock_advance(DCC_ROSTER_SAVE_INTERVAL * 1000UL);
+    scheduler.setSpeed(3, DCC_SHORT_ADDRESS, 120, 128);
+    runRails(scheduler, DCC_ROSTER_RECORD_SIZE / 2); //half of its bytes, and not the sequence number
+  }
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    std::vector<RailPacket> rails;
+    runRails(scheduler, RESTORE_PACKETS, &rails);
+    uint32_t found = 0;
+    for(size_t i = 0; i < rails.size(); ++i)
+    {
+      if(rails[i].bytes[0] == 3 && rails[i].bytes[1] == 0x3F)
+      {
+        CHECK_EQ(rails[i].bytes[2], 0x80 | speed[0]);
+        ++found;
+      }
+    }
+    CHECK(found > 0);
+  }
+
+  //restore() replaces whatever the roster held, rather than mixing it with the log
+  {
+    DCCRoster roster;
+    roster.setSpeed(99, DCC_SHORT_ADDRESS, 50, 128);
+    CHECK_EQ(roster.restore(), LOCOS);
+    CHECK(!roster.find(99, DCC_SHORT_ADDRESS));
+    for(uint8_t loco = 0; loco < LOCOS; ++loco)
+    {
+      DCCRosterEntry *e = roster.find(3 + loco, DCC_SHORT_ADDRESS);
+      CHECK(e != 0);
+      if(e)
+        CHECK_EQ(e->speed, speed[loco]);
+    }
+  }
+  host_clock_release();
+#endif
+  return TEST_RESULT();
+}
@@ -0,0 +1,67 @@
+//simulator bookkeeping: short and long forms of one number are different locos, and rejections are told apart
+#include "test.h"
+#include "DCCSimulator.h"
+
+int main(void)
+{
+  uint32_t short_key = DCCSimulator::commandKey("S 3 50");
+  uint32_t long_key = DCCSimulator::commandKey("S L3 50");
+  CHECK(short_key != long_key);
+  CHECK_EQ(DCCSimulator::commandKey("F 200 1"), DCCSimulator::commandKey("F L200 1")); //above 127 is always long
+
+  //the keys match the packets the scheduler puts out for them
+  const uint8_t short_speed[] = {0x03, 0x3F, 0x80 | 50, 0x03 ^ 0x3F ^ (0x80 | 50)};
+  const uint8_t long_speed[] = {0xC0, 0x03, 0x3F, 0x80 | 50, 0xC0 ^ 0x03 ^ 0x3F ^ (0x80 | 50)};
+  CHECK_EQ(DCCSimulator::packetKey(short_speed, sizeof(short_speed)), short_key);
+  CHECK_EQ(DCCSimulator::packetKey(long_speed, sizeof(long_speed)), long_key);
+
+  //a long-address loco's latency is measured from its own command, not from one to the short address
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCSimulator simulator(scheduler);
+    simulator.addCommand(100000, "S L3 50");
+    simulator.run(1000000);
+    CHECK_EQ(simulator.latency.count, 1);
+    CHECK(simulator.per_address[DCCSimulator::addressKey(3, DCC_LONG_ADDRESS)].packets > 0);
+    CHECK(!simulator.per_address.count(3));
+  }
+
+  //so are its packets and its speed packet intervals: each loco's repeats, not the two interleaved
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCSimulator simulator(scheduler);
+    simulator.addCommand(600000, "S L3 60"); //added out of order: run() sorts them
+    simulator.addCommand(400000, "S 3 50"); //after the reset sequence, with the short loco's repeats done by 600ms
+    simulator.run(1000000);
+    CHECK_EQ(simulator.latency.count, 2);
+    uint16_t short_3 = DCCSimulator::addressKey(3, DCC_SHORT_ADDRESS);
+    uint16_t long_3 = DCCSimulator::addressKey(3, DCC_LONG_ADDRESS);
+    CHECK(short_3 != long_3);
+    CHECK_EQ(simulator.per_address[short_3].packets, SPEED_REPEAT + 1); //sent, then repeated
+    CHECK_EQ(simulator.per_address[long_3].packets, SPEED_REPEAT + 1); //sent, then repeated
+    CHECK_EQ(simulator.refresh_interval[short_3].count, SPEED_REPEAT);
+    CHECK_EQ(simulator.refresh_interval[long_3].count, SPEED_REPEAT);
+    CHECK(simulator.refresh_interval[short_3].max < 100000); //not measured from one loco's packet to the other's
+    CHECK(simulator.refresh_interval[long_3].max < 100000);
+    CHECK_EQ(simulator.per_address[short_3].latency.count, 1);
+    CHECK_EQ(simulator.per_address[long_3].latency.count, 1);
+  }
+
+  //queue-full rejections are counted apart from malformed ones
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    DCCSimulator simulator(scheduler);
+    simulator.addCommand(1000, "S -3 50");
+    simulator.addCommand(2000, "S 3 50 27");
+    simulator.addCommand(3000, "Q");
+    simulator.run(10000);
+    CHECK_EQ(simulator.commands_issued, 3);
+    CHECK_EQ(simulator.commands_malformed, 3);
+    CHECK_EQ(simulator.commands_rejected, 0);
+    CHECK_EQ(simulator.commands_limited, 0);
+  }
+  return TEST_RESULT();
+}
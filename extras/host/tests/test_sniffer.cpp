@@ -0,0 +1,116 @@
+//track sniffer: packets encoded by DCCWaveformBuffer read back through decodeTimings(), and the counters for packets
+//with a bad XOR, cut short, or sent outside the command station's windows
+#include <vector>
+#include "test.h"
+#include "DCCSniffer.h"
+#include "DCCWaveformBuffer.h"
+
+static std::vector<std::vector<uint8_t> > heard;
+
+static void handler(DCCPacket &packet, const uint8_t *bytes, uint8_t size)
+{
+  heard.push_back(std::vector<uint8_t>(bytes, bytes + size));
+}
+
+/// Append the half-periods of bytes, sent with profile, to timings
+static void encode(std::vector<uint16_t> &timings, const uint8_t *bytes, uint8_t size,
+                   const DCC_timing_profile_t *profile = &DCC_timing_standard)
+{
+  uint16_t buffer[DCC_WAVEFORM_MAX_HALF_PERIODS];
+  uint16_t count = DCC_waveform_encode_timings(bytes, size, buffer, profile);
+  timings.insert(timings.end(), buffer, buffer + count);
+}
+
+int main(void)
+{
+  const uint8_t idle[] = {0xFF, 0x00, 0xFF};
+  const uint8_t speed[] = {0x03, 0x3F, 0x80 | 40, 0x03 ^ 0x3F ^ (0x80 | 40)};
+  const uint8_t functions[] = {0xC0, 0x03, 0x90, 0xC0 ^ 0x03 ^ 0x90}; //long address 3, F0
+  const uint8_t bad_xor[] = {0x03, 0x3F, 0x80 | 40, 0x03 ^ 0x3F ^ (0x80 | 41)};
+  const uint8_t too_short[] = {0xFF, 0xFF};
+  const uint16_t stopped = DCC_ZERO_HALF_PERIOD_RX_MAX_US + 2000; //longer than any '0': the signal stopped
+
+  //good packets, each read back byte for byte
+  {
+    DCCSniffer sniffer(handler);
+    sniffer.setup();
+    heard.clear();
+    std::vector<uint16_t> timings;
+    encode(timings, idle, sizeof(idle));
+    encode(timings, speed, sizeof(speed));
+    encode(timings, functions, sizeof(functions));
+    encode(timings, idle, sizeof(idle));
+    sniffer.decodeTimings(&timings[0], timings.size());
+    CHECK_EQ(sniffer.packets, 4);
+    CHECK_EQ(sniffer.xor_errors, 0);
+    CHECK_EQ(sniffer.framing_errors, 0);
+    CHECK_EQ(sniffer.out_of_spec, 0);
+    CHECK_EQ(sniffer.overruns, 0);
+    CHECK_EQ(sniffer.shortest_preamble, DCC_PREAMBLE_BITS - 1); //the first edge only starts the clock
+    CHECK_EQ(sniffer.idles, 2);
+    CHECK_EQ(sniffer.speeds, 1);
+    CHECK_EQ(sniffer.functions, 1);
+    CHECK_EQ(heard.size(), 4);
+    CHECK(heard.size() == 4 && heard[1] == std::vector<uint8_t>(speed, speed + sizeof(speed)));
+    CHECK(heard.size() == 4 && heard[2] == std::vector<uint8_t>(functions, functions + sizeof(functions)));
+    CHECK_EQ(sniffer.getSize(), sizeof(idle));
+    CHECK(!memcmp(sniffer.getBytes(), idle, sizeof(idle)));
+  }
+
+  //a corrupted XOR byte: counted, and not passed on
+  {
+    DCCSniffer sniffer(handler);
+    sniffer.setup();
+    heard.clear();
+    std::vector<uint16_t> timings;
+    encode(timings, idle, sizeof(idle));
+    encode(timings, bad_xor, sizeof(bad_xor));
+    encode(timings, speed, sizeof(speed));
+    sniffer.decodeTimings(&timings[0], timings.size());
+    CHECK_EQ(sniffer.packets, 2);
+    CHECK_EQ(sniffer.xor_errors, 1);
+    CHECK_EQ(sniffer.framing_errors, 0);
+    CHECK_EQ(heard.size(), 2);
+    CHECK_EQ(sniffer.speeds, 1);
+  }
+
+  //truncated packets: one cut off mid-byte by the signal stopping, and one that ends after two bytes
+  {
+    DCCSniffer sniffer(handler);
+    sniffer.setup();
+    heard.clear();
+    std::vector<uint16_t> timings;
+    encode(timings, speed, sizeof(speed));
+    timings.resize(timings.size() - 2 * (9 + 9 + 1) - 10); //the last two bytes, the end bit and five more bits gone
+    timings.push_back(stopped);
+    encode(timings, too_short, sizeof(too_short));
+    encode(timings, speed, sizeof(speed));
+    encode(timings, idle, sizeof(idle));
+    sniffer.decodeTimings(&timings[0], timings.size());
+    CHECK_EQ(sniffer.packets, 2);
+    CHECK_EQ(sniffer.framing_errors, 2);
+    CHECK_EQ(sniffer.xor_errors, 0);
+    CHECK_EQ(heard.size(), 2);
+    CHECK(heard.size() == 2 && heard[0] == std::vector<uint8_t>(speed, speed + sizeof(speed)));
+  }
+
+  //half-periods a decoder accepts but a command station may not send: read, and counted as out of spec
+  {
+    const DCC_timing_profile_t fast = {DCC_ONE_HALF_PERIOD_RX_MIN_US + 1, DCC_ZERO_HALF_PERIOD_RX_MIN_US + 1,
+                                       DCC_ZERO_HALF_PERIOD_RX_MIN_US + 1, DCC_RX_PREAMBLE_BITS + 1};
+    DCCSniffer sniffer(handler);
+    sniffer.setup();
+    heard.clear();
+    std::vector<uint16_t> timings;
+    encode(timings, speed, sizeof(speed), &fast);
+    encode(timings, idle, sizeof(idle), &fast);
+    sniffer.decodeTimings(&timings[0], timings.size());
+    CHECK_EQ(sniffer.packets, 2);
+    CHECK_EQ(sniffer.xor_errors, 0);
+    CHECK_EQ(sniffer.framing_errors, 0);
+    CHECK_EQ(sniffer.out_of_spec, timings.size() - 1);
+    CHECK_EQ(sniffer.shortest_preamble, DCC_RX_PREAMBLE_BITS);
+    CHECK(heard.size() == 2 && heard[0] == std::vector<uint8_t>(speed, speed + sizeof(speed)));
+  }
+  return TEST_RESULT();
+}
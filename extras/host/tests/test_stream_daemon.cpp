@@ -0,0 +1,65 @@
+//split command station end to end: the daemon, fed text commands through a pipe as from stdin, streaming to
+//DCCStreamBoard behind a pseudo-terminal, and the packets that board put on the rails
+#include <unistd.h>
+#include <string.h>
+#include "test.h"
+#include "DCCStreamDaemon.h"
+
+static bool onRails(const std::vector<DCCStreamRailPacket> &rails, const uint8_t *packet, uint8_t size)
+{
+  for(size_t i = 0; i < rails.size(); ++i)
+  {
+    if(rails[i].size == size && !memcmp(rails[i].packet, packet, size))
+      return true;
+  }
+  return false;
+}
+
+int main(void)
+{
+  DCCStreamBoard board;
+  if(!board.start())
+  {
+    printf("%s: no pseudo-terminal, skipped\n", __FILE__);
+    return 0;
+  }
+  DCCPacketScheduler scheduler;
+  scheduler.setup();
+  DCCStreamDaemon daemon(scheduler);
+  CHECK(daemon.open(board.path(), 115200));
+  int in[2], out[2];
+  CHECK(!pipe(in) && !pipe(out));
+  daemon.setInput(in[0], out[1]);
+
+  for(int i = 0; i < 200 && !daemon.isSynced(); ++i)
+    daemon.poll(10);
+  CHECK(daemon.isSynced());
+  CHECK_EQ(daemon.board_depth, DCC_STREAM_DEPTH);
+  daemon.run(300); //the scheduler's start-up resets
+
+  const char commands[] = "S 3 40\nF 3 1\nS -3 50\n";
+  CHECK_EQ(write(in[1], commands, sizeof(commands) - 1), (ssize_t)sizeof(commands) - 1);
+  daemon.run(500);
+  close(in[1]);
+  daemon.run(100);
+  char replies[16] = {0};
+  CHECK_EQ(read(out[0], replies, sizeof(replies) - 1), 6);
+  CHECK(!strcmp(replies, "+\n+\n?\n"));
+  board.stop();
+
+  const uint8_t speed[] = {0x03, 0x3F, 0xA8, 0x94}; //128 steps, forward, 40
+  const uint8_t functions[] = {0x03, 0x90, 0x93}; //F0 on
+  CHECK(onRails(board.rails, speed, sizeof(speed)));
+  CHECK(onRails(board.rails, functions, sizeof(functions)));
+  CHECK_EQ(daemon.commands_issued, 3);
+  CHECK_EQ(daemon.commands_rejected, 1);
+  CHECK_EQ(daemon.frames_dropped, 0);
+  CHECK(daemon.latency.count >= 2);
+  CHECK(daemon.latency.max < 200000); //8 frames of 5-8ms are ahead of a command on the board
+  CHECK(daemon.bytes_out > 0 && daemon.bytes_in > 0);
+  daemon.report(stdout);
+  close(in[0]);
+  close(out[0]);
+  close(out[1]);
+  return TEST_RESULT();
+}
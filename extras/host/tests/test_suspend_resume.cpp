@@ -0,0 +1,178 @@
+//e-stops: one loco's e-stop drops only its speed packets, and the broadcast one fits in a full pool; suspend() sets
+//the queued work aside and resume() brings it back, even with the pool full, after a second suspend() and after an
+//eStop() in between
+#include "test.h"
+#include "rails.h"
+
+/// How many packets in rails start with these bytes
+static uint32_t count(const std::vector<RailPacket> &rails, uint8_t byte0, uint8_t byte1, int byte2 = -1)
+{
+  uint32_t n = 0;
+  for(size_t i = 0; i < rails.size(); ++i)
+  {
+    if((rails[i].bytes[0] == byte0) && (rails[i].bytes[1] == byte1) && ((byte2 < 0) || (rails[i].bytes[2] == byte2)))
+      ++n;
+  }
+  return n;
+}
+
+int main(void)
+{
+  std::vector<RailPacket> rails;
+
+  //one loco's e-stop: its speed is dropped, its functions and the other locos' packets are not
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 30); //the reset sequence
+    CHECK(scheduler.setSpeed(3, DCC_SHORT_ADDRESS, 40, 128));
+    CHECK(scheduler.setFunctions0to4(3, DCC_SHORT_ADDRESS, 0x01)); //F0
+    CHECK(scheduler.setSpeed(4, DCC_SHORT_ADDRESS, 30, 128));
+    CHECK(scheduler.eStop(3, DCC_SHORT_ADDRESS));
+    runRails(scheduler, 100, &rails);
+    CHECK_EQ(rails[0].bytes[0], 3);
+    CHECK_EQ(rails[0].bytes[1], 0x41);
+    CHECK_EQ(count(rails, 3, 0x41), 10);
+    CHECK_EQ(count(rails, 3, 0x3F), 0);
+    CHECK(count(rails, 3, 0x90) > 0);
+    CHECK(count(rails, 4, 0x3F, 0x80 | 30) > 0);
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+
+  //the broadcast e-stop in a full pool: straight after setup(), with the reset sequence still queued
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    uint16_t loco = 3;
+    while(scheduler.setSpeed(loco, DCC_SHORT_ADDRESS, 40, 128))
+      ++loco;
+    while(scheduler.setFunctions0to4(loco, DCC_SHORT_ADDRESS, 0x01))
+      ++loco;
+    while(scheduler.eStop(loco, DCC_SHORT_ADDRESS))
+      ++loco;
+    CHECK(scheduler.eStop());
+    rails.clear();
+    runRails(scheduler, 60, &rails);
+    CHECK_EQ(count(rails, 0x00, 0x71), 10);
+    CHECK_EQ(count(rails, 3, 0x3F), 0);
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+
+#if DCC_ESTOP_SNAPSHOT
+  //and when suspend() has set aside every slot the queues' reservations leave
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    uint16_t loco = 3;
+    while(scheduler.setFunctions0to4(loco, DCC_SHORT_ADDRESS, 0x01))
+      ++loco;
+    CHECK(scheduler.suspend());
+    rails.clear();
+    runRails(scheduler, 60, &rails);
+    CHECK_EQ(count(rails, 0x00, 0x71), 10);
+    CHECK(scheduler.resume());
+  }
+
+  //suspend, then resume: the functions come back; with restart, so does the speed
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 30);
+    CHECK(!scheduler.resume()); //nothing suspended
+    CHECK(scheduler.setSpeed(3, DCC_SHORT_ADDRESS, 40, 128));
+    CHECK(scheduler.setFunctions0to4(3, DCC_SHORT_ADDRESS, 0x01));
+    CHECK(scheduler.setFunctions5to8(3, DCC_SHORT_ADDRESS, 0x02)); //F6
+    CHECK(scheduler.suspend());
+    CHECK(scheduler.isSuspended());
+    rails.clear();
+    runRails(scheduler, 100, &rails);
+    CHECK_EQ(count(rails, 0x00, 0x71), 10); //the broadcast e-stop
+    CHECK_EQ(count(rails, 3, 0x3F), 0);
+    CHECK_EQ(count(rails, 3, 0x90), 0);
+    CHECK_EQ(count(rails, 3, 0xB2), 0);
+    CHECK(scheduler.resume(true));
+    CHECK(!scheduler.isSuspended());
+    rails.clear();
+    runRails(scheduler, 100, &rails);
+    CHECK(count(rails, 3, 0x90) > 0);
+    CHECK(count(rails, 3, 0xB2) > 0);
+#if DCC_ROSTER_SIZE
+    CHECK(count(rails, 3, 0x3F, 0x80 | 40) > 0);
+#endif
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+
+  //resume with the pool full: nothing set aside is lost, and neither is any slot
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 30);
+    for(uint16_t loco = 3; loco < 3 + LOW_PRIORITY_QUEUE_RESERVE + 2; ++loco)
+      CHECK(scheduler.setFunctions0to4(loco, DCC_SHORT_ADDRESS, 0x01));
+    CHECK(scheduler.suspend());
+    runRails(scheduler, 20);
+    uint16_t accessories = 0;
+#if DCC_ACCESSORIES
+    while(scheduler.setBasicAccessory(100 + accessories, 0)) //other addresses, so nothing set aside is overtaken
+      ++accessories;
+    CHECK(accessories > 0);
+#else
+    while(scheduler.setFunctions0to4(100 + accessories, DCC_SHORT_ADDRESS, 0x01))
+      ++accessories;
+#endif
+    //the set-aside packets kept their slots, so they all go back in
+    CHECK(scheduler.resume());
+    CHECK(!scheduler.isSuspended());
+    rails.clear();
+    for(uint32_t i = 0; (i < 100) && (scheduler.packet_pool.getFreeCount() < PACKET_POOL_SIZE); ++i)
+      runRails(scheduler, 100, &rails);
+    for(uint16_t loco = 3; loco < 3 + LOW_PRIORITY_QUEUE_RESERVE + 2; ++loco)
+      CHECK(count(rails, loco, 0x90) > 0);
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+
+  //suspend twice: the first snapshot stands, and what was queued between the two is discarded
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 30);
+    CHECK(scheduler.setFunctions0to4(3, DCC_SHORT_ADDRESS, 0x01));
+    CHECK(scheduler.suspend());
+    CHECK(scheduler.setFunctions0to4(5, DCC_SHORT_ADDRESS, 0x01));
+    CHECK(!scheduler.suspend());
+    CHECK(scheduler.isSuspended());
+    rails.clear();
+    runRails(scheduler, 30, &rails);
+    CHECK_EQ(count(rails, 0x00, 0x71), 10); //the second e-stop went out too, once the first had finished
+    CHECK(scheduler.resume());
+    rails.clear();
+    runRails(scheduler, 100, &rails);
+    CHECK(count(rails, 3, 0x90) > 0);
+    CHECK_EQ(count(rails, 5, 0x90), 0);
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+
+  //eStop() while suspended keeps the snapshot for resume()
+  {
+    DCCPacketScheduler scheduler;
+    scheduler.setup();
+    runRails(scheduler, 30);
+    CHECK(scheduler.setFunctions0to4(3, DCC_SHORT_ADDRESS, 0x01));
+    CHECK(scheduler.suspend());
+    runRails(scheduler, 20);
+    CHECK(scheduler.eStop());
+    CHECK(scheduler.eStop(4, DCC_SHORT_ADDRESS));
+    CHECK(scheduler.isSuspended());
+    rails.clear();
+    runRails(scheduler, 30, &rails);
+    CHECK_EQ(count(rails, 0x00, 0x71), 10);
+    CHECK_EQ(count(rails, 4, 0x41), 10);
+    CHECK(scheduler.resume());
+    rails.clear();
+    runRails(scheduler, 100, &rails);
+    CHECK(count(rails, 3, 0x90) > 0);
+    CHECK_EQ(scheduler.packet_pool.getFreeCount(), PACKET_POOL_SIZE);
+  }
+#endif
+  return TEST_RESULT();
+}
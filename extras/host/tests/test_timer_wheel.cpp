@@ -0,0 +1,96 @@
+//timer wheel: 200,000 random ticks against a plain list of due times; every timer expires on exactly its tick,
+//whether it lands in the near wheel, the far wheel or beyond it, and none is lost or expires twice
+#include "test.h"
+#include "DCCTimerWheel.h"
+
+#define TICKS 200000UL
+
+#if DCC_PULSE_TIMERS
+static uint32_t state = 12345;
+
+static uint32_t random32(void) //xorshift, so every run and every host sees the same ticks
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+#endif
+
+int main(void)
+{
+#if DCC_PULSE_TIMERS
+  DCCTimerWheel wheel;
+  uint32_t due[DCC_PULSE_TIMERS]; //tick each running timer should expire on; 0 if it is not running
+  bool parked[DCC_PULSE_TIMERS]; //started with a wait that may reach past the far wheel
+  memset(due, 0, sizeof(due));
+  memset(parked, 0, sizeof(parked));
+  uint8_t parked_running = 0; //at most a quarter of the timers, or they would all sit out the long waits
+  uint32_t started = 0, expired = 0, wrong = 0, early = 0, longest = 0;
+  for(uint32_t now = 0; now < TICKS; ++now)
+  {
+    //now and then a batch takes every free timer, as a layout's worth of turnouts thrown at once
+    uint8_t starts = (random32() % 1000 == 0) ? DCC_PULSE_TIMERS : random32() % 3;
+    for(uint8_t i = 0; i < starts; ++i)
+    {
+      uint8_t timer = wheel.allocate();
+      if(timer == DCC_WHEEL_NONE)
+        break;
+      uint32_t r = random32();
+      uint16_t ticks;
+      uint8_t kind = (r & 1) ? 0 : ((r & 2) ? 1 : ((parked_running < DCC_PULSE_TIMERS / 4) ? 2 + ((r >> 2) & 1) : 1));
+      switch(kind)
+      {
+        case 0: ticks = (r >> 8) % (DCC_WHEEL_NEAR_SLOTS + 1); break; //0 means 1
+        case 1: ticks = (r >> 8) % (DCC_WHEEL_NEAR_SLOTS * DCC_WHEEL_FAR_SLOTS + 64); break; //either side of the far wheel's end
+        case 2: ticks = (r >> 8) % (DCC_WHEEL_MAX_TICKS + 1); break; //parked and placed again
+        default: ticks = 0xFFFF - (r >> 8) % 64; break; //clamped to DCC_WHEEL_MAX_TICKS
+      }
+      uint16_t expect = ticks ? ((ticks > DCC_WHEEL_MAX_TICKS) ? DCC_WHEEL_MAX_TICKS : ticks) : 1;
+      wheel.start(timer, ticks);
+      due[timer] = now + expect;
+      parked[timer] = (kind >= 2);
+      parked_running += parked[timer];
+      if(expect > longest)
+        longest = expect;
+      ++started;
+    }
+
+    uint8_t timer = wheel.tick();
+    uint32_t count = 0;
+    while(timer != DCC_WHEEL_NONE)
+    {
+      uint8_t following = wheel.next[timer];
+      if(!due[timer])
+        ++wrong; //not running, or expired already
+      else if(due[timer] != now + 1)
+        ++early;
+      due[timer] = 0;
+      parked_running -= parked[timer];
+      wheel.release(timer);
+      timer = following;
+      ++count;
+    }
+    expired += count;
+    for(uint8_t i = 0; i < DCC_PULSE_TIMERS; ++i)
+    {
+      if(due[i] && due[i] <= now + 1)
+      {
+        ++wrong; //late: its tick has gone by
+        due[i] = 0;
+        parked_running -= parked[i];
+      }
+    }
+  }
+  CHECK_EQ(wrong, 0);
+  CHECK_EQ(early, 0);
+  CHECK(started > TICKS / 100);
+  CHECK_EQ(longest, DCC_WHEEL_MAX_TICKS);
+  uint32_t running = 0;
+  for(uint8_t i = 0; i < DCC_PULSE_TIMERS; ++i)
+    running += due[i] ? 1 : 0;
+  CHECK_EQ(expired + running, started);
+  printf("%lu ticks: %u timers started, %u expired on time, %u still running\n", TICKS, started, expired, running);
+#endif
+  return TEST_RESULT();
+}
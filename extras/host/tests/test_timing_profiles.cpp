@@ -0,0 +1,76 @@
+//timing profiles: each predefined one inside the S 9.1 windows a command station sends in, throughput with a margin
+//to spare at either clock extreme, every half-period it encodes too; and profiles outside them refused
+#include "test.h"
+#include "DCCWaveformBuffer.h"
+#include "DCCHardware.h"
+
+#define CLOCK_TOLERANCE 0.005 //a 16MHz resonator
+
+/// Check one half-period of us, as the AVR timer sends it with the clock tolerance either way, against [min,max]
+static void checkHalfPeriod(uint16_t us, uint16_t min, uint16_t max)
+{
+  double sent = us; //OCR1A = us*2 - 1 ticks of 0.5us, exact at 16MHz (DCCHardware.c)
+  CHECK(sent * (1 - CLOCK_TOLERANCE) >= min);
+  CHECK(sent * (1 + CLOCK_TOLERANCE) <= max);
+}
+
+static void checkProfile(const DCC_timing_profile_t *profile)
+{
+  CHECK(DCC_timing_valid(profile));
+  checkHalfPeriod(profile->one_us, DCC_ONE_HALF_PERIOD_MIN_US, DCC_ONE_HALF_PERIOD_MAX_US);
+  checkHalfPeriod(profile->zero_high_us, DCC_ZERO_HALF_PERIOD_MIN_US, DCC_ZERO_HALF_PERIOD_MAX_US);
+  checkHalfPeriod(profile->zero_low_us, DCC_ZERO_HALF_PERIOD_MIN_US, DCC_ZERO_HALF_PERIOD_MAX_US);
+  CHECK(profile->preamble_bits >= DCC_PREAMBLE_BITS);
+  CHECK(profile->preamble_bits <= DCC_MAX_PREAMBLE_BITS);
+
+  //every half-period of an encoded packet: both halves of a bit the same length, in the '1' or the '0' window
+  const uint8_t speed[] = {0x03, 0x3F, 0x80 | 40, 0x03 ^ 0x3F ^ (0x80 | 40)};
+  uint16_t timings[DCC_WAVEFORM_MAX_HALF_PERIODS];
+  uint16_t count = DCC_waveform_encode_timings(speed, sizeof(speed), timings, profile);
+  CHECK_EQ(count, 2 * (profile->preamble_bits + 9 * sizeof(speed) + 1));
+  for(uint16_t i = 0; i + 1 < count; i += 2)
+  {
+    bool one = timings[i] <= DCC_ONE_HALF_PERIOD_MAX_US;
+    CHECK(one ? (timings[i] >= DCC_ONE_HALF_PERIOD_MIN_US) : (timings[i] >= DCC_ZERO_HALF_PERIOD_MIN_US));
+    CHECK(one ? (timings[i + 1] == timings[i]) : (timings[i + 1] >= DCC_ZERO_HALF_PERIOD_MIN_US && timings[i + 1] <= DCC_ZERO_HALF_PERIOD_MAX_US));
+  }
+}
+
+int main(void)
+{
+  checkProfile(&DCC_timing_standard);
+  checkProfile(&DCC_timing_throughput);
+  checkProfile(&DCC_timing_service);
+  CHECK_EQ(DCC_timing_throughput.one_us, DCC_ONE_HALF_PERIOD_MIN_US + DCC_TIMING_MARGIN_US);
+  CHECK_EQ(DCC_timing_throughput.zero_high_us, DCC_ZERO_HALF_PERIOD_MIN_US + DCC_TIMING_MARGIN_US);
+  CHECK(DCC_timing_throughput.one_us < DCC_timing_standard.one_us); //still faster than standard
+  CHECK_EQ(DCC_timing_service.preamble_bits, DCC_SERVICE_PREAMBLE_BITS);
+
+  //the spec limits themselves are accepted, one microsecond or one bit past them is not
+  {
+    DCC_timing_profile_t profile = {DCC_ONE_HALF_PERIOD_MIN_US, DCC_ZERO_HALF_PERIOD_MIN_US, DCC_ZERO_HALF_PERIOD_MAX_US, DCC_PREAMBLE_BITS};
+    CHECK(DCC_timing_valid(&profile));
+    profile.one_us = DCC_ONE_HALF_PERIOD_MIN_US - 1;
+    CHECK(!DCC_timing_valid(&profile));
+    profile.one_us = DCC_ONE_HALF_PERIOD_MAX_US + 1;
+    CHECK(!DCC_timing_valid(&profile));
+    profile.one_us = DCC_ONE_HALF_PERIOD_MAX_US;
+    profile.zero_high_us = DCC_ZERO_HALF_PERIOD_MIN_US - 1;
+    CHECK(!DCC_timing_valid(&profile));
+    profile.zero_high_us = DCC_ZERO_HALF_PERIOD_MIN_US;
+    profile.zero_low_us = DCC_ZERO_HALF_PERIOD_MAX_US + 1;
+    CHECK(!DCC_timing_valid(&profile));
+    profile.zero_low_us = DCC_ZERO_HALF_PERIOD_MAX_US;
+    profile.preamble_bits = DCC_PREAMBLE_BITS - 1;
+    CHECK(!DCC_timing_valid(&profile));
+    profile.preamble_bits = DCC_MAX_PREAMBLE_BITS + 1;
+    CHECK(!DCC_timing_valid(&profile));
+
+    //and the backend keeps the profile it had
+    CHECK(DCC_waveform_set_timing(&DCC_timing_throughput));
+    CHECK(!DCC_waveform_set_timing(&profile));
+    CHECK(DCC_waveform_timing() == &DCC_timing_throughput);
+    CHECK(DCC_waveform_set_timing(&DCC_timing_standard));
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,35 @@
+/**
+ * dcc_trace: prints a binary packet trace dump (DCCPacketTrace.h) as text, one packet per line.
+ *   dcc_trace [dump]
+ * The dump is read from the file named, or from stdin: as saved off a board's serial port after
+ * scheduler.trace.dump(Serial), say. Exits non-zero if the dump is malformed.
+**/
+
+#include <stdio.h>
+#include "DCCPacketTrace.h"
+
+int main(int argc, char **argv)
+{
+  if(argc > 2)
+  {
+    fprintf(stderr, "usage: %s [dump]\n", argv[0]);
+    return 2;
+  }
+  FILE *in = (argc == 2) ? fopen(argv[1], "rb") : stdin;
+  if(!in)
+  {
+    perror(argv[1]);
+    return 2;
+  }
+  //the largest dump: the header and 255 entries of 5 + 6 bytes
+  static uint8_t buffer[6 + 255 * 11 + 1];
+  size_t length = fread(buffer, 1, sizeof(buffer), in);
+  if(in != stdin)
+    fclose(in);
+  if(length == sizeof(buffer) || !DCCPacketTrace::decode(buffer, length, stdout))
+  {
+    fprintf(stderr, "not a packet trace dump (version %u)\n", DCC_TRACE_VERSION);
+    return 1;
+  }
+  return 0;
+}